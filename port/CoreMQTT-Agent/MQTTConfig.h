@@ -15,7 +15,9 @@
 
 
 
-#define MQTT_RECON_DELAY 3000 //Ticks to wait on reconnect
+#define MQTT_BACKOFF_BASE_MS 3000 //First reconnect delay ceiling, ms
+#define MQTT_BACKOFF_CAP_MS 120000 //Maximum reconnect delay ceiling, ms
+#define MQTT_BACKOFF_STABLE_MS 30000 //Session up this long resets backoff, ms
 #define MQTT_KEEP_ALIVE 10 //Keep alive publish timer, seconds
 
 
@@ -25,6 +27,7 @@
 #define MQTT_TOPIC_LIFECYCLE_OFFLINE "OFF"
 #define MQTT_TOPIC_LIFECYCLE_ONLINE "ON"
 #define MQTT_TOPIC_LIFECYCLE_KEEP_ALIVE "KEEP"
+#define MQTT_TOPIC_LIFECYCLE_CONN "CONN"
 #define MQTT_TOPIC_GROUP_HEADER "GRP"
 #define MQTT_STATE_TOPIC "STATE"
 #define MQTT_STATE_TOPIC_UPDATE "UPD"
@@ -100,4 +100,21 @@ struct NetworkContext
 #define MQTT_AGENT_COMMAND_QUEUE_LENGTH              ( 25 )
 #define MQTT_COMMAND_CONTEXTS_POOL_SIZE              ( 10 )
 
+/**
+ * @brief Keep alive in seconds sent in CONNECT. Defined here as well as in
+ * MQTTAgent.h so the agent queue wait below can be derived from it.
+ */
+#ifndef MQTTKEEPALIVETIME
+#define MQTTKEEPALIVETIME 10
+#endif
+
+/**
+ * @brief Longest the agent blocks on its command queue when idle. Received
+ * data wakes it through a process loop command posted by the transport, but
+ * PINGREQ is only checked when the loop runs, so it can leave up to this
+ * long after it is due. A quarter of the keep alive keeps it well inside
+ * the broker's 1.5 times grace.
+ */
+#define MQTT_AGENT_MAX_EVENT_QUEUE_WAIT_TIME         ( ( MQTTKEEPALIVETIME * 1000U ) / 4U )
+
 #endif /* ifndef CORE_MQTT_CONFIG_H_ */
@@ -13,6 +13,7 @@
 
 #define LWIP_SOCKET                 1
 #define LWIP_SO_RCVBUF				1
+#define LWIP_SO_RCVTIMEO			1
 #define RECV_BUFSIZE_DEFAULT		256
 
 #define MEM_LIBC_MALLOC             0
@@ -567,12 +567,16 @@ extern unsigned int my_rng_seed_gen(void);
 #define WOLFSSL_BASE64_ENCODE
 
 /* TLS Session Cache */
-#if 0
+#if 1
     #define SMALL_SESSION_CACHE
 #else
     #define NO_SESSION_CACHE
 #endif
 
+/* Session tickets for resumption */
+#undef  HAVE_SESSION_TICKET
+#define HAVE_SESSION_TICKET
+
 
 /* ------------------------------------------------------------------------- */
 /* Disable Features */
@@ -25,7 +25,6 @@
 #include "pico/time.h"
 #include "pico/types.h"
 #include "projdefs.h"
-#include "tiny-json.h"
 #include <cstddef>
 #include <cstdint>
 #include <ctime>
@@ -39,6 +38,8 @@
 
 #define NUM_BLINKS_MESSAGE 10
 
+MQTTRxBufferPool BadgerAgent::xRxPool;
+
 /***
  * Constructor
  * @param ledGP - GPIO Pad of LED to control
@@ -56,6 +57,10 @@ BadgerAgent::BadgerAgent(MQTTInterface *interface) : currentView(NULL), player(B
 	eventView = std::shared_ptr<EventView>(new EventView(badger, skipTimeDisplayCount));
 	mainView = std::shared_ptr<MainView>(new MainView(badger, skipTimeDisplayCount, eventView, reminderView));
 
+	//JSON is streamed straight into the reminder and event views
+	pCalHandler = new CalendarJsonHandler(reminderView, eventView);
+	pJsonReader = new JsonSax(pCalHandler);
+
 	//Display init screen
 	setView(mainView);
 	currentView->displayView();
@@ -72,10 +77,24 @@ BadgerAgent::BadgerAgent(MQTTInterface *interface) : currentView(NULL), player(B
 		LogError(("Unable to create Queue\n"));
 	}
 
-	//Construct a message buffer
-	xBuffer = xMessageBufferCreate(BADGER_BUFFER_LEN);
-	if (xBuffer == NULL){
-		LogError(("Buffer could not be allocated\n"));
+	//Received JSON is passed as pooled buffers, no copy through a message buffer
+	if (!xRxPool.init()){
+		LogError(("Receive pool could not be created\n"));
+	}
+	xJsonQ = xQueueCreate( BADGER_JSON_QUEUE_LEN, sizeof(rx_buffer_t *));
+
+	//Mailbox for HTTP jobs the worker has finished
+	xHttpQ = xQueueCreate( BADGER_HTTP_QUEUE_LEN, sizeof(HTTPJob *));
+	pWeatherJob = new WeatherJob(BADGER_WEATHER_LAT, BADGER_WEATHER_LON);
+
+	//Single set the agent task blocks on for actions, JSON and HTTP results
+	xWaitSet = xQueueCreateSet(BADGER_SET_LEN);
+	if ((xWaitSet == NULL) || (xJsonQ == NULL) || (xCmdQ == NULL) || (xHttpQ == NULL)){
+		LogError(("Unable to create wait set\n"));
+	} else {
+		xQueueAddToSet(xCmdQ, xWaitSet);
+		xQueueAddToSet(xJsonQ, xWaitSet);
+		xQueueAddToSet(xHttpQ, xWaitSet);
 	}
 
 	//Construct the TOPIC for status messages
@@ -139,6 +158,12 @@ BadgerAgent::BadgerAgent(MQTTInterface *interface) : currentView(NULL), player(B
 	nvs = NVSOnboard::getInstance();
 	loadJSONFromNVS();
 
+	//Show the last weather straight away, the worker refreshes it if stale
+	if (pWeatherJob->getRequest().loadCache()){
+		mainView->updateWeatherInfo(pWeatherJob->getRequest());
+	}
+	sendAction(GetWeather);
+
 	//Initlaize speaker and play song
 	player.playSong();
 	
@@ -164,8 +189,28 @@ BadgerAgent::~BadgerAgent() {
 		vPortFree(pTopicBadgerState);
 		pTopicBadgerState = NULL;
 	}
-	if (xBuffer != NULL){
-		vMessageBufferDelete(xBuffer);
+	if (pJsonReader != NULL){
+		delete pJsonReader;
+		pJsonReader = NULL;
+	}
+	if (pCalHandler != NULL){
+		delete pCalHandler;
+		pCalHandler = NULL;
+	}
+	if (xJsonQ != NULL){
+		rx_buffer_t *buf;
+		while (xQueueReceive(xJsonQ, &buf, 0) == pdTRUE){
+			xRxPool.release(buf);
+		}
+		vQueueDelete(xJsonQ);
+	}
+	if (pWeatherJob != NULL){
+		//Worker still holds it, leave it rather than free under it
+		pWeatherJob->cancel();
+		if (!xWeatherPending){
+			delete pWeatherJob;
+		}
+		pWeatherJob = NULL;
 	}
 }
 
@@ -228,9 +273,78 @@ void BadgerAgent::sendAction(BadgerAction action, bool putFront){
 	}
 	if (res != pdTRUE){
 		LogWarn(("Queue is full\n"));
+	} else {
+		markPosted();
+	}
+}
+
+/***
+ * Record time of post, used to measure wake latency
+ */
+void BadgerAgent::markPosted(){
+	if (xPostedUs == 0){
+		xPostedUs = time_us_64();
 	}
 }
 
+/***
+ * Worst case time from a message or action being posted to the
+ * agent task waking to handle it
+ * @return micro seconds
+ */
+uint32_t BadgerAgent::getWakeLatencyMaxUs(){
+	return xWakeLatencyMaxUs;
+}
+
+/***
+ * Time from the last post to the agent task waking
+ * @return micro seconds
+ */
+uint32_t BadgerAgent::getWakeLatencyLastUs(){
+	return xWakeLatencyLastUs;
+}
+
+/***
+ * Percentage of time the agent task has been blocked waiting for work
+ * since it started
+ * @return 0 - 100
+ */
+uint8_t BadgerAgent::getIdlePercent(){
+	if (xRunStartUs == 0){
+		return 0;
+	}
+	uint64_t total = time_us_64() - xRunStartUs;
+	if (total == 0){
+		return 0;
+	}
+	return (uint8_t)((xIdleUs * 100) / total);
+}
+
+/***
+ * Worst case time from a button press to the screen being redrawn
+ * @return micro seconds
+ */
+uint32_t BadgerAgent::getButtonLatencyMaxUs(){
+	return xButtonLatencyMaxUs;
+}
+
+/***
+ * Time from the last button press to the screen being redrawn
+ * @return micro seconds
+ */
+uint32_t BadgerAgent::getButtonLatencyLastUs(){
+	return xButtonLatencyLastUs;
+}
+
+/***
+ * Set worker that runs HTTP requests off this task.
+ * Without one requests block the agent task
+ * @param agent
+ */
+void BadgerAgent::setHTTPAgent(HTTPAgent *agent){
+	pHTTPAgent = agent;
+}
+
 /***
  * Toggle LED state from within an intrupt
  */
@@ -260,6 +374,11 @@ void BadgerAgent::handleButtonInput(uint8_t gp){
 	BaseType_t res = xQueueSendToFrontFromISR(xCmdQ, (void *)&action, NULL);
 	if (res != pdTRUE){
 		LogWarn(("Queue is full\n"));
+	} else {
+		markPosted();
+		if (xPressedUs == 0){
+			xPressedUs = time_us_64();
+		}
 	}
 }
 
@@ -268,48 +387,64 @@ void BadgerAgent::handleButtonInput(uint8_t gp){
   * Main Run Task for agent
   */
 void BadgerAgent::run(){
-	BaseType_t res;
 	BadgerAction action = RefreshScreen;
-	char jsonStr[BADGER_JSON_LEN];
-	size_t readLen;
+	rx_buffer_t *buf;
+	HTTPJob *job;
+	QueueSetMemberHandle_t xMember;
+	uint64_t xWaitStart;
 
-	if (xCmdQ == NULL){
+	if ((xCmdQ == NULL) || (xWaitSet == NULL)){
 		return;
 	}
 
+	xRunStartUs = time_us_64();
+
 	while (true) { // Loop forever
-		readLen = xMessageBufferReceive(
-						 xBuffer,
-				         jsonStr,
-						 BADGER_JSON_LEN,
-						 0
-				    );
-		if (readLen > 0){
-			jsonStr[readLen] = 0;
-	        parseJSON(jsonStr);
+		// Block until there is work, no CPU used while idle
+		xWaitStart = time_us_64();
+		xMember = xQueueSelectFromSet(xWaitSet, portMAX_DELAY);
+		uint64_t now = time_us_64();
+		xIdleUs += now - xWaitStart;
+
+		uint64_t posted = xPostedUs;
+		xPostedUs = 0;
+		if ((posted != 0) && (now > posted)){
+			xWakeLatencyLastUs = (uint32_t)(now - posted);
+			if (xWakeLatencyLastUs > xWakeLatencyMaxUs){
+				xWakeLatencyMaxUs = xWakeLatencyLastUs;
+			}
 		}
 
-		res = xQueueReceive(xCmdQ, (void *)&action, 0);
-		if (res == pdTRUE){
-			switch(action){		
-				case ScrollDown: {
-					handleScrollAction(false);
-					break;
-				}
-				case ScrollUp: {
-					handleScrollAction(true);
-					break;
-				}
-				case RefreshScreen: {
-					refreshDisplay();
-					break;
-				}	
-				case GetWeather: {
-					getWeather();
-					break;
+		if (xMember == xJsonQ){
+			if (xQueueReceive(xJsonQ, &buf, 0) == pdTRUE){
+				parseJSON(buf->data, buf->len);
+				xRxPool.release(buf);
+			}
+		} else if (xMember == xHttpQ){
+			if (xQueueReceive(xHttpQ, &job, 0) == pdTRUE){
+				weatherReady(job);
+			}
+		} else if (xMember == xCmdQ){
+			if (xQueueReceive(xCmdQ, (void *)&action, 0) == pdTRUE){
+				switch(action){
+					case ScrollDown: {
+						handleScrollAction(false);
+						break;
+					}
+					case ScrollUp: {
+						handleScrollAction(true);
+						break;
+					}
+					case RefreshScreen: {
+						refreshDisplay();
+						break;
+					}
+					case GetWeather: {
+						getWeather();
+						break;
+					}
 				}
 			}
-			taskYIELD();
 		}
 	}
 }
@@ -352,84 +487,55 @@ void BadgerAgent::blinkLED(int blinks){
 	 return 1024*3; //Was 1024
  }
 
-std::optional<eventReminder_t> BadgerAgent::processJsonToReminder(json_t const* reminderJson) {
-
-	char const* titleJ = json_getPropertyValue( reminderJson, "title" );
-	char const* dateJ = json_getPropertyValue( reminderJson, "date" );
-	char const* timeJ = json_getPropertyValue( reminderJson, "time" );
-	json_t const* timeField = json_getProperty( reminderJson, "epoch time" );
-	if (timeField != NULL && JSON_INTEGER == json_getType(timeField)) {
-		int epochTime = json_getInteger(timeField);
-	}
-
-	if ( titleJ  && dateJ && timeJ) {
-		eventReminder_t newEventReminder = { 
-			.title = titleJ,
-			.date = dateJ,
-			.time = timeJ};
-		LogDebug(("Reminder: %s , due date: %s %s",newEventReminder.title.c_str(), newEventReminder.time.c_str(), newEventReminder.date.c_str()));
-		return newEventReminder;
-	}
-	return std::nullopt;
-}
-
-void BadgerAgent::parseJSONEventsReminders(json_t const* reminderList, json_t const* eventList) {
-
-	//Clear previous reminders and start at index 0
-	reminderView->clear();
-	if (reminderList != NULL) {
-		for( auto remind = json_getChild( reminderList ); remind != 0; remind = json_getSibling( remind ) ) {
-			if ( JSON_OBJ == json_getType( remind ) ) {
-				auto newReminder = processJsonToReminder(remind);
-				if (newReminder.has_value()) reminderView->addReminder(newReminder.value());
-			}
-			else {
-				LogError(("Couldn't parse reminder!"));
-			}
-		}
-	}
-	
-	eventView->clear();
-	if (eventList != NULL) {
-		for( auto event = json_getChild( eventList ); event != 0; event = json_getSibling( event ) ) {
-			if ( JSON_OBJ == json_getType( event ) ) {
-				auto newEvent = processJsonToReminder(event);
-				if (newEvent.has_value()) eventView->addEvent(newEvent.value());
-			}
-			else {
-				LogError(("Couldn't parse reminder!"));
-			}
-		}
-	}
-	
+/***
+ * Stream a JSON string into the views. Views only change if the
+ * whole document is valid
+ * @param str - JSON String, need not be zero terminated
+ * @param len - length of string
+ * @return true if the whole document was valid
+ */
+bool BadgerAgent::streamJSON(const char *str, size_t len){
+	pCalHandler->reset();
+	pJsonReader->reset();
+	if (!pJsonReader->feed(str, len) || !pJsonReader->finish()){
+		LogError(("Error json parse at byte %d", pJsonReader->getBytes()));
+		//Views keep the last good calendar
+		pCalHandler->reset();
+		return false;
+	}
+	if (pJsonReader->getTruncated() > 0){
+		LogWarn(("%lu json keys truncated", (unsigned long) pJsonReader->getTruncated()));
+	}
+	pCalHandler->apply();
+	return true;
 }
 
 /***
 * Parse a JSON string and add request to queue
-* @param str - JSON Strging
+* @param str - JSON Strging, read in place and not modified
+* @param len - length of string
 */
-void BadgerAgent::parseJSON(char *str){
+void BadgerAgent::parseJSON(const char *str, size_t len){
 
-	json_t const* subJsons[NUM_FIELDS];
-	std::string cleanStr(str);
-	JsonFieldFlag fields = jsonFieldsPresent(str, subJsons);
+	if (!streamJSON(str, len)){
+		return;
+	}
 
-	if (fields.b.events|| fields.b.reminders) {
-		LogInfo(("%s %s found", fields.b.reminders ? "Reminders" : "", fields.b.events ? "Events" : ""));
-		parseJSONEventsReminders(fields.b.reminders ? subJsons[REMINDERS] : NULL, fields.b.events ? subJsons[EVENTS] : NULL);
+	if (pCalHandler->hasEvents() || pCalHandler->hasReminders()) {
+		LogInfo(("%s %s found", pCalHandler->hasReminders() ? "Reminders" : "", pCalHandler->hasEvents() ? "Events" : ""));
 		messageView->setMessage("New events and reminders. Press A to see reminder and B to see events");
 		setView(messageView);
 		blinkLED(NUM_BLINKS_MESSAGE);
 		sendAction(RefreshScreen, true);
-		nvs->set_str("jsons", cleanStr.c_str());
+		//Text is unchanged by the reader so persist straight from it
+		nvs->set_str("jsons", str);
 		nvs->commit();
 		player.playSong();
 	}
 
-	if (fields.b.message) {
+	if (pCalHandler->hasMessage()) {
 		LogInfo(("Message found"));
-		std::string msgToDisplay = json_getValue(subJsons[MESSAGES]);
-		messageView->setMessage(msgToDisplay);
+		messageView->setMessage(pCalHandler->getMessage());
 		setView(messageView);
 		blinkLED(NUM_BLINKS_MESSAGE);
 		sendAction(RefreshScreen, true);
@@ -439,18 +545,19 @@ void BadgerAgent::parseJSON(char *str){
 
 void BadgerAgent::loadJSONFromNVS(void) {
 	
-	if (nvs->contains("jsons")) {
-
-		size_t maxLen = BADGER_JSON_LEN;
-		char jsonStr[maxLen];
-		nvs->get_str("jsons", jsonStr, &maxLen);
-		json_t const* subJsons[NUM_FIELDS];
-		JsonFieldFlag fields = jsonFieldsPresent(jsonStr, subJsons);
-		if (fields.b.events|| fields.b.reminders) {
-			parseJSONEventsReminders(fields.b.reminders ? subJsons[REMINDERS] : NULL, fields.b.events ? subJsons[EVENTS] : NULL);
+	const char *jsonStr;
+	size_t len;
+	uint32_t gen = nvs->getGeneration();
+
+	if (nvs->view_str("jsons", &jsonStr, &len) == NVS_OK) {
+
+		//Parsed in place in flash, no copy on the stack
+		bool valid = streamJSON(jsonStr, len - 1);
+		if (nvs->getGeneration() != gen){
+			LogWarn(("NVS changed while loading json"));
 		}
-		else {
-			LogError(("Json saved in NVS does not contain reminders or events, deleting entry"));
+		if (!valid || !(pCalHandler->hasEvents() || pCalHandler->hasReminders())) {
+			LogError(("Json saved in NVS is invalid or has no reminders or events, deleting entry"));
 			nvs->erase_key("jsons");
 			nvs->commit();
 		}
@@ -461,51 +568,6 @@ void BadgerAgent::loadJSONFromNVS(void) {
 
 }
 
-/***
-* Parse a JSON string and add request to queue
-* * @param str - JSON Strging
-*/
-JsonFieldFlag BadgerAgent::jsonFieldsPresent(char *str, json_t const* outJsons[]){
-	
-	JsonFieldFlag fields = {0};
-	json_t const* json = json_create( str, pJsonPool, BADGER_JSON_POOL);
-	if ( !json ) {
-		LogError(("Error json create."));
-		return fields;
-	}
-	
-	
-	json_t const* remindersJson = json_getProperty( json, "reminders" );
-	if ( !remindersJson|| JSON_ARRAY != json_getType( remindersJson) ) {
-		LogDebug(("The reminders property is not found."));
-
-	}
-	else {
-		fields.b.reminders = 1;
-		outJsons[REMINDERS] = remindersJson;
-	}
-
-	json_t const* eventJson = json_getProperty( json, "calendar" );
-	if ( !eventJson|| JSON_ARRAY != json_getType( eventJson) ) {
-		LogDebug(("The calendar property is not found."));
-	}
-	else {
-		fields.b.events = 1;
-		outJsons[EVENTS] = eventJson;
-	}
-
-	json_t const* messageJson = json_getProperty( json, "message" );
-	if ( !messageJson || JSON_TEXT != json_getType( messageJson ) ) {
-		LogDebug(("The message property is not found."));
-	}
-	else {
-		fields.b.message = 1;
-		outJsons[MESSAGES] = messageJson;
-
-	}
-	return fields;
-}
-
 
 /***
  * Add a JSON string action
@@ -513,24 +575,37 @@ JsonFieldFlag BadgerAgent::jsonFieldsPresent(char *str, json_t const* outJsons[]
  */
 void BadgerAgent::addJSON(const void  *jsonStr, size_t len){
 
-	if (len >= BADGER_BUFFER_LEN) {
-		LogError(("Message received is longer than the buffer len %d", BADGER_BUFFER_LEN));
+	if (len > MQTT_RX_BUFFER_SIZE) {
+		LogError(("Message received is longer than the buffer len %lu",
+				(unsigned long)MQTT_RX_BUFFER_SIZE));
 		return;
 	}
 
-	if (xBuffer != NULL){
-		size_t res = xMessageBufferSend(
-			xBuffer,
-			jsonStr,
-			len,
-			0);
+	if (xJsonQ != NULL){
+		//Only copy made, agent parses this buffer in place
+		rx_buffer_t *buf = xRxPool.get(jsonStr, len);
+		if (buf == NULL){
+			LogError(("No receive buffer free"));
+			return;
+		}
 
-		if (res != len){
+		if (xQueueSendToBack(xJsonQ, &buf, 0) != pdTRUE){
 			LogError(("Failed to write"));
+			xRxPool.release(buf);
+		} else {
+			markPosted();
 		}
 	}
 }
 
+/***
+ * Receive buffer pool, exposes bytes copied and peak use
+ * @return pool
+ */
+MQTTRxBufferPool * BadgerAgent::getRxPool(){
+	return &xRxPool;
+}
+
 
 void BadgerAgent::refreshDisplay(void) {
 		
@@ -541,9 +616,42 @@ void BadgerAgent::refreshDisplay(void) {
 	 }
 
 	currentView->displayView();
+
+	uint64_t pressed = xPressedUs;
+	if (pressed != 0){
+		xPressedUs = 0;
+		xButtonLatencyLastUs = (uint32_t)(time_us_64() - pressed);
+		if (xButtonLatencyLastUs > xButtonLatencyMaxUs){
+			xButtonLatencyMaxUs = xButtonLatencyLastUs;
+		}
+	}
 }
 
 void BadgerAgent::getWeather(void) {
-	WeatherServiceRequest req;
-	mainView->updateWeatherInfo(req);
+	if (xWeatherPending){
+		LogDebug(("Weather fetch already in flight"));
+		return;
+	}
+	if (pHTTPAgent == NULL){
+		//No worker, fetch on this task
+		if (pWeatherJob->execute()){
+			mainView->updateWeatherInfo(pWeatherJob->getRequest());
+		}
+		return;
+	}
+	xWeatherPending = pHTTPAgent->submit(pWeatherJob, xHttpQ, BADGER_WEATHER_DEADLINE_MS);
+}
+
+/***
+ * Take the result of a weather fetch
+ * @param job - job posted back by the worker
+ */
+void BadgerAgent::weatherReady(HTTPJob *job){
+	xWeatherPending = false;
+	if (job->getStatus() == HTTPJobDone){
+		LogDebug(("Weather fetched in %lu ms", (unsigned long)job->getRunMs()));
+		mainView->updateWeatherInfo(pWeatherJob->getRequest());
+	} else {
+		LogError(("Failed to get weather, status %d", job->getStatus()));
+	}
 }
@@ -19,15 +19,19 @@
 #include "EventReminder.h"
 #include "SwitchObserver.h"
 #include "SwitchMgr.h"
-#include "tiny-json.h"
+#include "JsonSax.h"
+#include "CalendarJsonHandler.h"
 #include "NVSOnboard.h"
 #include "MusicPlayer.h"
 
 #include "pico/stdlib.h"
 #include "queue.h"
-#include "message_buffer.h"
+#include "semphr.h"
 #include "MQTTConfig.h"
 #include "MQTTInterface.h"
+#include "MQTTRxBufferPool.h"
+#include "HTTPAgent.h"
+#include "WeatherJob.h"
 #include "badger2040.hpp"
 #include <cstdint>
 #include <string.h>
@@ -39,9 +43,21 @@ using namespace pimoroni;
 
 #define BADGER_QUEUE_LEN 	5
 #define MQTT_TOPIC_BADGER_STATE "Badger/state"
-#define BADGER_BUFFER_LEN	2048	
-#define BADGER_JSON_LEN 	2048
-#define BADGER_JSON_POOL 	50
+#define BADGER_JSON_QUEUE_LEN	MQTT_RX_BUFFERS
+#define BADGER_HTTP_QUEUE_LEN	1
+#define BADGER_SET_LEN 		(BADGER_QUEUE_LEN + BADGER_JSON_QUEUE_LEN + BADGER_HTTP_QUEUE_LEN)
+
+#ifndef BADGER_WEATHER_LAT
+#define BADGER_WEATHER_LAT "37.76213"
+#endif
+#ifndef BADGER_WEATHER_LON
+#define BADGER_WEATHER_LON "-122.3943"
+#endif
+
+//A weather result later than this is dropped
+#ifndef BADGER_WEATHER_DEADLINE_MS
+#define BADGER_WEATHER_DEADLINE_MS 30000
+#endif
 
 
 enum BadgerAction { ScrollDown, ScrollUp, RefreshScreen, GetWeather};
@@ -54,22 +70,6 @@ enum BadgerButtons{
 	NUM_BUTTONS
 };
 
-enum JsonFieldsEnum {
-	REMINDERS,
-	EVENTS,
-	MESSAGES,
-	NUM_FIELDS
-};
-
-union JsonFieldFlag{
-	struct{
-		unsigned char reminders : 1;
-		unsigned char events: 1;
-		unsigned char message: 1;
-	} b;
-	uint8_t u8;
-};
-
 
 class BadgerAgent : public Agent, public SwitchObserver {
 public:
@@ -94,11 +94,25 @@ public:
 
 
 	/***
-	 * Add a JSON string action
+	 * Add a JSON string action. Payload is copied once into a pooled
+	 * receive buffer which the agent task parses in place
 	 * @param jsonStr
 	 */
 	void addJSON(const void  *jsonStr, size_t len);
 
+	/***
+	 * Receive buffer pool, exposes bytes copied and peak use
+	 * @return pool
+	 */
+	MQTTRxBufferPool * getRxPool();
+
+	/***
+	 * Set worker that runs HTTP requests off this task.
+	 * Without one requests block the agent task
+	 * @param agent
+	 */
+	void setHTTPAgent(HTTPAgent *agent);
+
 	/***
 	 * Handle a short press from the switch
 	 * @param gp - GPIO number of the switch
@@ -111,6 +125,38 @@ public:
 	 */
 	virtual void handleLongPress(uint8_t gp);
 
+	/***
+	 * Worst case time from a message or action being posted to the
+	 * agent task waking to handle it
+	 * @return micro seconds
+	 */
+	uint32_t getWakeLatencyMaxUs();
+
+	/***
+	 * Time from the last post to the agent task waking
+	 * @return micro seconds
+	 */
+	uint32_t getWakeLatencyLastUs();
+
+	/***
+	 * Percentage of time the agent task has been blocked waiting for work
+	 * since it started
+	 * @return 0 - 100
+	 */
+	uint8_t getIdlePercent();
+
+	/***
+	 * Worst case time from a button press to the screen being redrawn
+	 * @return micro seconds
+	 */
+	uint32_t getButtonLatencyMaxUs();
+
+	/***
+	 * Time from the last button press to the screen being redrawn
+	 * @return micro seconds
+	 */
+	uint32_t getButtonLatencyLastUs();
+
 protected:
 	/***
 	 * Task main run loop
@@ -143,9 +189,10 @@ private:
 
 	/***
 	 * Parse a JSON string and add request to queue
-	 * @param str - JSON Strging
+	 * @param str - JSON Strging, read in place and not modified
+	 * @param len - length of string
 	 */
-	void parseJSON(char *str);
+	void parseJSON(const char *str, size_t len);
 
 
 	/***
@@ -154,10 +201,13 @@ private:
 	 */
 	void loadJSONFromNVS(void);
 	/***
-	 * Parse a JSON string and return bitfield with fields present
-	 * @param str - JSON Strging
+	 * Stream a JSON string into the views. Views only change if the
+	 * whole document is valid
+	 * @param str - JSON String, need not be zero terminated
+	 * @param len - length of string
+	 * @return true if the whole document was valid
 	 */
-	JsonFieldFlag jsonFieldsPresent(char* str, json_t const* outJsons[]);
+	bool streamJSON(const char *str, size_t len);
 
 	//Interface to publish state to MQTT
 	MQTTInterface *pInterface = NULL;
@@ -168,11 +218,9 @@ private:
 	//State of the LED
 	bool xState = false;
 	
-	//Json methods
-	std::optional<eventReminder_t>  processJsonToReminder(json_t const* reminderJson);
-	void parseJSONEventsReminders(json_t const* reminderList, json_t const* eventList);
-	// Json decoding buffer
-	json_t pJsonPool[ BADGER_JSON_POOL ];
+	//Streaming JSON reader, fills the views as the text is read
+	CalendarJsonHandler *pCalHandler = NULL;
+	JsonSax *pJsonReader = NULL;
 	
 	//Badger class
 	Badger2040 badger;
@@ -206,8 +254,43 @@ private:
 	int blinkCount = 0;
 	int numBlinks = 0;
 
-	// Message buffer handle
-	MessageBufferHandle_t xBuffer = NULL;
+	// Received JSON buffers waiting to be parsed, passed by pointer
+	QueueHandle_t xJsonQ = NULL;
+
+	// Static as agent object may live on a task stack
+	static MQTTRxBufferPool xRxPool;
+
+	// Single wait point for all sources of work for the agent
+	QueueSetHandle_t xWaitSet = NULL;
+
+	/***
+	 * Record time of post, used to measure wake latency
+	 */
+	void markPosted();
+
+	//Wake and idle counters
+	volatile uint64_t xPostedUs = 0;
+	uint32_t xWakeLatencyLastUs = 0;
+	uint32_t xWakeLatencyMaxUs = 0;
+	uint64_t xRunStartUs = 0;
+	uint64_t xIdleUs = 0;
+
+	//Button to screen counters
+	volatile uint64_t xPressedUs = 0;
+	uint32_t xButtonLatencyLastUs = 0;
+	uint32_t xButtonLatencyMaxUs = 0;
+
+	//Weather is fetched by the HTTP worker and posted back to xHttpQ
+	HTTPAgent *pHTTPAgent = NULL;
+	WeatherJob *pWeatherJob = NULL;
+	QueueHandle_t xHttpQ = NULL;
+	bool xWeatherPending = false;
+
+	/***
+	 * Take the result of a weather fetch
+	 * @param job - job posted back by the worker
+	 */
+	void weatherReady(HTTPJob *job);
 
 	//Views
 	std::shared_ptr<View> currentView;
@@ -0,0 +1,255 @@
+/*
+ * CalendarJsonHandler.cpp
+ *
+ * Streaming handler for badge calendar documents. Reminders and events
+ * are built one at a time as the JSON is read, so the number of entries
+ * is not limited by a parse tree. They are staged and only replace what
+ * the views hold once the whole document has parsed.
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#include "CalendarJsonHandler.h"
+#include "MQTTConfig.h"
+#include <string.h>
+#include <utility>
+
+//Nesting: 1 document object, 2 list array, 3 entry object
+#define DEPTH_TOP	1
+#define DEPTH_LIST	2
+#define DEPTH_ITEM	3
+
+#define FIELD_TITLE	0x01
+#define FIELD_DATE	0x02
+#define FIELD_TIME	0x04
+#define FIELD_ALL	(FIELD_TITLE | FIELD_DATE | FIELD_TIME)
+
+/***
+ * Constructor
+ * @param reminders - view to fill with reminders
+ * @param events - view to fill with events
+ */
+CalendarJsonHandler::CalendarJsonHandler(std::shared_ptr<ReminderView> reminders,
+		std::shared_ptr<EventView> events) {
+	pReminderView = reminders;
+	pEventView = events;
+}
+
+/***
+ * Destructor
+ */
+CalendarJsonHandler::~CalendarJsonHandler() {
+	// NOP
+}
+
+/***
+ * Prepare for a new document
+ */
+void CalendarJsonHandler::reset(){
+	xDepth = 0;
+	xTopKey = KeyOther;
+	xList = KeyOther;
+	xItemKey = ItemOther;
+	xReminders = false;
+	xEvents = false;
+	xMessage = false;
+	xItems = 0;
+	discard();
+	xItemFields = 0;
+	xMessageText.clear();
+	xPart.clear();
+}
+
+/***
+ * Was a reminders array found
+ * @return
+ */
+bool CalendarJsonHandler::hasReminders(){
+	return xReminders;
+}
+
+/***
+ * Was a calendar array found
+ * @return
+ */
+bool CalendarJsonHandler::hasEvents(){
+	return xEvents;
+}
+
+/***
+ * Was a message string found
+ * @return
+ */
+bool CalendarJsonHandler::hasMessage(){
+	return xMessage;
+}
+
+/***
+ * Message text, valid if hasMessage
+ * @return
+ */
+const std::string & CalendarJsonHandler::getMessage(){
+	return xMessageText;
+}
+
+/***
+ * Number of reminders and events staged
+ * @return
+ */
+uint32_t CalendarJsonHandler::getItems(){
+	return xItems;
+}
+
+/***
+ * Document parsed, replace what the views hold with the staged
+ * lists. Views are left alone if the document had neither list
+ */
+void CalendarJsonHandler::apply(){
+	if (xReminders || xEvents){
+		pReminderView->clear();
+		pEventView->clear();
+		for (eventReminder_t &item : xStagedReminders){
+			pReminderView->addReminder(std::move(item));
+		}
+		for (eventReminder_t &item : xStagedEvents){
+			pEventView->addEvent(std::move(item));
+		}
+	}
+	discard();
+}
+
+/***
+ * Drop staged items and free their memory
+ */
+void CalendarJsonHandler::discard(){
+	std::vector<eventReminder_t>().swap(xStagedReminders);
+	std::vector<eventReminder_t>().swap(xStagedEvents);
+}
+
+/***
+ * A non object entry at list level
+ */
+void CalendarJsonHandler::badEntry(){
+	if ((xDepth == DEPTH_LIST) && (xList != KeyOther)){
+		LogError(("Couldn't parse reminder!"));
+	}
+}
+
+void CalendarJsonHandler::jsonStartObject(){
+	if ((xDepth == DEPTH_LIST) && (xList != KeyOther)){
+		xItem.title.clear();
+		xItem.date.clear();
+		xItem.time.clear();
+		xItemFields = 0;
+		xItemKey = ItemOther;
+	}
+	xDepth++;
+}
+
+void CalendarJsonHandler::jsonEndObject(){
+	xDepth--;
+	if ((xDepth == DEPTH_LIST) && (xList != KeyOther)){
+		if (xItemFields == FIELD_ALL){
+			LogDebug(("Reminder: %s , due date: %s %s",
+					xItem.title.c_str(), xItem.time.c_str(), xItem.date.c_str()));
+			if (xList == KeyReminders){
+				xStagedReminders.push_back(xItem);
+			} else {
+				xStagedEvents.push_back(xItem);
+			}
+			xItems++;
+		}
+	}
+}
+
+void CalendarJsonHandler::jsonStartArray(){
+	badEntry();
+	if ((xDepth == DEPTH_TOP) && ((xTopKey == KeyReminders) || (xTopKey == KeyEvents))){
+		xList = xTopKey;
+		if (xList == KeyReminders){
+			xReminders = true;
+		} else {
+			xEvents = true;
+		}
+	}
+	xDepth++;
+}
+
+void CalendarJsonHandler::jsonEndArray(){
+	xDepth--;
+	if (xDepth == DEPTH_TOP){
+		xList = KeyOther;
+	}
+}
+
+void CalendarJsonHandler::jsonKey(const char *key, size_t len){
+	if (xDepth == DEPTH_TOP){
+		if (strcmp(key, "reminders") == 0){
+			xTopKey = KeyReminders;
+		} else if (strcmp(key, "calendar") == 0){
+			xTopKey = KeyEvents;
+		} else if (strcmp(key, "message") == 0){
+			xTopKey = KeyMessage;
+		} else {
+			xTopKey = KeyOther;
+		}
+	} else if ((xDepth == DEPTH_ITEM) && (xList != KeyOther)){
+		if (strcmp(key, "title") == 0){
+			xItemKey = ItemTitle;
+		} else if (strcmp(key, "date") == 0){
+			xItemKey = ItemDate;
+		} else if (strcmp(key, "time") == 0){
+			xItemKey = ItemTime;
+		} else {
+			xItemKey = ItemOther;
+		}
+	}
+}
+
+void CalendarJsonHandler::jsonStringPart(const char *value, size_t len){
+	//Only hold on to parts of values that are kept
+	if (((xDepth == DEPTH_TOP) && (xTopKey == KeyMessage)) ||
+			((xDepth == DEPTH_ITEM) && (xList != KeyOther) && (xItemKey != ItemOther))){
+		xPart.append(value, len);
+	}
+}
+
+void CalendarJsonHandler::jsonString(const char *value, size_t len){
+	//Long values arrive in parts, join them
+	if (!xPart.empty()){
+		xPart.append(value, len);
+		value = xPart.c_str();
+		len = xPart.length();
+	}
+	badEntry();
+	if ((xDepth == DEPTH_TOP) && (xTopKey == KeyMessage)){
+		xMessageText.assign(value, len);
+		xMessage = true;
+	} else if ((xDepth == DEPTH_ITEM) && (xList != KeyOther)){
+		switch(xItemKey){
+		case ItemTitle:{
+			xItem.title.assign(value, len);
+			xItemFields |= FIELD_TITLE;
+			break;
+		}
+		case ItemDate:{
+			xItem.date.assign(value, len);
+			xItemFields |= FIELD_DATE;
+			break;
+		}
+		case ItemTime:{
+			xItem.time.assign(value, len);
+			xItemFields |= FIELD_TIME;
+			break;
+		}
+		default:{
+			break;
+		}
+		}
+	}
+	xPart.clear();
+}
+
+void CalendarJsonHandler::jsonPrimitive(const char *text, size_t len){
+	badEntry();
+}
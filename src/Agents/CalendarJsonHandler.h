@@ -0,0 +1,128 @@
+/*
+ * CalendarJsonHandler.h
+ *
+ * Streaming handler for badge calendar documents. Reminders and events
+ * are built one at a time as the JSON is read, so the number of entries
+ * is not limited by a parse tree. They are staged and only replace what
+ * the views hold once the whole document has parsed. Long titles and
+ * messages arrive in parts and are joined, so they are never truncated.
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#ifndef CALENDARJSONHANDLER_H_
+#define CALENDARJSONHANDLER_H_
+
+#include "JsonSaxHandler.h"
+#include "EventReminder.h"
+#include "ReminderView.h"
+#include "EventView.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+class CalendarJsonHandler : public JsonSaxHandler {
+public:
+	/***
+	 * Constructor
+	 * @param reminders - view to fill with reminders
+	 * @param events - view to fill with events
+	 */
+	CalendarJsonHandler(std::shared_ptr<ReminderView> reminders,
+			std::shared_ptr<EventView> events);
+
+	/***
+	 * Destructor
+	 */
+	virtual ~CalendarJsonHandler();
+
+	/***
+	 * Prepare for a new document
+	 */
+	void reset();
+
+	/***
+	 * Was a reminders array found
+	 * @return
+	 */
+	bool hasReminders();
+
+	/***
+	 * Was a calendar array found
+	 * @return
+	 */
+	bool hasEvents();
+
+	/***
+	 * Was a message string found
+	 * @return
+	 */
+	bool hasMessage();
+
+	/***
+	 * Message text, valid if hasMessage
+	 * @return
+	 */
+	const std::string & getMessage();
+
+	/***
+	 * Number of reminders and events staged
+	 * @return
+	 */
+	uint32_t getItems();
+
+	/***
+	 * Document parsed, replace what the views hold with the staged
+	 * lists. Views are left alone if the document had neither list
+	 */
+	void apply();
+
+	virtual void jsonStartObject();
+	virtual void jsonEndObject();
+	virtual void jsonStartArray();
+	virtual void jsonEndArray();
+	virtual void jsonKey(const char *key, size_t len);
+	virtual void jsonString(const char *value, size_t len);
+	virtual void jsonStringPart(const char *value, size_t len);
+	virtual void jsonPrimitive(const char *text, size_t len);
+
+private:
+	enum TopKey { KeyOther, KeyReminders, KeyEvents, KeyMessage };
+	enum ItemKey { ItemOther, ItemTitle, ItemDate, ItemTime };
+
+	/***
+	 * Drop staged items and free their memory
+	 */
+	void discard();
+
+	/***
+	 * A non object entry at list level
+	 */
+	void badEntry();
+
+	std::shared_ptr<ReminderView> pReminderView;
+	std::shared_ptr<EventView> pEventView;
+
+	uint8_t xDepth = 0;
+	TopKey xTopKey = KeyOther;
+	TopKey xList = KeyOther;
+	ItemKey xItemKey = ItemOther;
+
+	bool xReminders = false;
+	bool xEvents = false;
+	bool xMessage = false;
+	uint32_t xItems = 0;
+
+	std::vector<eventReminder_t> xStagedReminders;
+	std::vector<eventReminder_t> xStagedEvents;
+
+	eventReminder_t xItem;
+	uint8_t xItemFields = 0;
+
+	std::string xMessageText;
+
+	//Leading parts of a long string value
+	std::string xPart;
+};
+
+#endif /* CALENDARJSONHANDLER_H_ */
@@ -0,0 +1,161 @@
+/*
+ * HTTPAgent.cpp
+ *
+ * Worker task that runs blocking HTTP requests off the UI task. Jobs are
+ * queued by pointer, run one at a time, and posted back to the mailbox
+ * of the requester when done. Jobs past their deadline or cancelled
+ * before they start are not run. Between jobs the task closes pooled
+ * connections that have been idle too long.
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#include "HTTPAgent.h"
+#include "Transport.h"
+#include "HTTPConnPool.h"
+
+/***
+ * Constructor
+ */
+HTTPAgent::HTTPAgent() {
+	xJobQ = xQueueCreate(HTTP_AGENT_QUEUE_LEN, sizeof(HTTPJob *));
+	if (xJobQ == NULL){
+		LogError(("Unable to create HTTP job queue"));
+	}
+}
+
+/***
+ * Destructor
+ */
+HTTPAgent::~HTTPAgent() {
+	stop();
+	if (xJobQ != NULL){
+		vQueueDelete(xJobQ);
+	}
+}
+
+/***
+ * Queue a job. Does not block
+ * @param job - owned by caller, must live until posted back
+ * @param replyQ - mailbox of HTTPJob pointers
+ * @param deadlineMs - time allowed from now, 0 for none
+ * @return false if queue full
+ */
+bool HTTPAgent::submit(HTTPJob * job, QueueHandle_t replyQ, uint32_t deadlineMs){
+	if (xJobQ == NULL){
+		return false;
+	}
+	job->prepare(replyQ, deadlineMs);
+	if (xQueueSendToBack(xJobQ, &job, 0) != pdTRUE){
+		job->setStatus(HTTPJobIdle);
+		LogWarn(("HTTP job queue full"));
+		return false;
+	}
+	return true;
+}
+
+/***
+ * Run one job and post it back
+ * @param job
+ */
+void HTTPAgent::process(HTTPJob * job){
+	if (job->isCancelled()){
+		job->setStatus(HTTPJobCancelled);
+		xCancelled++;
+	} else if (job->isExpired()){
+		job->setStatus(HTTPJobExpired);
+		xExpired++;
+	} else {
+		job->setStatus(HTTPJobRunning);
+		uint32_t start = Transport::getTime();
+		bool ok = job->execute();
+		uint32_t ms = Transport::getTime() - start;
+		job->setRunMs(ms);
+		if (ms > xMaxRunMs){
+			xMaxRunMs = ms;
+		}
+		xCompleted++;
+
+		if (job->isCancelled()){
+			job->setStatus(HTTPJobCancelled);
+			xCancelled++;
+		} else if (job->isExpired()){
+			//Too late to be of use
+			job->setStatus(HTTPJobExpired);
+			xExpired++;
+		} else {
+			job->setStatus(ok ? HTTPJobDone : HTTPJobFailed);
+		}
+	}
+
+	QueueHandle_t replyQ = job->getReplyQ();
+	if (replyQ != NULL){
+		if (xQueueSendToBack(replyQ, &job, 0) != pdTRUE){
+			LogError(("HTTP job reply lost, mailbox full"));
+		}
+	}
+}
+
+/***
+ * Task main run loop
+ */
+void HTTPAgent::run(){
+	HTTPJob *job;
+
+	if (xJobQ == NULL){
+		return;
+	}
+
+	for (;;){
+		//Wake when the next idle connection is due to close
+		TickType_t wait = portMAX_DELAY;
+		uint32_t idleMs = HTTPConnPool::getInstance()->expireIdle();
+		if (idleMs != HTTP_POOL_NO_IDLE){
+			wait = pdMS_TO_TICKS(idleMs) + 1;
+		}
+		if (xQueueReceive(xJobQ, &job, wait) == pdTRUE){
+			process(job);
+		}
+	}
+}
+
+/***
+ * Get the static depth required in words
+ * @return - words
+ */
+configSTACK_DEPTH_TYPE HTTPAgent::getMaxStackSize(){
+	//TLS handshake and JSON parse run on this task
+	return 1024*3;
+}
+
+/***
+ * Number of jobs run
+ * @return
+ */
+uint32_t HTTPAgent::getCompleted(){
+	return xCompleted;
+}
+
+/***
+ * Number of jobs dropped as their deadline passed
+ * @return
+ */
+uint32_t HTTPAgent::getExpired(){
+	return xExpired;
+}
+
+/***
+ * Number of jobs cancelled
+ * @return
+ */
+uint32_t HTTPAgent::getCancelled(){
+	return xCancelled;
+}
+
+/***
+ * Longest time a job ran
+ * @return milliseconds
+ */
+uint32_t HTTPAgent::getMaxRunMs(){
+	return xMaxRunMs;
+}
@@ -0,0 +1,96 @@
+/*
+ * HTTPAgent.h
+ *
+ * Worker task that runs blocking HTTP requests off the UI task. Jobs are
+ * queued by pointer, run one at a time, and posted back to the mailbox
+ * of the requester when done. Jobs past their deadline or cancelled
+ * before they start are not run. Between jobs the task closes pooled
+ * connections that have been idle too long.
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#ifndef HTTPAGENT_H_
+#define HTTPAGENT_H_
+
+#include "Agent.h"
+#include "HTTPJob.h"
+#include "queue.h"
+
+#ifndef HTTP_AGENT_QUEUE_LEN
+#define HTTP_AGENT_QUEUE_LEN 4
+#endif
+
+class HTTPAgent : public Agent {
+public:
+	/***
+	 * Constructor
+	 */
+	HTTPAgent();
+
+	/***
+	 * Destructor
+	 */
+	virtual ~HTTPAgent();
+
+	/***
+	 * Queue a job. Does not block
+	 * @param job - owned by caller, must live until posted back
+	 * @param replyQ - mailbox of HTTPJob pointers
+	 * @param deadlineMs - time allowed from now, 0 for none
+	 * @return false if queue full
+	 */
+	bool submit(HTTPJob * job, QueueHandle_t replyQ, uint32_t deadlineMs);
+
+	/***
+	 * Number of jobs run
+	 * @return
+	 */
+	uint32_t getCompleted();
+
+	/***
+	 * Number of jobs dropped as their deadline passed
+	 * @return
+	 */
+	uint32_t getExpired();
+
+	/***
+	 * Number of jobs cancelled
+	 * @return
+	 */
+	uint32_t getCancelled();
+
+	/***
+	 * Longest time a job ran
+	 * @return milliseconds
+	 */
+	uint32_t getMaxRunMs();
+
+protected:
+	/***
+	 * Task main run loop
+	 */
+	virtual void run();
+
+	/***
+	 * Get the static depth required in words
+	 * @return - words
+	 */
+	virtual configSTACK_DEPTH_TYPE getMaxStackSize();
+
+private:
+	/***
+	 * Run one job and post it back
+	 * @param job
+	 */
+	void process(HTTPJob * job);
+
+	QueueHandle_t xJobQ = NULL;
+
+	uint32_t xCompleted = 0;
+	uint32_t xExpired = 0;
+	uint32_t xCancelled = 0;
+	uint32_t xMaxRunMs = 0;
+};
+
+#endif /* HTTPAGENT_H_ */
@@ -0,0 +1,237 @@
+/*
+ * HTTPConnPool.cpp
+ *
+ * Pool of persistent HTTP and HTTPS connections keyed by scheme, host and
+ * port. A Request borrows a connection, and hands it back open if the
+ * server agreed to keep it alive, so the next request to the same server
+ * skips the TCP connect and TLS handshake. Idle connections are closed
+ * after a timeout by the task that runs requests.
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#include "HTTPConnPool.h"
+#include <string.h>
+
+HTTPConnPool * HTTPConnPool::pSingleton = NULL;
+
+/***
+ * Get the single pool
+ * @return pool
+ */
+HTTPConnPool * HTTPConnPool::getInstance(){
+	if (HTTPConnPool::pSingleton == NULL) {
+		HTTPConnPool::pSingleton = new HTTPConnPool();
+	}
+	return HTTPConnPool::pSingleton;
+}
+
+/***
+ * Constructor
+ */
+HTTPConnPool::HTTPConnPool() {
+	for (int i = 0; i < HTTP_POOL_SLOTS; i++){
+		http_conn_t *c = &xConns[i];
+		c->host[0] = 0;
+		c->port = 0;
+		c->tls = false;
+		c->inUse = false;
+		c->open = false;
+		c->idleSince = 0;
+		c->idleMs = HTTP_POOL_IDLE_MS;
+		c->pTrans = &c->xTCP;
+	}
+	xLock = xSemaphoreCreateMutex();
+}
+
+/***
+ * Destructor
+ */
+HTTPConnPool::~HTTPConnPool() {
+	for (int i = 0; i < HTTP_POOL_SLOTS; i++){
+		close(&xConns[i]);
+	}
+	vSemaphoreDelete(xLock);
+}
+
+/***
+ * Close connection in a slot. Lock must be held
+ * @param conn
+ */
+void HTTPConnPool::close(http_conn_t * conn){
+	if (conn->open){
+		conn->pTrans->transClose();
+		conn->open = false;
+	}
+}
+
+/***
+ * Close idle connections past their timeout. Lock must be held
+ * @return milliseconds until the next idle connection times out,
+ * or HTTP_POOL_NO_IDLE if none are idle
+ */
+uint32_t HTTPConnPool::expire(){
+	uint32_t now = Transport::getTime();
+	uint32_t next = HTTP_POOL_NO_IDLE;
+	for (int i = 0; i < HTTP_POOL_SLOTS; i++){
+		http_conn_t *c = &xConns[i];
+		if (!c->open || c->inUse){
+			continue;
+		}
+		uint32_t idle = now - c->idleSince;
+		if (idle >= c->idleMs){
+			LogDebug(("Closing idle connection to %s:%u", c->host, c->port));
+			close(c);
+			xExpired++;
+		} else if ((c->idleMs - idle) < next){
+			next = c->idleMs - idle;
+		}
+	}
+	return next;
+}
+
+/***
+ * Borrow a connection for scheme, host and port. An idle open
+ * connection is reused, otherwise a free slot is returned closed
+ * and the caller connects it through pTrans
+ * @param tls - true for HTTPS
+ * @param host - server name
+ * @param port - port number
+ * @param reused - set true if the connection is already open
+ * @return connection or NULL if every slot is busy
+ */
+http_conn_t * HTTPConnPool::acquire(bool tls, const char * host, uint16_t port, bool *reused){
+	http_conn_t *conn = NULL;
+
+	*reused = false;
+	if (strlen(host) >= HTTP_POOL_HOST_LEN){
+		xMisses++;
+		return NULL;
+	}
+
+	xSemaphoreTake(xLock, portMAX_DELAY);
+	expire();
+
+	for (int i = 0; i < HTTP_POOL_SLOTS; i++){
+		http_conn_t *c = &xConns[i];
+		if (!c->inUse && c->open && (c->tls == tls) && (c->port == port) &&
+				(strcmp(c->host, host) == 0)){
+			conn = c;
+			*reused = true;
+			break;
+		}
+	}
+
+	if (conn == NULL){
+		//Prefer a closed slot, otherwise close the longest idle one
+		for (int i = 0; i < HTTP_POOL_SLOTS; i++){
+			http_conn_t *c = &xConns[i];
+			if (c->inUse){
+				continue;
+			}
+			if (!c->open){
+				conn = c;
+				break;
+			}
+			if ((conn == NULL) || (c->idleSince < conn->idleSince)){
+				conn = c;
+			}
+		}
+		if (conn != NULL){
+			close(conn);
+			strcpy(conn->host, host);
+			conn->port = port;
+			conn->tls = tls;
+			if (tls){
+				conn->pTrans = &conn->xTLS;
+			} else {
+				conn->pTrans = &conn->xTCP;
+			}
+		}
+	}
+
+	if (*reused){
+		xHits++;
+	} else {
+		xMisses++;
+	}
+	if (conn != NULL){
+		conn->inUse = true;
+	}
+	xSemaphoreGive(xLock);
+	return conn;
+}
+
+/***
+ * Hand a connection back
+ * @param conn - connection from acquire
+ * @param keep - true to keep it open for reuse, false closes it
+ * @param idleMs - how long it may stay idle, 0 for default
+ */
+void HTTPConnPool::release(http_conn_t * conn, bool keep, uint32_t idleMs){
+	xSemaphoreTake(xLock, portMAX_DELAY);
+	if (keep){
+		conn->open = true;
+		conn->idleSince = Transport::getTime();
+		if ((idleMs == 0) || (idleMs > HTTP_POOL_IDLE_MS)){
+			idleMs = HTTP_POOL_IDLE_MS;
+		}
+		conn->idleMs = idleMs;
+	} else {
+		//Transport may be part open after a failed connect
+		conn->pTrans->transClose();
+		conn->open = false;
+	}
+	conn->inUse = false;
+	xSemaphoreGive(xLock);
+}
+
+/***
+ * Close every idle connection, for example when the network drops
+ */
+void HTTPConnPool::closeIdle(){
+	xSemaphoreTake(xLock, portMAX_DELAY);
+	for (int i = 0; i < HTTP_POOL_SLOTS; i++){
+		if (!xConns[i].inUse){
+			close(&xConns[i]);
+		}
+	}
+	xSemaphoreGive(xLock);
+}
+
+/***
+ * Close idle connections past their timeout. Called by the task
+ * that runs requests, so idle sockets close without a new request
+ * @return milliseconds until the next idle connection times out,
+ * or HTTP_POOL_NO_IDLE if none are idle
+ */
+uint32_t HTTPConnPool::expireIdle(){
+	xSemaphoreTake(xLock, portMAX_DELAY);
+	uint32_t next = expire();
+	xSemaphoreGive(xLock);
+	return next;
+}
+
+/***
+ * Number of requests that reused an open connection
+ * @return
+ */
+uint32_t HTTPConnPool::getHits(){
+	return xHits;
+}
+
+/***
+ * Number of requests that needed a new connection
+ * @return
+ */
+uint32_t HTTPConnPool::getMisses(){
+	return xMisses;
+}
+
+/***
+ * Number of idle connections closed on timeout
+ * @return
+ */
+uint32_t HTTPConnPool::getExpired(){
+	return xExpired;
+}
@@ -0,0 +1,146 @@
+/*
+ * HTTPConnPool.h
+ *
+ * Pool of persistent HTTP and HTTPS connections keyed by scheme, host and
+ * port. A Request borrows a connection, and hands it back open if the
+ * server agreed to keep it alive, so the next request to the same server
+ * skips the TCP connect and TLS handshake. Idle connections are closed
+ * after a timeout by the task that runs requests.
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#ifndef HTTPCONNPOOL_H_
+#define HTTPCONNPOOL_H_
+
+#include "TCPTransport.h"
+#include "TLSTransBlock.h"
+
+extern "C" {
+#include <FreeRTOS.h>
+#include <semphr.h>
+}
+
+#ifndef HTTP_POOL_SLOTS
+#define HTTP_POOL_SLOTS 2
+#endif
+
+//Longest an idle connection is kept, unless the server says less
+#ifndef HTTP_POOL_IDLE_MS
+#define HTTP_POOL_IDLE_MS 10000
+#endif
+
+//Returned by expireIdle when no connection is idle
+#define HTTP_POOL_NO_IDLE 0xFFFFFFFF
+
+#ifndef HTTP_POOL_HOST_LEN
+#define HTTP_POOL_HOST_LEN 80
+#endif
+
+typedef struct {
+	char 			host[HTTP_POOL_HOST_LEN];
+	uint16_t 		port;
+	bool 			tls;
+	bool 			inUse;
+	bool 			open;
+	uint32_t 		idleSince;
+	uint32_t 		idleMs;
+	Transport * 	pTrans;
+	TCPTransport 	xTCP;
+	TLSTransBlock 	xTLS;
+} http_conn_t;
+
+class HTTPConnPool {
+public:
+	/***
+	 * Get the single pool
+	 * @return pool
+	 */
+	static HTTPConnPool * getInstance();
+
+	/***
+	 * Borrow a connection for scheme, host and port. An idle open
+	 * connection is reused, otherwise a free slot is returned closed
+	 * and the caller connects it through pTrans
+	 * @param tls - true for HTTPS
+	 * @param host - server name
+	 * @param port - port number
+	 * @param reused - set true if the connection is already open
+	 * @return connection or NULL if every slot is busy
+	 */
+	http_conn_t * acquire(bool tls, const char * host, uint16_t port, bool *reused);
+
+	/***
+	 * Hand a connection back
+	 * @param conn - connection from acquire
+	 * @param keep - true to keep it open for reuse, false closes it
+	 * @param idleMs - how long it may stay idle, 0 for default
+	 */
+	void release(http_conn_t * conn, bool keep, uint32_t idleMs = 0);
+
+	/***
+	 * Close every idle connection, for example when the network drops
+	 */
+	void closeIdle();
+
+	/***
+	 * Close idle connections past their timeout. Called by the task
+	 * that runs requests, so idle sockets close without a new request
+	 * @return milliseconds until the next idle connection times out,
+	 * or HTTP_POOL_NO_IDLE if none are idle
+	 */
+	uint32_t expireIdle();
+
+	/***
+	 * Number of requests that reused an open connection
+	 * @return
+	 */
+	uint32_t getHits();
+
+	/***
+	 * Number of requests that needed a new connection
+	 * @return
+	 */
+	uint32_t getMisses();
+
+	/***
+	 * Number of idle connections closed on timeout
+	 * @return
+	 */
+	uint32_t getExpired();
+
+private:
+	/***
+	 * Constructor
+	 */
+	HTTPConnPool();
+
+	/***
+	 * Destructor
+	 */
+	virtual ~HTTPConnPool();
+
+	/***
+	 * Close connection in a slot. Lock must be held
+	 * @param conn
+	 */
+	void close(http_conn_t * conn);
+
+	/***
+	 * Close idle connections past their timeout. Lock must be held
+	 * @return milliseconds until the next idle connection times out,
+	 * or HTTP_POOL_NO_IDLE if none are idle
+	 */
+	uint32_t expire();
+
+	static HTTPConnPool * pSingleton;
+
+	http_conn_t xConns[HTTP_POOL_SLOTS];
+	SemaphoreHandle_t xLock = NULL;
+
+	uint32_t xHits = 0;
+	uint32_t xMisses = 0;
+	uint32_t xExpired = 0;
+};
+
+#endif /* HTTPCONNPOOL_H_ */
@@ -0,0 +1,132 @@
+/*
+ * HTTPJob.cpp
+ *
+ * Unit of work for the HTTP worker agent. Subclass implements execute to
+ * run the blocking request. The requester keeps ownership, submits it with
+ * a mailbox and a deadline, and gets the job pointer back on the mailbox
+ * once it is finished, expired or cancelled.
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#include "HTTPJob.h"
+#include "Transport.h"
+
+/***
+ * Constructor
+ */
+HTTPJob::HTTPJob() {
+	// NOP
+}
+
+/***
+ * Destructor
+ */
+HTTPJob::~HTTPJob() {
+	// NOP
+}
+
+/***
+ * Prepare for submission
+ * @param replyQ - mailbox the job pointer is posted to when finished
+ * @param deadlineMs - time allowed from now, 0 for none
+ */
+void HTTPJob::prepare(QueueHandle_t replyQ, uint32_t deadlineMs){
+	xReplyQ = replyQ;
+	xHasDeadline = (deadlineMs != 0);
+	xDeadline = Transport::getTime() + deadlineMs;
+	xRunMs = 0;
+	xCancelled.store(false);
+	xStatus.store(HTTPJobQueued);
+}
+
+/***
+ * Ask for the job to be dropped. If it is already running the
+ * result is discarded. Job is still posted back to the mailbox
+ */
+void HTTPJob::cancel(){
+	xCancelled.store(true);
+}
+
+/***
+ * Has cancel been called
+ * @return
+ */
+bool HTTPJob::isCancelled(){
+	return xCancelled.load();
+}
+
+/***
+ * Submitted and not yet posted back
+ * @return true if worker still holds the job
+ */
+bool HTTPJob::isInFlight(){
+	HTTPJobStatus s = xStatus.load();
+	return (s == HTTPJobQueued) || (s == HTTPJobRunning);
+}
+
+/***
+ * Has the deadline passed
+ * @return
+ */
+bool HTTPJob::isExpired(){
+	if (!xHasDeadline){
+		return false;
+	}
+	return ((int32_t)(Transport::getTime() - xDeadline)) >= 0;
+}
+
+/***
+ * Time left before the deadline
+ * @return milliseconds, UINT32_MAX if no deadline
+ */
+uint32_t HTTPJob::getRemainingMs(){
+	if (!xHasDeadline){
+		return UINT32_MAX;
+	}
+	int32_t left = (int32_t)(xDeadline - Transport::getTime());
+	if (left < 0){
+		return 0;
+	}
+	return (uint32_t)left;
+}
+
+/***
+ * Current status
+ * @return
+ */
+HTTPJobStatus HTTPJob::getStatus(){
+	return xStatus.load();
+}
+
+/***
+ * Set status, used by the worker
+ * @param status
+ */
+void HTTPJob::setStatus(HTTPJobStatus status){
+	xStatus.store(status);
+}
+
+/***
+ * Mailbox to post the job back to
+ * @return queue
+ */
+QueueHandle_t HTTPJob::getReplyQ(){
+	return xReplyQ;
+}
+
+/***
+ * Time spent on the worker running the request
+ * @return milliseconds
+ */
+uint32_t HTTPJob::getRunMs(){
+	return xRunMs;
+}
+
+/***
+ * Set run time, used by the worker
+ * @param ms
+ */
+void HTTPJob::setRunMs(uint32_t ms){
+	xRunMs = ms;
+}
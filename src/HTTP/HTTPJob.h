@@ -0,0 +1,129 @@
+/*
+ * HTTPJob.h
+ *
+ * Unit of work for the HTTP worker agent. Subclass implements execute to
+ * run the blocking request. The requester keeps ownership, submits it with
+ * a mailbox and a deadline, and gets the job pointer back on the mailbox
+ * once it is finished, expired or cancelled.
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#ifndef HTTPJOB_H_
+#define HTTPJOB_H_
+
+extern "C" {
+#include <FreeRTOS.h>
+#include <queue.h>
+}
+
+#include <stdint.h>
+#include <atomic>
+
+enum HTTPJobStatus {
+	HTTPJobIdle,
+	HTTPJobQueued,
+	HTTPJobRunning,
+	HTTPJobDone,
+	HTTPJobFailed,
+	HTTPJobExpired,
+	HTTPJobCancelled
+};
+
+class HTTPJob {
+public:
+	/***
+	 * Constructor
+	 */
+	HTTPJob();
+
+	/***
+	 * Destructor
+	 */
+	virtual ~HTTPJob();
+
+	/***
+	 * Run the request. Called on the worker task. Requests should be
+	 * limited to getRemainingMs so a late job stops while it runs
+	 * @return true on success
+	 */
+	virtual bool execute() = 0;
+
+	/***
+	 * Prepare for submission
+	 * @param replyQ - mailbox the job pointer is posted to when finished
+	 * @param deadlineMs - time allowed from now, 0 for none
+	 */
+	void prepare(QueueHandle_t replyQ, uint32_t deadlineMs);
+
+	/***
+	 * Ask for the job to be dropped. If it is already running the
+	 * result is discarded. Job is still posted back to the mailbox
+	 */
+	void cancel();
+
+	/***
+	 * Has cancel been called
+	 * @return
+	 */
+	bool isCancelled();
+
+	/***
+	 * Submitted and not yet posted back
+	 * @return true if worker still holds the job
+	 */
+	bool isInFlight();
+
+	/***
+	 * Has the deadline passed
+	 * @return
+	 */
+	bool isExpired();
+
+	/***
+	 * Time left before the deadline
+	 * @return milliseconds, UINT32_MAX if no deadline
+	 */
+	uint32_t getRemainingMs();
+
+	/***
+	 * Current status
+	 * @return
+	 */
+	HTTPJobStatus getStatus();
+
+	/***
+	 * Set status, used by the worker
+	 * @param status
+	 */
+	void setStatus(HTTPJobStatus status);
+
+	/***
+	 * Mailbox to post the job back to
+	 * @return queue
+	 */
+	QueueHandle_t getReplyQ();
+
+	/***
+	 * Time spent on the worker running the request
+	 * @return milliseconds
+	 */
+	uint32_t getRunMs();
+
+	/***
+	 * Set run time, used by the worker
+	 * @param ms
+	 */
+	void setRunMs(uint32_t ms);
+
+private:
+	QueueHandle_t xReplyQ = NULL;
+	uint32_t xDeadline = 0;
+	bool xHasDeadline = false;
+	uint32_t xRunMs = 0;
+
+	std::atomic<HTTPJobStatus> xStatus{HTTPJobIdle};
+	std::atomic<bool> xCancelled{false};
+};
+
+#endif /* HTTPJOB_H_ */
@@ -7,6 +7,7 @@
 
 #include "Request.h"
 #include "Transport.h"
+#include "HTTPConnPool.h"
 #include "json-maker/json-maker.h"
 #include "FreeRTOS.h"
 #include "task.h"
@@ -16,14 +17,12 @@ Request::Request() {
 	pAllocBuffer = pvPortMalloc(REQUEST_BUFFER_SIZE);
 	pBuffer = (char *) pAllocBuffer;
 	xBufferLen = REQUEST_BUFFER_SIZE;
-	pTrans = &xSockTrans;
 }
 
 Request::Request(char * buffer, uint bufLen) {
 	pAllocBuffer = NULL;
 	pBuffer = (char *) buffer;
 	xBufferLen = bufLen;
-	pTrans = &xSockTrans;
 }
 
 Request::~Request() {
@@ -90,8 +89,8 @@ bool Request::get(const char * url, std::map<std::string, std::string> *query){
 
 bool Request::doRequest(const char * method, const char * url, const char * payload, uint payloadLen){
 	char path[REQUEST_MAX_PATH];
-	char authPlain[REQUEST_MAX_PATH];
-	char auth64[REQUEST_MAX_PATH];
+	bool tls = false;
+	bool reused = false;
 
 	freeMemory();
 	pUri = new uri (url);
@@ -99,7 +98,7 @@ bool Request::doRequest(const char * method, const char * url, const char * payl
 	int serverPort = pUri->get_port();
 
 	if (pUri->get_scheme().compare("http") == 0 ){
-		pTrans =&xSockTrans;
+		tls = false;
 		if (serverPort == 0){
 			serverPort = 80;
 		}
@@ -107,7 +106,7 @@ bool Request::doRequest(const char * method, const char * url, const char * payl
 		printf("HTTP on Port %d\n", serverPort);
 #endif
 	} else if (pUri->get_scheme().compare("https") == 0 ){
-		pTrans =&xTLSTrans;
+		tls = true;
 		if (serverPort == 0){
 			serverPort = 443;
 		}
@@ -118,26 +117,11 @@ bool Request::doRequest(const char * method, const char * url, const char * payl
 		printf("Schema not implemented %s\n",
 				pUri->get_scheme().c_str()
 				);
+		xExtraCount = 0;
 		return false;
 	}
 
 	printf("host: %s port: %d\n", pUri->get_host().c_str(), serverPort);
-	if (!pTrans->transConnect(pUri->get_host().c_str(), serverPort)){
-		printf("Socket Connect Failed\r\n");
-		pTrans->transClose();
-		return false;
-	}
-
-	xNetworkContext.tcpTransport = pTrans;
-	xTransportInterface.pNetworkContext = &xNetworkContext;
-	xTransportInterface.send = Transport::staticTransSend;
-	xTransportInterface.recv = Transport::staticTransRead;
-
-	  /* Initialize all HTTP Client library API structs to 0. */
-	( void ) memset( &xRequestInfo, 0, sizeof( xRequestInfo ) );
-	( void ) memset( &xResponse, 0, sizeof( xResponse ) );
-	( void ) memset( &xRequestHeaders, 0, sizeof( xRequestHeaders ) );
-
 
 	if (pUri->get_query().length() == 0){
 		sprintf(path, "/%s", pUri->get_path().c_str() );
@@ -145,83 +129,117 @@ bool Request::doRequest(const char * method, const char * url, const char * payl
 		sprintf(path, "/%s?%s", pUri->get_path().c_str(), pUri->get_query().c_str() );
 	}
 
-	/* Initialize the request object. */
-	xRequestInfo.pHost = pUri->get_host().c_str();
-	xRequestInfo.hostLen = pUri->get_host().length();
-	xRequestInfo.pMethod =  method;
-	xRequestInfo.methodLen = strlen(method);
-	xRequestInfo.pPath = path;
-	xRequestInfo.pathLen = strlen(path);
-	xRequestInfo.reqFlags = false;
-
-	/* Set the buffer used for storing request headers. */
-	xRequestHeaders.pBuffer = (unsigned char *)pBuffer;
-	xRequestHeaders.bufferLen = xBufferLen;
-
+	//A pooled connection the server has since dropped is retried once on a new one
+	for (int attempt = 0; attempt < 2; attempt++){
+		if (!openConnection(tls, pUri->get_host().c_str(), serverPort, &reused)){
+			xExtraCount = 0;
+			return false;
+		}
 
-	xHTTPStatus = HTTPClient_InitializeRequestHeaders( &xRequestHeaders,
-													   &xRequestInfo );
+		xNetworkContext.tcpTransport = pTrans;
+		xTransportInterface.pNetworkContext = &xNetworkContext;
+		xTransportInterface.send = Transport::staticTransSend;
+		xTransportInterface.recv = Transport::staticTransRead;
+
+		  /* Initialize all HTTP Client library API structs to 0. */
+		( void ) memset( &xRequestInfo, 0, sizeof( xRequestInfo ) );
+		( void ) memset( &xResponse, 0, sizeof( xResponse ) );
+		( void ) memset( &xRequestHeaders, 0, sizeof( xRequestHeaders ) );
+
+		/* Initialize the request object. */
+		xRequestInfo.pHost = pUri->get_host().c_str();
+		xRequestInfo.hostLen = pUri->get_host().length();
+		xRequestInfo.pMethod =  method;
+		xRequestInfo.methodLen = strlen(method);
+		xRequestInfo.pPath = path;
+		xRequestInfo.pathLen = strlen(path);
+		xRequestInfo.reqFlags = HTTP_REQUEST_KEEP_ALIVE_FLAG;
+
+		/* Set the buffer used for storing request headers. */
+		xRequestHeaders.pBuffer = (unsigned char *)pBuffer;
+		xRequestHeaders.bufferLen = xBufferLen;
+
+
+		xHTTPStatus = HTTPClient_InitializeRequestHeaders( &xRequestHeaders,
+														   &xRequestInfo );
+
+		if (xHTTPStatus == HTTPSuccess){
+			if (payloadLen > 0){
+				xHTTPStatus = HTTPClient_AddHeader(
+						&xRequestHeaders,
+						"Content-Type",
+						strlen("Content-Type") ,
+						"application/json",
+						strlen("application/json")
+					   );
+			}
+		}
 
-	if (xHTTPStatus == HTTPSuccess){
-		if (payloadLen > 0){
+		for (uint i = 0; (i < xExtraCount) && (xHTTPStatus == HTTPSuccess); i++){
 			xHTTPStatus = HTTPClient_AddHeader(
 					&xRequestHeaders,
-					"Content-Type",
-					strlen("Content-Type") ,
-					"application/json",
-					strlen("application/json")
+					pExtraName[i],
+					strlen(pExtraName[i]),
+					pExtraValue[i],
+					strlen(pExtraValue[i])
 				   );
 		}
-	}
 
-	if( xHTTPStatus == HTTPSuccess ) {
-			/* Initialize the response object. The same buffer used for storing
-			 * request headers is reused here. */
-			xResponse.pBuffer = (unsigned char *)pBuffer;
-			xResponse.bufferLen = xBufferLen;
-			xResponse.getTime = Transport::getTime;
+		if( xHTTPStatus == HTTPSuccess ) {
+				/* Initialize the response object. The same buffer used for storing
+				 * request headers is reused here. */
+				xResponse.pBuffer = (unsigned char *)pBuffer;
+				xResponse.bufferLen = xBufferLen;
+				xResponse.getTime = Transport::getTime;
 
 #ifdef REQUEST_DEBUG
-			if (payloadLen != 0){
-				printf("Method %.*s Host %.*s:%d Path %.*s Payload %.*s\n",
-						xRequestInfo.methodLen,
-						xRequestInfo.pMethod,
-						xRequestInfo.hostLen,
-						xRequestInfo.pHost,
-						serverPort,
-						xRequestInfo.pathLen ,
-						xRequestInfo.pPath,
-						payloadLen,
-						payload
-						);
-				 printf( "Request Headers:\n%.*s\n",
-				                   ( int32_t ) xRequestHeaders.headersLen,
-				                   ( char * ) xRequestHeaders.pBuffer  );
-			} else {
-				printf("Method %.*s Host %.*s:%d Path %.*s \n",
-						xRequestInfo.methodLen,
-						xRequestInfo.pMethod,
-						xRequestInfo.hostLen,
-						xRequestInfo.pHost,
-						serverPort,
-						xRequestInfo.pathLen ,
-						xRequestInfo.pPath
-						);
-			}
+				if (payloadLen != 0){
+					printf("Method %.*s Host %.*s:%d Path %.*s Payload %.*s\n",
+							xRequestInfo.methodLen,
+							xRequestInfo.pMethod,
+							xRequestInfo.hostLen,
+							xRequestInfo.pHost,
+							serverPort,
+							xRequestInfo.pathLen ,
+							xRequestInfo.pPath,
+							payloadLen,
+							payload
+							);
+					 printf( "Request Headers:\n%.*s\n",
+					                   ( int32_t ) xRequestHeaders.headersLen,
+					                   ( char * ) xRequestHeaders.pBuffer  );
+				} else {
+					printf("Method %.*s Host %.*s:%d Path %.*s \n",
+							xRequestInfo.methodLen,
+							xRequestInfo.pMethod,
+							xRequestInfo.hostLen,
+							xRequestInfo.pHost,
+							serverPort,
+							xRequestInfo.pathLen ,
+							xRequestInfo.pPath
+							);
+				}
 #endif
 
-			/* Send the request and receive the response. */
-			xHTTPStatus = HTTPClient_Send( &xTransportInterface,
-										   &xRequestHeaders,
-										   ( uint8_t * ) payload,
-										  payloadLen,
-										   &xResponse,
-										   0 );
+				/* Send the request and receive the response. */
+				xHTTPStatus = HTTPClient_Send( &xTransportInterface,
+											   &xRequestHeaders,
+											   ( uint8_t * ) payload,
+											  payloadLen,
+											   &xResponse,
+											   0 );
 
-		} else {
-			printf ( "Failed to initialize HTTP request headers: Error=%s.",
-						HTTPClient_strerror( xHTTPStatus ) );
+			} else {
+				printf ( "Failed to initialize HTTP request headers: Error=%s.",
+							HTTPClient_strerror( xHTTPStatus ) );
+			}
+
+		if (reused && ((xHTTPStatus == HTTPNetworkError) || (xHTTPStatus == HTTPNoResponse))){
+			closeConnection(false);
+			continue;
 		}
+		break;
+	}
 
 
 	if (pObserver != NULL){
@@ -229,7 +247,8 @@ bool Request::doRequest(const char * method, const char * url, const char * payl
 	}
 
 
-	pTrans->transClose();
+	closeConnection(isKeepAlive(), getKeepAliveMs());
+	xExtraCount = 0;
 
 	if (xHTTPStatus == HTTPSuccess){
 		return true;
@@ -238,6 +257,106 @@ bool Request::doRequest(const char * method, const char * url, const char * payl
 
 }
 
+/***
+ * Borrow a connection from the pool, connecting it if not already open.
+ * Falls back to this request's own transports if the pool is busy
+ * @param tls - true for HTTPS
+ * @param host - server name
+ * @param port - port number
+ * @param reused - set true if an open connection was reused
+ * @return true if connected
+ */
+bool Request::openConnection(bool tls, const char * host, int port, bool *reused){
+	pConn = HTTPConnPool::getInstance()->acquire(tls, host, port, reused);
+	if (pConn != NULL){
+		pTrans = pConn->pTrans;
+	} else {
+		*reused = false;
+		if (tls){
+			pTrans = &xTLSTrans;
+		} else {
+			pTrans = &xSockTrans;
+		}
+	}
+
+	//Transport stops connect and reads when the time is up
+	pTrans->setTimeLimit(getTimeLeft());
+
+	if (*reused){
+		return true;
+	}
+
+	if (!pTrans->transConnect(host, port)){
+		printf("Socket Connect Failed\r\n");
+		closeConnection(false);
+		return false;
+	}
+	return true;
+}
+
+/***
+ * Finish with the connection
+ * @param keep - true to leave it open in the pool
+ * @param idleMs - how long it may stay idle, 0 for pool default
+ */
+void Request::closeConnection(bool keep, uint32_t idleMs){
+	//Pooled connection may be borrowed without a limit next time
+	pTrans->setTimeLimit(UINT32_MAX);
+	if (pConn != NULL){
+		HTTPConnPool::getInstance()->release(pConn, keep, idleMs);
+		pConn = NULL;
+	} else {
+		pTrans->transClose();
+	}
+	pTrans = NULL;
+}
+
+/***
+ * Can the connection be reused after this response
+ * @return true if response complete and server did not ask to close
+ */
+bool Request::isKeepAlive(){
+	if (xHTTPStatus != HTTPSuccess){
+		return false;
+	}
+	return (xResponse.respFlags & HTTP_RESPONSE_CONNECTION_CLOSE_FLAG) == 0;
+}
+
+/***
+ * Idle timeout from any Keep-Alive response header, less a second
+ * so we close before the server does
+ * @return milliseconds or 0 if not given
+ */
+uint32_t Request::getKeepAliveMs(){
+	const char * value = NULL;
+	size_t valueLen = 0;
+
+	if (xHTTPStatus != HTTPSuccess){
+		return 0;
+	}
+	if (HTTPClient_ReadHeader(&xResponse, "Keep-Alive", strlen("Keep-Alive"),
+			&value, &valueLen) != HTTPSuccess){
+		return 0;
+	}
+
+	const char * key = "timeout=";
+	size_t keyLen = strlen(key);
+	for (size_t i = 0; (i + keyLen) < valueLen; i++){
+		if (strncmp(&value[i], key, keyLen) == 0){
+			uint32_t secs = 0;
+			for (i += keyLen; (i < valueLen) && isdigit(value[i]); i++){
+				secs = secs * 10 + (value[i] - '0');
+			}
+			if (secs <= 1){
+				//Too short to be worth keeping, but not zero which means default
+				return 1;
+			}
+			return (secs - 1) * 1000;
+		}
+	}
+	return 0;
+}
+
 
 
 bool Request::post(const char * url,  std::map<std::string, std::string> *query){
@@ -297,6 +416,71 @@ const char * Request::getUriChar(){
 	return pUri->to_string().c_str();
 }
 
+/***
+ * Add a header to the next request only, for example If-None-Match.
+ * Strings are not copied and must live until the request returns
+ * @param name - header name
+ * @param value - header value
+ * @return false if too many headers
+ */
+bool Request::addHeader(const char * name, const char * value){
+	if (xExtraCount >= REQUEST_MAX_EXTRA_HEADERS){
+		return false;
+	}
+	pExtraName[xExtraCount] = name;
+	pExtraValue[xExtraCount] = value;
+	xExtraCount++;
+	return true;
+}
+
+/***
+ * Limit this and later requests to a time from now. Connect, TLS
+ * handshake and reads give up once it has passed
+ * @param ms - milliseconds allowed, UINT32_MAX for no limit
+ */
+void Request::setTimeLimit(uint32_t ms){
+	xLimited = (ms != UINT32_MAX);
+	xLimitEnd = Transport::getTime() + ms;
+}
+
+/***
+ * Time left before the limit
+ * @return milliseconds, UINT32_MAX if no limit
+ */
+uint32_t Request::getTimeLeft(){
+	if (!xLimited){
+		return UINT32_MAX;
+	}
+	int32_t left = (int32_t)(xLimitEnd - Transport::getTime());
+	if (left < 0){
+		return 0;
+	}
+	return (uint32_t)left;
+}
+
+/***
+ * Copy a header value from the last response
+ * @param name - header name
+ * @param value - buffer, zero terminated on return
+ * @param len - size of buffer
+ * @return true if header present and fitted
+ */
+bool Request::readHeader(const char * name, char * value, size_t len){
+	const char * pValue = NULL;
+	size_t valueLen = 0;
+
+	if (HTTPClient_ReadHeader(&xResponse, name, strlen(name),
+			&pValue, &valueLen) != HTTPSuccess){
+		return false;
+	}
+	if (valueLen >= len){
+		return false;
+	}
+	memcpy(value, pValue, valueLen);
+	value[valueLen] = 0;
+	return true;
+}
+
 
 
 int Request::urlEncode(char *target, const char * source){
@@ -16,6 +16,7 @@
 #include "core_http_client.h"
 #include "TCPTransport.h"
 #include "TLSTransBlock.h"
+#include "HTTPConnPool.h"
 
 #ifndef REQUEST_BUFFER_SIZE
 #define REQUEST_BUFFER_SIZE 256
@@ -25,6 +26,10 @@
 #define REQUEST_MAX_PATH 256
 #endif
 
+#ifndef REQUEST_MAX_EXTRA_HEADERS
+#define REQUEST_MAX_EXTRA_HEADERS 2
+#endif
+
 #define REQUEST_BUF_OVERFLOW -200
 
 //#define REQUEST_DEBUG
@@ -112,6 +117,37 @@ public:
 	 */
 	const char * getUriChar();
 
+	/***
+	 * Add a header to the next request only, for example If-None-Match.
+	 * Strings are not copied and must live until the request returns
+	 * @param name - header name
+	 * @param value - header value
+	 * @return false if too many headers
+	 */
+	bool addHeader(const char * name, const char * value);
+
+	/***
+	 * Copy a header value from the last response
+	 * @param name - header name
+	 * @param value - buffer, zero terminated on return
+	 * @param len - size of buffer
+	 * @return true if header present and fitted
+	 */
+	bool readHeader(const char * name, char * value, size_t len);
+
+	/***
+	 * Limit this and later requests to a time from now. Connect, TLS
+	 * handshake and reads give up once it has passed
+	 * @param ms - milliseconds allowed, UINT32_MAX for no limit
+	 */
+	void setTimeLimit(uint32_t ms);
+
+	/***
+	 * Time left before the limit
+	 * @return milliseconds, UINT32_MAX if no limit
+	 */
+	uint32_t getTimeLeft();
+
 private:
 	/***
 	 * Issue an HTTP Request
@@ -132,6 +168,37 @@ private:
      */
     int urlEncode(char *target, const char * source);
 
+	/***
+	 * Borrow a connection from the pool, connecting it if not already open.
+	 * Falls back to this request's own transports if the pool is busy
+	 * @param tls - true for HTTPS
+	 * @param host - server name
+	 * @param port - port number
+	 * @param reused - set true if an open connection was reused
+	 * @return true if connected
+	 */
+	bool openConnection(bool tls, const char * host, int port, bool *reused);
+
+	/***
+	 * Finish with the connection
+	 * @param keep - true to leave it open in the pool
+	 * @param idleMs - how long it may stay idle, 0 for pool default
+	 */
+	void closeConnection(bool keep, uint32_t idleMs = 0);
+
+	/***
+	 * Can the connection be reused after this response
+	 * @return true if response complete and server did not ask to close
+	 */
+	bool isKeepAlive();
+
+	/***
+	 * Idle timeout from any Keep-Alive response header, less a second
+	 * so we close before the server does
+	 * @return milliseconds or 0 if not given
+	 */
+	uint32_t getKeepAliveMs();
+
 
 	void *pAllocBuffer = NULL;
 	char * pBuffer = NULL;
@@ -147,9 +214,20 @@ private:
 	HTTPRequestHeaders_t xRequestHeaders;
 	HTTPStatus_t xHTTPStatus = HTTPSuccess;
 
+	//Used when every pooled connection is busy
 	TCPTransport xSockTrans;
 	TLSTransBlock xTLSTrans;
-	Transport *pTrans;
+	Transport *pTrans = NULL;
+	http_conn_t *pConn = NULL;
+
+	//Headers for the next request only
+	const char * pExtraName[REQUEST_MAX_EXTRA_HEADERS];
+	const char * pExtraValue[REQUEST_MAX_EXTRA_HEADERS];
+	uint xExtraCount = 0;
+
+	//Time limit from setTimeLimit
+	bool xLimited = false;
+	uint32_t xLimitEnd = 0;
 
 };
 
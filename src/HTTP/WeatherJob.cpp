@@ -0,0 +1,50 @@
+/*
+ * WeatherJob.cpp
+ *
+ * HTTP job that fetches the current weather for a location on the
+ * HTTP worker agent. Result is read from the request once posted back.
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#include "WeatherJob.h"
+
+/***
+ * Constructor
+ * @param lat - latitude
+ * @param lon - longitude
+ */
+WeatherJob::WeatherJob(const char * lat, const char * lon) : xLat(lat), xLon(lon) {
+	// NOP
+}
+
+/***
+ * Destructor
+ */
+WeatherJob::~WeatherJob() {
+	// NOP
+}
+
+/***
+ * Fetch the weather, and the icon if it is not yet in flash.
+ * Called on the worker task
+ * @return true on success
+ */
+bool WeatherJob::execute(){
+	//Stop mid request rather than finish after the deadline
+	xReq.setTimeLimit(getRemainingMs());
+	if (!xReq.getWeather(xLat, xLon)){
+		return false;
+	}
+	//An icon failure still leaves the weather usable
+	xReq.getIcon();
+	return true;
+}
+
+/***
+ * Request holding the latest result
+ * @return request
+ */
+WeatherServiceRequest & WeatherJob::getRequest(){
+	return xReq;
+}
@@ -0,0 +1,49 @@
+/*
+ * WeatherJob.h
+ *
+ * HTTP job that fetches the current weather for a location on the
+ * HTTP worker agent. Result is read from the request once posted back.
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#ifndef WEATHERJOB_H_
+#define WEATHERJOB_H_
+
+#include "HTTPJob.h"
+#include "WeatherServiceRequest.h"
+#include <string>
+
+class WeatherJob : public HTTPJob {
+public:
+	/***
+	 * Constructor
+	 * @param lat - latitude
+	 * @param lon - longitude
+	 */
+	WeatherJob(const char * lat, const char * lon);
+
+	/***
+	 * Destructor
+	 */
+	virtual ~WeatherJob();
+
+	/***
+	 * Fetch the weather. Called on the worker task
+	 * @return true on success
+	 */
+	virtual bool execute();
+
+	/***
+	 * Request holding the latest result
+	 * @return request
+	 */
+	WeatherServiceRequest & getRequest();
+
+private:
+	std::string xLat;
+	std::string xLon;
+	WeatherServiceRequest xReq;
+};
+
+#endif /* WEATHERJOB_H_ */
@@ -1,5 +1,60 @@
 #include "WeatherServiceRequest.h"
+#include "NVSOnboard.h"
+#include "ViewUtil.h"
+#include "IconCache.h"
+#include "hardware/rtc.h"
 #include <spng.h>
+#include <string.h>
+#include <stdint.h>
+
+//libspng needs malloc, calloc, realloc and free. The FreeRTOS heap only
+//has malloc and free, so each block is prefixed with its size for realloc
+typedef union {
+	size_t len;
+	uint64_t align;
+} spng_block_t;
+
+static void * spngMalloc(size_t size){
+	if (size > (SIZE_MAX - sizeof(spng_block_t))){
+		return NULL;
+	}
+	spng_block_t *b = (spng_block_t *) pvPortMalloc(sizeof(spng_block_t) + size);
+	if (b == NULL){
+		return NULL;
+	}
+	b->len = size;
+	return b + 1;
+}
+
+static void spngFree(void *ptr){
+	if (ptr != NULL){
+		vPortFree(((spng_block_t *) ptr) - 1);
+	}
+}
+
+static void * spngCalloc(size_t count, size_t size){
+	if ((size != 0) && (count > (SIZE_MAX / size))){
+		return NULL;
+	}
+	void *p = spngMalloc(count * size);
+	if (p != NULL){
+		memset(p, 0, count * size);
+	}
+	return p;
+}
+
+static void * spngRealloc(void *ptr, size_t size){
+	if (ptr == NULL){
+		return spngMalloc(size);
+	}
+	void *p = spngMalloc(size);
+	if (p != NULL){
+		size_t old = (((spng_block_t *) ptr) - 1)->len;
+		memcpy(p, ptr, (old < size) ? old : size);
+		spngFree(ptr);
+	}
+	return p;
+}
 
 bool WeatherServiceRequest::getWeather(std::string lat, std::string lon) {
 	
@@ -7,12 +62,38 @@ bool WeatherServiceRequest::getWeather(std::string lat, std::string lon) {
 	//Call OpenWeatherMap Service
 	char url[] = "https://api.openweathermap.org/data/2.5/weather";
 
+	xFromCache = false;
+	if (!xCacheValid){
+		loadCache();
+	}
+	if (isCacheFresh(lat, lon)){
+		xFromCache = true;
+		return true;
+	}
+
 	query["appid"]=OPENWEATHERMAPKEY;
 	query["lat"] = lat; 
 	query["lon"] = lon;
 	query["units"] = "imperial";
 
+	//Let the server answer 304 if nothing has changed
+	bool samePlace = xCacheValid &&
+			(lat.compare(xCache.lat) == 0) && (lon.compare(xCache.lon) == 0);
+	if (samePlace){
+		if (xCache.etag[0] != 0){
+			addHeader("If-None-Match", xCache.etag);
+		}
+		if (xCache.lastModified[0] != 0){
+			addHeader("If-Modified-Since", xCache.lastModified);
+		}
+	}
+
 	res = get(url, &query);
+	if (res && samePlace && (getStatusCode() == 304)){
+		printf("Weather not modified\n");
+		saveCache(lat, lon);
+		return true;
+	}
 	if ( res ){
 		res = (getStatusCode() == 200);
 	}
@@ -77,6 +158,7 @@ bool WeatherServiceRequest::getWeather(std::string lat, std::string lon) {
 				}
 			}
 
+			saveCache(lat, lon);
 		}
 	} else {
 		printf("WS failed %d\n", getStatusCode());
@@ -85,55 +167,219 @@ bool WeatherServiceRequest::getWeather(std::string lat, std::string lon) {
 	return res;
 }
 
-void WeatherServiceRequest::getIcon(){
+/***
+ * Load the last weather saved in NVS, so it can be shown at boot
+ * @return true if a cached result was loaded
+ */
+bool WeatherServiceRequest::loadCache(){
+	size_t len = sizeof(xCache);
+	NVSOnboard *nvs = NVSOnboard::getInstance();
+
+	if (nvs->get_blob(WEATHER_CACHE_NVS_KEY, &xCache, &len) != NVS_OK){
+		return false;
+	}
+	if (len != sizeof(xCache)){
+		//Layout changed, ignore
+		return false;
+	}
+	xTemp = xCache.temp;
+	xTempMin = xCache.tempMin;
+	xTempMax = xCache.tempMax;
+	strcpy(xDesc, xCache.desc);
+	strcpy(xLoc, xCache.loc);
+	strcpy(xIcon, xCache.icon);
+	xCacheValid = true;
+	return true;
+}
+
+/***
+ * Was the last getWeather answered from the cache
+ * @return true if no network was used
+ */
+bool WeatherServiceRequest::isFromCache(){
+	return xFromCache;
+}
+
+/***
+ * Is the cached result for this place and young enough to use
+ * @return true if fresh
+ */
+bool WeatherServiceRequest::isCacheFresh(const std::string &lat, const std::string &lon){
+	if (!xCacheValid || (xCache.fetched == 0)){
+		return false;
+	}
+	if ((lat.compare(xCache.lat) != 0) || (lon.compare(xCache.lon) != 0)){
+		return false;
+	}
+	uint32_t now = nowSeconds();
+	if ((now == 0) || (now < xCache.fetched)){
+		return false;
+	}
+	return (now - xCache.fetched) < WEATHER_CACHE_TTL_S;
+}
+
+/***
+ * Write parsed values and validators to NVS
+ */
+void WeatherServiceRequest::saveCache(const std::string &lat, const std::string &lon){
+	NVSOnboard *nvs = NVSOnboard::getInstance();
+	char etag[sizeof(xCache.etag)];
+	char lastModified[sizeof(xCache.lastModified)];
+
+	//Validators, a 304 may leave them out so keep the old ones
+	bool samePlace = xCacheValid &&
+			(lat.compare(xCache.lat) == 0) && (lon.compare(xCache.lon) == 0);
+	if (!readHeader("ETag", etag, sizeof(etag))){
+		strcpy(etag, samePlace ? xCache.etag : "");
+	}
+	if (!readHeader("Last-Modified", lastModified, sizeof(lastModified))){
+		strcpy(lastModified, samePlace ? xCache.lastModified : "");
+	}
+
+	memset(&xCache, 0, sizeof(xCache));
+	xCache.fetched = nowSeconds();
+	xCache.temp = xTemp;
+	xCache.tempMin = xTempMin;
+	xCache.tempMax = xTempMax;
+	strncpy(xCache.desc, xDesc, sizeof(xCache.desc) - 1);
+	strncpy(xCache.loc, xLoc, sizeof(xCache.loc) - 1);
+	strncpy(xCache.icon, xIcon, sizeof(xCache.icon) - 1);
+	strncpy(xCache.lat, lat.c_str(), sizeof(xCache.lat) - 1);
+	strncpy(xCache.lon, lon.c_str(), sizeof(xCache.lon) - 1);
+	strcpy(xCache.etag, etag);
+	strcpy(xCache.lastModified, lastModified);
+	xCacheValid = true;
+
+	if (nvs->set_blob(WEATHER_CACHE_NVS_KEY, &xCache, sizeof(xCache)) == NVS_OK){
+		nvs->commit();
+	}
+}
+
+/***
+ * Current UTC time from the RTC
+ * @return seconds, 0 if RTC not set
+ */
+uint32_t WeatherServiceRequest::nowSeconds(){
+	datetime_t d;
+	if (!rtc_running() || !rtc_get_datetime(&d)){
+		return 0;
+	}
+	return (uint32_t) get_seconds_from_datetime_t(d);
+}
+
+bool WeatherServiceRequest::getIcon(){
 	char iconURL[120];
+	IconCache *cache = IconCache::getInstance();
+
+	if (xIcon[0] == 0){
+		return false;
+	}
+	//Seen before, nothing to fetch or decode
+	if (cache->find(xIcon) != NULL){
+		return true;
+	}
+
+	char * pIconBuf = (char *) pvPortMalloc(WEATHER_ICON_BUF_LEN);
+	if (pIconBuf == NULL){
+		LogError(("No memory for icon download"));
+		return false;
+	}
 
 	sprintf(iconURL,"https://openweathermap.org/img/w/%s.png", xIcon);
-	Request req(pBuffer, xBufSize);
+	Request req(pIconBuf, WEATHER_ICON_BUF_LEN);
 	bool res;
 
+	//Same time limit as the weather request
+	req.setTimeLimit(getTimeLeft());
+
 	res = req.get(iconURL);
 	if ( res ){
 		res = (req.getStatusCode() == 200);
 	}
 	if (res){
-		printf("Icon Len: %d\n", req.getPayloadLen());
-
-		size_t size;
-		int length =  req.getPayloadLen();
-		uint8_t * pPng = (uint8_t *) req.getPayload();
-		struct spng_ihdr ihdr;
-		struct spng_alloc spngAlloc;
-		spngAlloc.malloc_fn = pvPortMalloc;
-		//spngAlloc.realloc_fn = pvPortRealloc;
-		//spngAlloc.calloc_fn = pvPortCalloc;
-		spngAlloc.free_fn = vPortFree;
-
-		spng_ctx *ctx = spng_ctx_new2(&spngAlloc, 0);
-		spng_set_png_buffer(ctx, pPng, length);
-
-		spng_decoded_image_size(ctx, SPNG_FMT_RGB8, &size);
-		printf("PNG Out Buf size is %d\n", size);
-		//out = (uint32_t *)malloc(size);
-		uint8_t * out = (uint8_t *) pvPortMalloc(size);
-
-		spng_get_ihdr(ctx, &ihdr);
-		uint width = ihdr.width;
-		uint height=ihdr.height;
-		printf("PNG (%u, %u)\n", width, height);
-
-		int res = spng_decode_image(ctx, out, size, SPNG_FMT_RGB8, 0);
-
-		printf("Decod complete = %d  %s\n", res, spng_strerror(res));
-	
-		//Draw PNG
-		//pTft->drawBitmapRGB8(0,0, width, height, out, true);
-		vPortFree(out);
-		spng_ctx_free(ctx);
+		LogDebug(("Icon Len: %d", req.getPayloadLen()));
+
+		uint8_t bitmap[ICON_CACHE_BYTES];
+		res = decodeIcon((const uint8_t *) req.getPayload(), req.getPayloadLen(), bitmap);
+		if (res){
+			//Dithered once, later renders come straight from flash
+			res = cache->store(xIcon, bitmap);
+		}
 
 	} else {
-		printf("WS failed %d\n", req.getStatusCode());
+		LogError(("Icon fetch failed %d", req.getStatusCode()));
 	}
+	vPortFree(pIconBuf);
+	return res;
+}
+
+bool WeatherServiceRequest::decodeIcon(const uint8_t *png, size_t len, uint8_t *bitmap){
+	struct spng_ihdr ihdr;
+	struct spng_row_info info;
+	struct spng_alloc spngAlloc;
+	size_t rowLen = 0;
+	uint8_t *row = NULL;
+	int err;
+
+	//All four hooks are required, the context itself comes from calloc
+	memset(&spngAlloc, 0, sizeof(spngAlloc));
+	spngAlloc.malloc_fn = spngMalloc;
+	spngAlloc.realloc_fn = spngRealloc;
+	spngAlloc.calloc_fn = spngCalloc;
+	spngAlloc.free_fn = spngFree;
+
+	spng_ctx *ctx = spng_ctx_new2(&spngAlloc, 0);
+	if (ctx == NULL){
+		return false;
+	}
+	spng_set_png_buffer(ctx, png, len);
+	spng_set_image_limits(ctx, WEATHER_ICON_MAX_DIM, WEATHER_ICON_MAX_DIM);
+
+	err = spng_get_ihdr(ctx, &ihdr);
+	if (err == 0){
+		LogDebug(("PNG (%u, %u)", ihdr.width, ihdr.height));
+		err = spng_decode_image(ctx, NULL, 0, SPNG_FMT_RGBA8, SPNG_DECODE_PROGRESSIVE);
+	}
+
+	//Only ever hold one scanline of the image
+	if (err == 0){
+		rowLen = ihdr.width * 4;
+		row = (uint8_t *) pvPortMalloc(rowLen);
+		if (row == NULL){
+			err = SPNG_EMEM;
+		}
+	}
+
+	if (err == 0){
+		IconDither dither(bitmap, ICON_CACHE_W, ICON_CACHE_H);
+		dither.begin(ihdr.width, ihdr.height);
+
+		//Adam7 last pass holds every odd row at full width, sample those
+		int lastPass = (ihdr.interlace_method == SPNG_INTERLACE_NONE) ? 0 : 6;
+		do {
+			err = spng_get_row_info(ctx, &info);
+			if (err != 0){
+				break;
+			}
+			err = spng_decode_row(ctx, row, rowLen);
+			if ((err == 0) || (err == SPNG_EOI)){
+				if (info.pass == lastPass){
+					dither.row(row, info.row_num);
+				}
+			}
+		} while (err == 0);
+	}
+
+	if (row != NULL){
+		vPortFree(row);
+	}
+	spng_ctx_free(ctx);
+
+	if (err != SPNG_EOI){
+		LogError(("Icon decode failed %d %s", err, spng_strerror(err)));
+		return false;
+	}
+	return true;
 }
 
 bool WeatherServiceRequest::getTempValues(float& temp, float& tempMin, float& tempMax) {
@@ -157,3 +403,8 @@ bool WeatherServiceRequest::getLoc(char* loc) {
 	return true;
 }
 
+bool WeatherServiceRequest::getIconCode(char* icon) {
+	strcpy(icon, xIcon);
+	return (xIcon[0] != 0);
+}
+
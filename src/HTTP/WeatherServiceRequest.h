@@ -4,6 +4,41 @@
 #include "tiny-json.h"
 
 #define MAX_TAGS 80
+
+//Cached weather younger than this is used without going to the network
+#ifndef WEATHER_CACHE_TTL_S
+#define WEATHER_CACHE_TTL_S 600
+#endif
+
+#define WEATHER_CACHE_NVS_KEY "wcache"
+
+//Download buffer for an icon PNG, only held while fetching a new icon
+#ifndef WEATHER_ICON_BUF_LEN
+#define WEATHER_ICON_BUF_LEN 4096
+#endif
+
+//Larger icons are rejected rather than decoded
+#ifndef WEATHER_ICON_MAX_DIM
+#define WEATHER_ICON_MAX_DIM 256
+#endif
+
+/***
+ * Parsed weather as kept in NVS, with validators for a conditional refresh
+ */
+typedef struct {
+	uint32_t fetched;	//UTC seconds, 0 if clock was not set
+	float temp;
+	float tempMin;
+	float tempMax;
+	char desc[20];
+	char loc[20];
+	char icon[5];
+	char lat[12];
+	char lon[12];
+	char etag[48];
+	char lastModified[32];
+} weather_cache_t;
+
 class WeatherServiceRequest : public Request {
 
 	public:
@@ -12,13 +47,63 @@ class WeatherServiceRequest : public Request {
 	bool getTempValues(float& temp, float& tempMin, float& tempMax);
 	bool getDesc(char* desc);
 	bool getLoc(char* loc);
-	void getIcon();
+	bool getIconCode(char* icon);
+
+	/***
+	 * Make sure the current icon is in the flash icon cache.
+	 * Downloads and dithers it only the first time the code is seen
+	 * @return true if the icon is cached
+	 */
+	bool getIcon();
+
+	/***
+	 * Load the last weather saved in NVS, so it can be shown at boot
+	 * @return true if a cached result was loaded
+	 */
+	bool loadCache();
+
+	/***
+	 * Was the last getWeather answered from the cache
+	 * @return true if no network was used
+	 */
+	bool isFromCache();
 
 private:
+	/***
+	 * Is the cached result for this place and young enough to use
+	 * @return true if fresh
+	 */
+	bool isCacheFresh(const std::string &lat, const std::string &lon);
+
+	/***
+	 * Write parsed values and validators to NVS
+	 */
+	void saveCache(const std::string &lat, const std::string &lon);
+
+	/***
+	 * Current UTC time from the RTC
+	 * @return seconds, 0 if RTC not set
+	 */
+	static uint32_t nowSeconds();
+
+	/***
+	 * Decode a PNG row by row, dithering each row into the icon bitmap.
+	 * Peak memory is one RGBA8 scanline rather than the whole image
+	 * @param png - PNG data
+	 * @param len - length of PNG data
+	 * @param bitmap - ICON_CACHE_BYTES bitmap to fill
+	 * @return true if decoded
+	 */
+	static bool decodeIcon(const uint8_t *png, size_t len, uint8_t *bitmap);
+
+	weather_cache_t xCache;
+	bool xCacheValid = false;
+	bool xFromCache = false;
+
 	//Weather Service parameters
 	char xDesc[20];
 	char xLoc[20];
-	char xIcon[5];
+	char xIcon[5] = "";
 	float xTemp = 0.0f;
 	float xTempMax = 0.0f;
 	float xTempMin = 0.0f;
@@ -28,6 +113,4 @@ private:
 	char responseBuf[RESPONSE_BUF_LEN];
 	char json[RESPONSE_BUF_LEN];
 	json_t pool[MAX_TAGS];
-	char * pBuffer;
-	size_t xBufSize;
 };
@@ -0,0 +1,456 @@
+/*
+ * JsonSax.cpp
+ *
+ * Incremental event based JSON reader. Text can be fed in chunks of any
+ * size as it arrives and events are passed to a handler as soon as each
+ * token completes. No document tree is built, so memory use is fixed by
+ * the token buffer and nesting depth rather than the size of the input.
+ * String values longer than the buffer are passed to the handler in parts.
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#include "JsonSax.h"
+#include <string.h>
+
+/***
+ * Constructor
+ * @param handler - receives events, must remain valid
+ */
+JsonSax::JsonSax(JsonSaxHandler *handler) {
+	pHandler = handler;
+	reset();
+}
+
+/***
+ * Destructor
+ */
+JsonSax::~JsonSax() {
+	// NOP
+}
+
+/***
+ * Start a new document
+ */
+void JsonSax::reset(){
+	xState = SaxValue;
+	xStack = 0;
+	xDepth = 0;
+	xTokenLen = 0;
+	xToken[0] = 0;
+	xStringIsKey = false;
+	xTokenTruncated = false;
+	xChunked = false;
+	xTruncated = 0;
+	xBytes = 0;
+}
+
+/***
+ * Read the next chunk of the document
+ * @param chunk - text, need not be zero terminated
+ * @param len - length of chunk
+ * @return false once the document is found to be invalid
+ */
+bool JsonSax::feed(const char *chunk, size_t len){
+	for (size_t i = 0; i < len; i++){
+		if (!step(chunk[i])){
+			xState = SaxError;
+			return false;
+		}
+	}
+	xBytes += len;
+	return (xState != SaxError);
+}
+
+/***
+ * End of input
+ * @return true if a complete document was read
+ */
+bool JsonSax::finish(){
+	//A bare top level number has no terminator
+	if ((xState == SaxLiteral) && (xDepth == 0)){
+		emitLiteral();
+		if (xState != SaxError){
+			valueDone();
+		}
+	}
+	return (xState == SaxDone);
+}
+
+/***
+ * Has the document been found to be invalid
+ * @return
+ */
+bool JsonSax::isError(){
+	return (xState == SaxError);
+}
+
+/***
+ * Number of keys truncated to fit the token buffer
+ * @return
+ */
+uint32_t JsonSax::getTruncated(){
+	return xTruncated;
+}
+
+/***
+ * Total bytes read since reset
+ * @return
+ */
+size_t JsonSax::getBytes(){
+	return xBytes;
+}
+
+/***
+ * Value has completed, work out what comes next
+ */
+void JsonSax::valueDone(){
+	xState = (xDepth == 0) ? SaxDone : SaxNext;
+}
+
+/***
+ * Push a container
+ * @param isObject
+ * @return false if too deep
+ */
+bool JsonSax::push(bool isObject){
+	if (xDepth >= JSON_SAX_MAX_DEPTH){
+		return false;
+	}
+	if (isObject){
+		xStack |= (1UL << xDepth);
+	} else {
+		xStack &= ~(1UL << xDepth);
+	}
+	xDepth++;
+	return true;
+}
+
+/***
+ * Pop a container
+ * @param isObject - type expected by the closing character
+ * @return false if it does not match the open container
+ */
+bool JsonSax::pop(bool isObject){
+	if (xDepth == 0){
+		return false;
+	}
+	bool top = ((xStack & (1UL << (xDepth - 1))) != 0);
+	if (top != isObject){
+		return false;
+	}
+	xDepth--;
+	return true;
+}
+
+/***
+ * Add a character to the token buffer
+ * @param c
+ */
+void JsonSax::append(char c){
+	if ((xTokenLen >= JSON_SAX_TOKEN_LEN) && xChunked){
+		flushPart();
+	}
+	if (xTokenLen < JSON_SAX_TOKEN_LEN){
+		xToken[xTokenLen++] = c;
+	} else {
+		xTokenTruncated = true;
+	}
+}
+
+/***
+ * Add a code point to the token buffer as UTF-8
+ * @param cp
+ */
+void JsonSax::appendCodePoint(uint16_t cp){
+	size_t need = (cp < 0x80) ? 1 : ((cp < 0x800) ? 2 : 3);
+	if (((xTokenLen + need) > JSON_SAX_TOKEN_LEN) && xChunked){
+		flushPart();
+	}
+	if ((xTokenLen + need) > JSON_SAX_TOKEN_LEN){
+		xTokenTruncated = true;
+		return;
+	}
+	if (need == 1){
+		append((char)cp);
+	} else if (need == 2){
+		append((char)(0xC0 | (cp >> 6)));
+		append((char)(0x80 | (cp & 0x3F)));
+	} else {
+		append((char)(0xE0 | (cp >> 12)));
+		append((char)(0x80 | ((cp >> 6) & 0x3F)));
+		append((char)(0x80 | (cp & 0x3F)));
+	}
+}
+
+/***
+ * Token buffer is full of a string value, pass it on as a part.
+ * An incomplete UTF-8 sequence at the end is kept for the next part
+ */
+void JsonSax::flushPart(){
+	size_t split = xTokenLen;
+	size_t start = xTokenLen;
+	char keep[4];
+
+	//Find the lead byte of the last sequence
+	while ((start > 0) && ((xTokenLen - start) < 3) &&
+			((xToken[start - 1] & 0xC0) == 0x80)){
+		start--;
+	}
+	if ((start > 0) && ((xToken[start - 1] & 0xC0) == 0xC0)){
+		uint8_t lead = (uint8_t) xToken[start - 1];
+		size_t seqLen = (lead >= 0xF0) ? 4 : ((lead >= 0xE0) ? 3 : 2);
+		if ((xTokenLen - (start - 1)) < seqLen){
+			split = start - 1;
+		}
+	}
+
+	size_t kept = xTokenLen - split;
+	memcpy(keep, &xToken[split], kept);
+	xToken[split] = 0;
+	pHandler->jsonStringPart(xToken, split);
+	memcpy(xToken, keep, kept);
+	xTokenLen = kept;
+}
+
+/***
+ * Hand the completed literal to the handler
+ */
+void JsonSax::emitLiteral(){
+	xToken[xTokenLen] = 0;
+	if (xTokenTruncated){
+		xState = SaxError;
+		return;
+	}
+	char first = xToken[0];
+	if ((first == 't') || (first == 'f') || (first == 'n')){
+		if ((strcmp(xToken, "true") != 0) &&
+				(strcmp(xToken, "false") != 0) &&
+				(strcmp(xToken, "null") != 0)){
+			xState = SaxError;
+			return;
+		}
+	}
+	pHandler->jsonPrimitive(xToken, xTokenLen);
+}
+
+/***
+ * Process one character
+ * @param c
+ * @return false on error
+ */
+bool JsonSax::step(char c){
+	switch(xState){
+	case SaxString:{
+		if (c == '\\'){
+			xState = SaxEscape;
+		} else if (c == '"'){
+			if (xTokenTruncated){
+				//Do not leave a partial UTF-8 sequence at the end
+				while ((xTokenLen > 0) && ((xToken[xTokenLen - 1] & 0xC0) == 0x80)){
+					xTokenLen--;
+				}
+				if ((xTokenLen > 0) && ((xToken[xTokenLen - 1] & 0xC0) == 0xC0)){
+					xTokenLen--;
+				}
+				xTruncated++;
+			}
+			xToken[xTokenLen] = 0;
+			if (xStringIsKey){
+				pHandler->jsonKey(xToken, xTokenLen);
+				xState = SaxColon;
+			} else {
+				pHandler->jsonString(xToken, xTokenLen);
+				valueDone();
+			}
+		} else if ((uint8_t)c < 0x20){
+			return false;
+		} else {
+			append(c);
+		}
+		return true;
+	}
+	case SaxEscape:{
+		xState = SaxString;
+		switch(c){
+		case '"':
+		case '\\':
+		case '/':{
+			append(c);
+			break;
+		}
+		case 'b':{
+			append('\b');
+			break;
+		}
+		case 'f':{
+			append('\f');
+			break;
+		}
+		case 'n':{
+			append('\n');
+			break;
+		}
+		case 'r':{
+			append('\r');
+			break;
+		}
+		case 't':{
+			append('\t');
+			break;
+		}
+		case 'u':{
+			xUnicode = 0;
+			xUnicodeDigits = 0;
+			xState = SaxUnicode;
+			break;
+		}
+		default:{
+			return false;
+		}
+		}
+		return true;
+	}
+	case SaxUnicode:{
+		uint8_t v;
+		if ((c >= '0') && (c <= '9')){
+			v = c - '0';
+		} else if ((c >= 'a') && (c <= 'f')){
+			v = c - 'a' + 10;
+		} else if ((c >= 'A') && (c <= 'F')){
+			v = c - 'A' + 10;
+		} else {
+			return false;
+		}
+		xUnicode = (xUnicode << 4) | v;
+		xUnicodeDigits++;
+		if (xUnicodeDigits == 4){
+			//Surrogate halves are not paired, show a placeholder
+			if ((xUnicode >= 0xD800) && (xUnicode <= 0xDFFF)){
+				xUnicode = '?';
+			}
+			appendCodePoint(xUnicode);
+			xState = SaxString;
+		}
+		return true;
+	}
+	case SaxLiteral:{
+		if (((c >= '0') && (c <= '9')) || ((c >= 'a') && (c <= 'z')) ||
+				((c >= 'A') && (c <= 'Z')) || (c == '+') || (c == '-') || (c == '.')){
+			append(c);
+			return true;
+		}
+		emitLiteral();
+		if (xState == SaxError){
+			return false;
+		}
+		valueDone();
+		//Terminating character belongs to the structure
+		return step(c);
+	}
+	default:{
+		break;
+	}
+	}
+
+	if ((c == ' ') || (c == '\t') || (c == '\n') || (c == '\r')){
+		return (xState != SaxError);
+	}
+
+	switch(xState){
+	case SaxFirstValue:
+		if (c == ']'){
+			if (!pop(false)){
+				return false;
+			}
+			pHandler->jsonEndArray();
+			valueDone();
+			return true;
+		}
+		/* no break */
+	case SaxValue:{
+		if (c == '{'){
+			if (!push(true)){
+				return false;
+			}
+			pHandler->jsonStartObject();
+			xState = SaxFirstKey;
+		} else if (c == '['){
+			if (!push(false)){
+				return false;
+			}
+			pHandler->jsonStartArray();
+			xState = SaxFirstValue;
+		} else if (c == '"'){
+			xTokenLen = 0;
+			xTokenTruncated = false;
+			xStringIsKey = false;
+			xChunked = true;
+			xState = SaxString;
+		} else if (((c >= '0') && (c <= '9')) || (c == '-') ||
+				(c == 't') || (c == 'f') || (c == 'n')){
+			xTokenLen = 0;
+			xTokenTruncated = false;
+			xChunked = false;
+			append(c);
+			xState = SaxLiteral;
+		} else {
+			return false;
+		}
+		return true;
+	}
+	case SaxFirstKey:
+		if (c == '}'){
+			if (!pop(true)){
+				return false;
+			}
+			pHandler->jsonEndObject();
+			valueDone();
+			return true;
+		}
+		/* no break */
+	case SaxKey:{
+		if (c != '"'){
+			return false;
+		}
+		xTokenLen = 0;
+		xTokenTruncated = false;
+		xStringIsKey = true;
+		xChunked = false;
+		xState = SaxString;
+		return true;
+	}
+	case SaxColon:{
+		if (c != ':'){
+			return false;
+		}
+		xState = SaxValue;
+		return true;
+	}
+	case SaxNext:{
+		bool inObject = ((xStack & (1UL << (xDepth - 1))) != 0);
+		if (c == ','){
+			xState = inObject ? SaxKey : SaxValue;
+		} else if (c == '}'){
+			if (!pop(true)){
+				return false;
+			}
+			pHandler->jsonEndObject();
+			valueDone();
+		} else if (c == ']'){
+			if (!pop(false)){
+				return false;
+			}
+			pHandler->jsonEndArray();
+			valueDone();
+		} else {
+			return false;
+		}
+		return true;
+	}
+	default:{
+		//Done or error, nothing more is accepted
+		return false;
+	}
+	}
+}
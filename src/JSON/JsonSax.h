@@ -0,0 +1,166 @@
+/*
+ * JsonSax.h
+ *
+ * Incremental event based JSON reader. Text can be fed in chunks of any
+ * size as it arrives and events are passed to a handler as soon as each
+ * token completes. No document tree is built, so memory use is fixed by
+ * the token buffer and nesting depth rather than the size of the input.
+ * String values longer than the buffer are passed to the handler in parts.
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#ifndef JSONSAX_H_
+#define JSONSAX_H_
+
+#include "JsonSaxHandler.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+//Longest key or literal held. Longer keys are truncated and longer
+//literals are an error. String values of any length are passed in parts
+#ifndef JSON_SAX_TOKEN_LEN
+#define JSON_SAX_TOKEN_LEN 128
+#endif
+
+//Deepest nesting of objects and arrays, at most 32
+#ifndef JSON_SAX_MAX_DEPTH
+#define JSON_SAX_MAX_DEPTH 16
+#endif
+
+enum JsonSaxState {
+	SaxValue,		//Expecting a value
+	SaxFirstValue,	//Expecting a value or end of an empty array
+	SaxKey,			//Expecting a key
+	SaxFirstKey,	//Expecting a key or end of an empty object
+	SaxColon,		//Expecting colon after key
+	SaxNext,		//Expecting comma or end of container
+	SaxString,		//Inside a string
+	SaxEscape,		//After backslash inside a string
+	SaxUnicode,		//Reading \uXXXX digits
+	SaxLiteral,		//Inside a number, true, false or null
+	SaxDone,		//Top level value complete
+	SaxError
+};
+
+class JsonSax {
+public:
+	/***
+	 * Constructor
+	 * @param handler - receives events, must remain valid
+	 */
+	JsonSax(JsonSaxHandler *handler);
+
+	/***
+	 * Destructor
+	 */
+	virtual ~JsonSax();
+
+	/***
+	 * Start a new document
+	 */
+	void reset();
+
+	/***
+	 * Read the next chunk of the document
+	 * @param chunk - text, need not be zero terminated
+	 * @param len - length of chunk
+	 * @return false once the document is found to be invalid
+	 */
+	bool feed(const char *chunk, size_t len);
+
+	/***
+	 * End of input
+	 * @return true if a complete document was read
+	 */
+	bool finish();
+
+	/***
+	 * Has the document been found to be invalid
+	 * @return
+	 */
+	bool isError();
+
+	/***
+	 * Number of keys truncated to fit the token buffer
+	 * @return
+	 */
+	uint32_t getTruncated();
+
+	/***
+	 * Total bytes read since reset
+	 * @return
+	 */
+	size_t getBytes();
+
+private:
+	/***
+	 * Process one character
+	 * @param c
+	 * @return false on error
+	 */
+	bool step(char c);
+
+	/***
+	 * Value has completed, work out what comes next
+	 */
+	void valueDone();
+
+	/***
+	 * Push a container
+	 * @param isObject
+	 * @return false if too deep
+	 */
+	bool push(bool isObject);
+
+	/***
+	 * Pop a container
+	 * @param isObject - type expected by the closing character
+	 * @return false if it does not match the open container
+	 */
+	bool pop(bool isObject);
+
+	/***
+	 * Add a character to the token buffer
+	 * @param c
+	 */
+	void append(char c);
+
+	/***
+	 * Add a code point to the token buffer as UTF-8
+	 * @param cp
+	 */
+	void appendCodePoint(uint16_t cp);
+
+	/***
+	 * Token buffer is full of a string value, pass it on as a part.
+	 * An incomplete UTF-8 sequence at the end is kept for the next part
+	 */
+	void flushPart();
+
+	/***
+	 * Hand the completed literal to the handler
+	 */
+	void emitLiteral();
+
+	JsonSaxHandler *pHandler;
+	JsonSaxState xState = SaxValue;
+
+	//One bit per level, set for object
+	uint32_t xStack = 0;
+	uint8_t xDepth = 0;
+
+	char xToken[JSON_SAX_TOKEN_LEN + 1];
+	size_t xTokenLen = 0;
+	bool xStringIsKey = false;
+	bool xTokenTruncated = false;
+	bool xChunked = false;		//Token is a string value, passed in parts
+
+	uint16_t xUnicode = 0;
+	uint8_t xUnicodeDigits = 0;
+
+	uint32_t xTruncated = 0;
+	size_t xBytes = 0;
+};
+
+#endif /* JSONSAX_H_ */
@@ -0,0 +1,91 @@
+/*
+ * JsonSaxHandler.cpp
+ *
+ * Receives the events produced by JsonSax as a document is read.
+ * Default implementations ignore the event so a handler only needs to
+ * override the ones it cares about.
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#include "JsonSaxHandler.h"
+
+/***
+ * Constructor
+ */
+JsonSaxHandler::JsonSaxHandler() {
+	// NOP
+}
+
+/***
+ * Destructor
+ */
+JsonSaxHandler::~JsonSaxHandler() {
+	// NOP
+}
+
+/***
+ * Opening brace of an object
+ */
+void JsonSaxHandler::jsonStartObject(){
+	// NOP
+}
+
+/***
+ * Closing brace of an object
+ */
+void JsonSaxHandler::jsonEndObject(){
+	// NOP
+}
+
+/***
+ * Opening bracket of an array
+ */
+void JsonSaxHandler::jsonStartArray(){
+	// NOP
+}
+
+/***
+ * Closing bracket of an array
+ */
+void JsonSaxHandler::jsonEndArray(){
+	// NOP
+}
+
+/***
+ * Property name within an object
+ * @param key - zero terminated, unescaped. Only valid during call
+ * @param len - length of key
+ */
+void JsonSaxHandler::jsonKey(const char *key, size_t len){
+	// NOP
+}
+
+/***
+ * String value, or the last part of one passed in parts
+ * @param value - zero terminated, unescaped. Only valid during call
+ * @param len - length of value
+ */
+void JsonSaxHandler::jsonString(const char *value, size_t len){
+	// NOP
+}
+
+/***
+ * Leading part of a string value too long for the token buffer.
+ * Further parts follow, then jsonString with the rest. Parts never
+ * split a UTF-8 sequence
+ * @param value - zero terminated, unescaped. Only valid during call
+ * @param len - length of part
+ */
+void JsonSaxHandler::jsonStringPart(const char *value, size_t len){
+	// NOP
+}
+
+/***
+ * Number, true, false or null value
+ * @param text - zero terminated literal text. Only valid during call
+ * @param len - length of text
+ */
+void JsonSaxHandler::jsonPrimitive(const char *text, size_t len){
+	// NOP
+}
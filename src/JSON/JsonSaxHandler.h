@@ -0,0 +1,79 @@
+/*
+ * JsonSaxHandler.h
+ *
+ * Receives the events produced by JsonSax as a document is read.
+ * Default implementations ignore the event so a handler only needs to
+ * override the ones it cares about.
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#ifndef JSONSAXHANDLER_H_
+#define JSONSAXHANDLER_H_
+
+#include <stdlib.h>
+
+class JsonSaxHandler {
+public:
+	/***
+	 * Constructor
+	 */
+	JsonSaxHandler();
+
+	/***
+	 * Destructor
+	 */
+	virtual ~JsonSaxHandler();
+
+	/***
+	 * Opening brace of an object
+	 */
+	virtual void jsonStartObject();
+
+	/***
+	 * Closing brace of an object
+	 */
+	virtual void jsonEndObject();
+
+	/***
+	 * Opening bracket of an array
+	 */
+	virtual void jsonStartArray();
+
+	/***
+	 * Closing bracket of an array
+	 */
+	virtual void jsonEndArray();
+
+	/***
+	 * Property name within an object
+	 * @param key - zero terminated, unescaped. Only valid during call
+	 * @param len - length of key
+	 */
+	virtual void jsonKey(const char *key, size_t len);
+
+	/***
+	 * String value, or the last part of one passed in parts
+	 * @param value - zero terminated, unescaped. Only valid during call
+	 * @param len - length of value
+	 */
+	virtual void jsonString(const char *value, size_t len);
+
+	/***
+	 * Leading part of a string value too long for the token buffer.
+	 * Further parts follow, then jsonString with the rest. Parts never
+	 * split a UTF-8 sequence
+	 * @param value - zero terminated, unescaped. Only valid during call
+	 * @param len - length of part
+	 */
+	virtual void jsonStringPart(const char *value, size_t len);
+
+	/***
+	 * Number, true, false or null value
+	 * @param text - zero terminated literal text. Only valid during call
+	 * @param len - length of text
+	 */
+	virtual void jsonPrimitive(const char *text, size_t len);
+};
+
+#endif /* JSONSAXHANDLER_H_ */
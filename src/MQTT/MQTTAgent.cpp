@@ -9,6 +9,7 @@
 
 #include "MQTTAgent.h"
 #include <stdlib.h>
+#include <stddef.h>
 #include "Transport.h"
 #include "WifiHelper.h"
 
@@ -18,6 +19,9 @@
 
 const char * MQTTAgent::WILLPAYLOAD = "{'online':0}";
 const char * MQTTAgent::ONLINEPAYLOAD = "{'online':1}";
+MQTTPublishPool MQTTAgent::xPublishPool;
+MQTTSubscribePool MQTTAgent::xSubscribePool;
+MQTTOfflineQueue MQTTAgent::xOfflineQueue;
 
 
 /***
@@ -26,7 +30,8 @@ const char * MQTTAgent::ONLINEPAYLOAD = "{'online':1}";
  * @param eth - Ethernet helper for communicating to hardware
  */
 MQTTAgent::MQTTAgent() {
-	//NOP
+	memset(&xDrainCmd, 0, sizeof(xDrainCmd));
+	xDrainCmd.pOwner = this;
 }
 
 /***
@@ -42,6 +47,11 @@ MQTTAgent::~MQTTAgent() {
 		vPortFree(pOnlineTopic);
 		pOnlineTopic = NULL;
 	}
+
+	if (pConnTopic != NULL){
+		vPortFree(pConnTopic);
+		pConnTopic = NULL;
+	}
 }
 
 /***
@@ -79,9 +89,15 @@ MQTTStatus_t MQTTAgent::init(){
 	/* Initialize the task pool. */
 	Agent_InitializePool();
 
+	if (!xPublishPool.init() || !xSubscribePool.init()){
+		return MQTTIllegalState;
+	}
+	xOfflineQueue.init();
+
 	// Fill in Transforp interface
 	xNetworkContext.mqttTask = NULL;
 	xNetworkContext.tcpTransport = &xTcpTrans;
+	xTcpTrans.setRecvCallback(MQTTAgent::socketDataCB, this);
 	xTransport.pNetworkContext = &xNetworkContext;
 	xTransport.send = Transport::staticTransSend;
 	xTransport.recv = Transport::staticTransRead;
@@ -168,6 +184,22 @@ void MQTTAgent::credentials(const char * user, const char * passwd, const char *
 		}
 	}
 
+	if (pConnTopic == NULL){
+		pConnTopic = (char *)pvPortMalloc( MQTTTopicHelper::lenLifeCycleTopic(this->pId, MQTT_TOPIC_LIFECYCLE_CONN));
+		if (pConnTopic != NULL){
+			MQTTTopicHelper::genLifeCycleTopic(pConnTopic, this->pId, MQTT_TOPIC_LIFECYCLE_CONN);
+		} else {
+			LogError( ("Unable to allocate LC topic") );
+		}
+	}
+
+	//Spread retries across devices, client id is unique per device
+	uint32_t seed = 2166136261U;
+	for (const char *c = this->pId; *c != 0; c++){
+		seed = (seed ^ (uint8_t)*c) * 16777619U;
+	}
+	xBackoff.seed(seed ^ Transport::getTime());
+
 }
 
 /***
@@ -186,6 +218,56 @@ bool MQTTAgent::mqttConnect(const char * target, uint16_t  port, bool recon){
 	return true;
 }
 
+/***
+ * Wake the state machine so it re-evaluates its state
+ */
+void MQTTAgent::wake(){
+	if (xHandle != NULL){
+		xTaskNotifyGive(xHandle);
+	}
+}
+
+/***
+ * Block the agent task until woken or timeout
+ * @param ticks - max time to wait
+ * @return true if woken before timeout
+ */
+bool MQTTAgent::waitForEvent(TickType_t ticks){
+	return (ulTaskNotifyTake(pdTRUE, ticks) > 0);
+}
+
+/***
+ * Socket has data, wake the command loop to process it rather than
+ * having it poll the socket
+ * @param arg - MQTTAgent
+ */
+void MQTTAgent::socketDataCB(void *arg){
+	MQTTAgent *self = (MQTTAgent *)arg;
+	if (self->xConnState != Online){
+		//Agent task is reading the socket itself while connecting
+		return;
+	}
+
+	//Any queued command runs the process loop anyway
+	if (uxQueueMessagesWaiting(self->xCommandQueue.queue) > 0){
+		return;
+	}
+
+	MQTTAgentCommandInfo_t xCommandInfo;
+	memset(&xCommandInfo, 0, sizeof(xCommandInfo));
+	xCommandInfo.blockTimeMs = 0;
+	MQTTAgent_ProcessLoop(&self->xGlobalMqttAgentContext, &xCommandInfo);
+}
+
+/***
+ * Wifi join callback, link is up so retry without waiting out the delay
+ * @param arg - MQTTAgent
+ */
+void MQTTAgent::linkUpCB(void *arg){
+	MQTTAgent *self = (MQTTAgent *)arg;
+	self->wake();
+}
+
 
 
 /***
@@ -202,6 +284,7 @@ void MQTTAgent::start(UBaseType_t priority){
 			priority,
 			&xHandle
 		);
+		WifiHelper::setJoinCallback(MQTTAgent::linkUpCB, this);
 	}
 }
 
@@ -227,6 +310,8 @@ void MQTTAgent::start(UBaseType_t priority){
 
 		 switch(xConnState){
 		 case Offline: {
+			 // Nothing to do until asked to connect
+			 waitForEvent(portMAX_DELAY);
 			 break;
 		 }
 		 case TCPReq: {
@@ -234,7 +319,7 @@ void MQTTAgent::start(UBaseType_t priority){
 				 TCPconn();
 			 } else {
 				 LogInfo(("Network offline, awaiting reconnect"));
-				 vTaskDelay(MQTT_RECON_DELAY);
+				 backoffWait();
 			 }
 			 break;
 		 }
@@ -256,10 +341,19 @@ void MQTTAgent::start(UBaseType_t priority){
 		 }
 		 case MQTTConned: {
 			 setConnState(Online);
+			 xOnlineMs = Transport::getTime();
 			 pubToTopic(pOnlineTopic, ONLINEPAYLOAD, strlen(ONLINEPAYLOAD), 1, false);
-			 if (pRouter != NULL){
+			 xSubsPending = 0;
+			 //Broker kept our subscriptions, no need to ask again
+			 if ((pRouter != NULL) && !xSessionPresent){
+				 xSubStartMs = Transport::getTime();
+				 xSubAckPending = true;
 				 pRouter->subscribe(this);
 			 }
+			 if (xSubsPending == 0){
+				 markReady();
+			 }
+			 drainOffline();
 			 break;
 		 }
 		 case Online:{
@@ -267,6 +361,11 @@ void MQTTAgent::start(UBaseType_t priority){
 
 			 status = MQTTAgent_CommandLoop( &xGlobalMqttAgentContext );
 
+			 //Only a session that stayed up earns a fast retry
+			 if ((Transport::getTime() - xOnlineMs) >= MQTT_BACKOFF_STABLE_MS){
+				 xBackoff.reset();
+			 }
+
 			 // The function returns on either receiving a terminate command,
 			 // undergoing network disconnection OR encountering an error.
 			 if( ( status == MQTTSuccess ) && ( xGlobalMqttAgentContext.mqttContext.connectStatus == MQTTNotConnected ) )
@@ -302,7 +401,7 @@ void MQTTAgent::start(UBaseType_t priority){
 			 if (WifiHelper::isJoined()){
 				 xTcpTrans.transClose();
 			 }
-			 vTaskDelay(MQTT_RECON_DELAY);
+			 backoffWait();
 			 setConnState(TCPReq);
 			 break;
 		 }
@@ -311,9 +410,6 @@ void MQTTAgent::start(UBaseType_t priority){
 		 }
 
 		 };
-
-		 taskYIELD();
-		 //vTaskDelay(1);
 	 }
 
 
@@ -363,16 +459,15 @@ void MQTTAgent::connectCmdCallback( MQTTAgentCommandContext_t * pCmdCallbackCont
 MQTTStatus_t  MQTTAgent::MQTTconn(){
 	MQTTStatus_t xResult;
 	MQTTConnectInfo_t xConnectInfo;
-	bool xSessionPresent = false;
+	bool bSessionPresent = false;
 
 	/* Many fields not used in this demo so start with everything at 0. */
 	( void ) memset( ( void * ) &xConnectInfo, 0x00, sizeof( xConnectInfo ) );
 
-	/* Start with a clean session i.e. direct the MQTT broker to discard any
-	 * previous session data. Also, establishing a connection with clean
-	 * session will ensure that the broker does not store any data when this
-	 * client gets disconnected. */
-	xConnectInfo.cleanSession = true;
+	/* Clean session unless persistent session is requested. A persistent
+	 * session lets the broker keep subscriptions and undelivered QoS1
+	 * messages while we are away, so reconnect can skip resubscribing. */
+	xConnectInfo.cleanSession = !xPersistentSession;
 
 	/* The client identifier is used to uniquely identify this MQTT client to
 	 * the MQTT broker. In a production device the identifier can be something
@@ -401,14 +496,28 @@ MQTTStatus_t  MQTTAgent::MQTTconn(){
 	/* Send MQTT CONNECT packet to broker. LWT is not used in this demo, so it
 	 * is passed as NULL. */
 	LogDebug(("MQTT Connect \n"));
+	uint32_t start = Transport::getTime();
 	xResult = MQTT_Connect( &(xGlobalMqttAgentContext.mqttContext),
 							&xConnectInfo,
 							&xWillInfo,
 							30000U,
-							&xSessionPresent );
+							&bSessionPresent );
+	xConnStats.record(PhaseConnect, Transport::getTime() - start, (xResult == MQTTSuccess));
 
 	if (xResult != MQTTSuccess){
 		LogError(("MQTTConnect error %d", xResult));
+		return xResult;
+	}
+
+	xSessionPresent = xPersistentSession && bSessionPresent;
+	LogInfo(("MQTT session present %d", xSessionPresent));
+
+	/* Resend QoS1/2 publishes not acknowledged before the link dropped if
+	 * the broker kept our session, otherwise fail them back to their
+	 * callbacks so their slots are returned */
+	xResult = MQTTAgent_ResumeSession( &xGlobalMqttAgentContext, xSessionPresent );
+	if (xResult != MQTTSuccess){
+		LogError(("MQTT resume session error %d", xResult));
 	}
 	return xResult ;
 }
@@ -422,7 +531,10 @@ MQTTStatus_t  MQTTAgent::MQTTconn(){
  */
 bool MQTTAgent::TCPconn(){
 	LogDebug(("TCP Connect...."));
-	if (xTcpTrans.transConnect(pTarget, xPort)){
+	bool ok = xTcpTrans.transConnect(pTarget, xPort);
+	xConnStats.record(PhaseDNS, xTcpTrans.getDNSTimeMs(), xTcpTrans.isDNSOk());
+	xConnStats.record(PhaseTCP, xTcpTrans.getConnectTimeMs(), ok);
+	if (ok){
 		setConnState(TCPConned);
 		LogDebug(("TCP Connected"));
 		return true;
@@ -453,6 +565,7 @@ void MQTTAgent::stop(){
 		setConnState(Offline);
 	}
 	if (xHandle != NULL){
+		WifiHelper::setJoinCallback(NULL, NULL);
 		vTaskDelete(  xHandle );
 		xHandle = NULL;
 	}
@@ -465,6 +578,17 @@ void MQTTAgent::stop(){
 void MQTTAgent::setConnState(MQTTState s){
 	xConnState = s;
 
+	if ((s == TCPReq) && !xReadyPending){
+		xConnStartMs = Transport::getTime();
+		xReadyPending = true;
+		xFirstMsgPending = true;
+	}
+
+	//State changed from another task, so wake the state machine
+	if (xTaskGetCurrentTaskHandle() != xHandle){
+		wake();
+	}
+
 	if (pObserver != NULL){
 		switch(xConnState){
 		case Offline:{
@@ -505,7 +629,35 @@ unsigned int MQTTAgent::getStakHighWater(){
 }
 
 /***
- * Publish message to topic
+ * Number of publishes rejected because no slot was free
+ * @return count
+ */
+uint32_t MQTTAgent::getPublishSlotsExhausted(){
+	return xPublishPool.getExhausted();
+}
+
+/***
+ * Per phase timings of connection attempts
+ * @return stats object owned by the agent
+ */
+MQTTConnStats * MQTTAgent::getConnStats(){
+	return &xConnStats;
+}
+
+/***
+ * Block for the next backoff delay before a reconnect attempt
+ */
+void MQTTAgent::backoffWait(){
+	uint32_t ms = xBackoff.nextDelayMs();
+	LogInfo(("Reconnect attempt %lu in %lu ms",
+			(unsigned long)xBackoff.getAttempts(), (unsigned long)ms));
+	waitForEvent(pdMS_TO_TICKS(ms));
+}
+
+/***
+ * Publish message to topic. While not online, or while older messages
+ * are still queued, the message is held in the offline queue and sent
+ * in order once the connection is back
  * @param topic - zero terminated string. Copied by function
  * @param payload - payload as pointer to memory block
  * @param payloadLen - length of memory block
@@ -515,47 +667,65 @@ unsigned int MQTTAgent::getStakHighWater(){
 bool MQTTAgent::pubToTopic(const char * topic, const void * payload,
 	size_t payloadLen, const uint8_t QoS, bool retain){
 
+	//Keep order until messages queued while offline have been sent
+	if ((xConnState != Online) || !xOfflineQueue.isEmpty()){
+		if (!xOfflineQueue.push(topic, payload, payloadLen, QoS, retain)){
+			return false;
+		}
+		if (xConnState == Online){
+			requestDrain();
+		}
+		return true;
+	}
+	return publish(topic, payload, payloadLen, QoS, retain);
+}
+
+/***
+ * Hand the message to the MQTT Agent to publish now
+ * @param topic - zero terminated string. Copied by function
+ * @param payload - payload as pointer to memory block
+ * @param payloadLen - length of memory block
+ * @param QoS - quality of service - 0, 1 or 2
+ * @param retain - ask broker to retain message
+ * @return true if queued with the agent
+ */
+bool MQTTAgent::publish(const char * topic, const void * payload,
+	size_t payloadLen, const uint8_t QoS, bool retain){
+
 	MQTTStatus_t status;
 
-	// Fill command
+	MQTTQoS_t xQoS = toMQTTQoS(QoS);
+
+	// Fill command. QoS0 is fire and forget, the agent completes the
+	// command, releasing the slot, as soon as the packet is sent so the
+	// caller is never held waiting for the command queue
 	MQTTAgentCommandInfo_t xCommandInfo;
 	xCommandInfo.cmdCompleteCallback = MQTTAgent::publishCmdCompleteCb;
-	xCommandInfo.blockTimeMs = 500;
-
-	MQTTAgentCommandContext_t* pCmdCBContext = (MQTTAgentCommandContext_t*) pvPortMalloc(sizeof(MQTTAgentCommandContext_t));
-	if (pCmdCBContext == NULL){
-		LogError(("malloc failed"));
-		return false;
-	}
-
-	pCmdCBContext->topic = (char *)pvPortMalloc(strlen(topic)+1);
-	if (pCmdCBContext->topic == NULL){
-		LogError(("malloc failed"));
-		return false;
+	if (xQoS == MQTTQoS0){
+		xCommandInfo.blockTimeMs = MQTT_PUB_QOS0_BLOCK_MS;
+	} else {
+		xCommandInfo.blockTimeMs = 500;
 	}
-	strcpy(pCmdCBContext->topic,topic);
 
-	pCmdCBContext->payload = pvPortMalloc(payloadLen);
-	if (pCmdCBContext->payload == NULL){
-		LogError(("malloc failed"));
+	// Take a slot with topic and payload copied inline
+	MQTTPublishSlot_t * pSlot = xPublishPool.get(topic, payload, payloadLen, this);
+	if (pSlot == NULL){
+		LogError(("No publish slot available"));
 		return false;
 	}
-	memcpy(pCmdCBContext->payload, payload, payloadLen);
+	MQTTAgentCommandContext_t* pCmdCBContext = &pSlot->xContext;
 	xCommandInfo.pCmdCompleteCallbackContext = pCmdCBContext;
 
 
 	// Fill the information for publish operation.
 	MQTTPublishInfo_t * pPublishInfo = &(pCmdCBContext->publishInfo);
-	pPublishInfo->qos = MQTTQoS1;
-	pPublishInfo->pTopicName = pCmdCBContext->topic;
-	pPublishInfo->topicNameLength = strlen(pCmdCBContext->topic);
-	pPublishInfo->pPayload = pCmdCBContext->payload;
-	pPublishInfo->payloadLength = payloadLen;
+	pPublishInfo->qos = xQoS;
 	pPublishInfo->retain = retain;
 
 	status = MQTTAgent_Publish( &xGlobalMqttAgentContext, pPublishInfo, &xCommandInfo );
 	if (status != MQTTSuccess ){
 		LogError(("publish error %d", status));
+		xPublishPool.release(pSlot);
 		return false;
 	} else {
 		//LogInfo(("Publish Complete"));
@@ -575,84 +745,160 @@ bool MQTTAgent::pubToTopic(const char * topic, const void * payload,
 */
 void MQTTAgent::publishCmdCompleteCb( MQTTAgentCommandContext_t * pCmdCallbackContext,
             MQTTAgentReturnInfo_t * pReturnInfo ){
-	vPortFree(pCmdCallbackContext->topic);
-	vPortFree(pCmdCallbackContext->payload);
-	vPortFree(pCmdCallbackContext);
-}
+	MQTTPublishSlot_t * pSlot = MQTTPublishPool::fromContext(pCmdCallbackContext);
+	MQTTAgent * self = (MQTTAgent *) pSlot->pOwner;
+	xPublishPool.release(pSlot);
 
+	//Slot is free so keep the offline backlog moving
+	if (self != NULL){
+		self->drainOffline();
+	}
+}
 
 /***
- * Subscribe to a topic, mesg will be sent to router object
- * @param topic
- * @param QoS
- * @return
+ * Send messages held while offline, as far as free publish slots allow.
+ * Only called on the agent task, which is the queue consumer
  */
-bool MQTTAgent::subToTopic(const char * topic,  const uint8_t QoS){
-	MQTTStatus_t status = MQTTNoDataAvailable ;
-
-	// Fill the command information.
-	MQTTAgentCommandInfo_t subCommandInfo;
-	subCommandInfo.cmdCompleteCallback = MQTTAgent::subscribeCmdCompleteCb;
-	subCommandInfo.blockTimeMs = 500;
+void MQTTAgent::drainOffline(){
+	if (xConnState != Online){
+		return;
+	}
+	while (xPublishPool.getFree() > 0){
+		offline_entry_t * e = xOfflineQueue.front();
+		if (e == NULL){
+			return;
+		}
+		if (!e->superseded){
+			if (!publish(MQTTOfflineQueue::topic(e),
+					MQTTOfflineQueue::payload(e),
+					e->payloadLen,
+					e->QoS,
+					e->retain)){
+				return;
+			}
+		}
+		xOfflineQueue.pop();
+	}
+}
 
-	MQTTSubscribeInfo_t *pSubInfo = (MQTTSubscribeInfo_t*)
-		pvPortMalloc(sizeof(MQTTSubscribeInfo_t));
-	if (pSubInfo == NULL){
-		LogError(("malloc failed"));
-		return false;
-	};
-	MQTTAgentSubscribeArgs_t *pSubArgs = (MQTTAgentSubscribeArgs_t*)
-		pvPortMalloc(sizeof(MQTTAgentSubscribeArgs_t));
-	if (pSubArgs == NULL){
-		LogError(("malloc failed"));
-		return false;
-	};
+/***
+ * Ask the agent task to drain the offline queue
+ */
+void MQTTAgent::requestDrain(){
+	if (xDrainPending){
+		return;
+	}
+	xDrainPending = true;
 
-	MQTTAgentCommandContext_t* pCmdCBContext = (MQTTAgentCommandContext_t*) pvPortMalloc(sizeof(MQTTAgentCommandContext_t));
-	if (pCmdCBContext == NULL){
-		LogError(("malloc failed"));
-		return false;
+	MQTTAgentCommandInfo_t xCommandInfo;
+	memset(&xCommandInfo, 0, sizeof(xCommandInfo));
+	xCommandInfo.cmdCompleteCallback = MQTTAgent::drainCmdCompleteCb;
+	xCommandInfo.pCmdCompleteCallbackContext = &xDrainCmd.xContext;
+	xCommandInfo.blockTimeMs = 0;
+	if (MQTTAgent_ProcessLoop(&xGlobalMqttAgentContext, &xCommandInfo) != MQTTSuccess){
+		//Next publish complete will drain instead
+		xDrainPending = false;
 	}
-	pCmdCBContext->subArgs = pSubArgs;
-	subCommandInfo.pCmdCompleteCallbackContext = pCmdCBContext;
+}
 
+/***
+ * Call back function when a drain request runs on the agent task
+ * @param pCmdCallbackContext
+ * @param pReturnInfo
+ */
+void MQTTAgent::drainCmdCompleteCb( MQTTAgentCommandContext_t * pCmdCallbackContext,
+            MQTTAgentReturnInfo_t * pReturnInfo ){
+	static_assert(offsetof(MQTTDrainCmd_t, xContext) == 0,
+			"Context must be first member of drain command");
+	MQTTAgent * self = (MQTTAgent *) ((MQTTDrainCmd_t *) pCmdCallbackContext)->pOwner;
+	self->xDrainPending = false;
+	self->drainOffline();
+}
 
-	// Fill the information for topic filters to subscribe to.
+
+/***
+ * Map a numeric QoS level onto the coreMQTT enumeration
+ * @param QoS - 0, 1 or 2. Anything else is treated as 1
+ * @return
+ */
+MQTTQoS_t MQTTAgent::toMQTTQoS(uint8_t QoS){
 	switch(QoS){
 	case 0:{
-		pSubInfo->qos = MQTTQoS0;
-		break;
+		return MQTTQoS0;
 	}
 	case 1:{
-		pSubInfo->qos = MQTTQoS1;
-		break;
+		return MQTTQoS1;
 	}
 	case 2:{
-		pSubInfo->qos = MQTTQoS2;
-		break;
+		return MQTTQoS2;
 	}
 	default:{
-		pSubInfo->qos = MQTTQoS1;
-		break;
+		return MQTTQoS1;
 	}
 	}
-	pSubInfo->pTopicFilter = topic;
-	pSubInfo->topicFilterLength = strlen(topic);
-	pSubArgs->pSubscribeInfo = pSubInfo;
-	pSubArgs->numSubscriptions = 1U;
+}
 
-	status = MQTTAgent_Subscribe( &xGlobalMqttAgentContext, pSubArgs, &subCommandInfo );
-	if (status != MQTTSuccess){
-		LogError(("Sub error %d", status));
-		return false;
-	}
+/***
+ * Subscribe to a topic, mesg will be sent to router object
+ * @param topic
+ * @param QoS
+ * @return
+ */
+bool MQTTAgent::subToTopic(const char * topic,  const uint8_t QoS){
+	return subToTopics(&topic, &QoS, 1);
+}
 
-	if (pObserver != NULL){
-		pObserver->MQTTSend();
+/***
+ * Subscribe to a set of topics, packed MAXSUBS at a time into a
+ * single SUBSCRIBE packet using pooled static storage
+ * @param topics - array of zero terminated filters. Not copied so must remain valid
+ * @param QoS - array of QoS, one per topic
+ * @param count - number of topics
+ * @return true if all requests were made
+ */
+bool MQTTAgent::subToTopics(const char * const * topics, const uint8_t * QoS, size_t count){
+	MQTTStatus_t status = MQTTNoDataAvailable ;
+	size_t done = 0;
+
+	while (done < count){
+		MQTTSubscribeSlot_t * pSlot = xSubscribePool.get(500, this);
+		if (pSlot == NULL){
+			LogError(("No subscribe slot available"));
+			return false;
+		}
+
+		// Fill the information for topic filters to subscribe to.
+		MQTTAgentSubscribeArgs_t *pSubArgs = &pSlot->xArgs;
+		while ((done < count) && (pSubArgs->numSubscriptions < MAXSUBS)){
+			MQTTSubscribeInfo_t *pSubInfo = &pSlot->xInfo[pSubArgs->numSubscriptions];
+			pSubInfo->qos = toMQTTQoS(QoS[done]);
+			pSubInfo->pTopicFilter = topics[done];
+			pSubInfo->topicFilterLength = strlen(topics[done]);
+			pSubArgs->numSubscriptions++;
+			done++;
+		}
+
+		// Fill the command information.
+		MQTTAgentCommandInfo_t subCommandInfo;
+		subCommandInfo.cmdCompleteCallback = MQTTAgent::subscribeCmdCompleteCb;
+		subCommandInfo.blockTimeMs = 500;
+		subCommandInfo.pCmdCompleteCallbackContext = &pSlot->xContext;
+
+		xSubsPending++;
+		status = MQTTAgent_Subscribe( &xGlobalMqttAgentContext, pSubArgs, &subCommandInfo );
+		if (status != MQTTSuccess){
+			LogError(("Sub error %d", status));
+			xSubsPending--;
+			xSubscribePool.release(pSlot);
+			return false;
+		}
+
+		if (pObserver != NULL){
+			pObserver->MQTTSend();
+		}
 	}
 
 	return true;
-
 }
 
 /***
@@ -663,10 +909,86 @@ bool MQTTAgent::subToTopic(const char * topic,  const uint8_t QoS){
 void MQTTAgent::subscribeCmdCompleteCb( MQTTAgentCommandContext_t * pCmdCallbackContext,
 	                             MQTTAgentReturnInfo_t * pReturnInfo ){
 	//LogDebug(("Subscription complete\n"));
+	MQTTSubscribeSlot_t * pSlot = MQTTSubscribePool::fromContext(pCmdCallbackContext);
+	MQTTAgent * self = (MQTTAgent *) pSlot->pOwner;
+	xSubscribePool.release(pSlot);
+
+	if (self != NULL){
+		if (self->xSubAckPending){
+			self->xSubAckPending = false;
+			self->xConnStats.record(PhaseSubAck,
+					Transport::getTime() - self->xSubStartMs,
+					(pReturnInfo->returnCode == MQTTSuccess));
+		}
+		if (self->xSubsPending > 0){
+			self->xSubsPending--;
+		}
+		if (self->xSubsPending == 0){
+			self->markReady();
+		}
+	}
+}
+
+/***
+ * All subscriptions acknowledged, record time taken to be ready
+ * and publish the connection stats on the lifecycle topic
+ */
+void MQTTAgent::markReady(){
+	if (xReadyPending){
+		xReadyPending = false;
+		xReadyMs = Transport::getTime() - xConnStartMs;
+		LogInfo(("MQTT ready %u ms after connect request", xReadyMs));
+
+		if (pConnTopic != NULL){
+			static_assert(MQTT_CONN_STATS_JSON_LEN >= MQTT_CONN_STATS_JSON_MAX,
+					"Connection stats JSON buffer too small");
+			char json[MQTT_CONN_STATS_JSON_LEN];
+			size_t len = xConnStats.toJSON(json, sizeof(json), xBackoff.getLastDelayMs());
+			if (len > 0){
+				publish(pConnTopic, json, len, 0, false);
+			} else {
+				LogError(("Connection stats do not fit %lu bytes",
+						(unsigned long)sizeof(json)));
+			}
+		}
+	}
+}
 
-	vPortFree(pCmdCallbackContext->subArgs->pSubscribeInfo);
-	vPortFree(pCmdCallbackContext->subArgs);
-	vPortFree(pCmdCallbackContext);
+/***
+ * Time taken by the last connection from TCP request until all
+ * subscriptions were acknowledged
+ * @return milliseconds
+ */
+uint32_t MQTTAgent::getReadyTimeMs(){
+	return xReadyMs;
+}
+
+
+/***
+ * Time taken by the last connection from TCP request until the
+ * first message arrived from the broker
+ * @return milliseconds
+ */
+uint32_t MQTTAgent::getFirstMessageTimeMs(){
+	return xFirstMsgMs;
+}
+
+/***
+ * Request a persistent session on the next connect. Broker keeps
+ * subscriptions and QoS1 messages while offline so reconnect
+ * skips resubscribing. Client id must be stable across restarts
+ * @param persistent - true for persistent, false for clean session
+ */
+void MQTTAgent::setPersistentSession(bool persistent){
+	xPersistentSession = persistent;
+}
+
+/***
+ * Did the broker resume an existing session on the last connect
+ * @return true if session was present
+ */
+bool MQTTAgent::isSessionPresent(){
+	return xSessionPresent;
 }
 
 
@@ -701,6 +1023,11 @@ void MQTTAgent::setRouter( MQTTRouter *pRouter) {
 * @param payloadLen - payload length
 */
 void MQTTAgent::route(const char * topic, size_t topicLen, const void * payload, size_t payloadLen){
+	if (xFirstMsgPending){
+		xFirstMsgPending = false;
+		xFirstMsgMs = Transport::getTime() - xConnStartMs;
+		LogInfo(("MQTT first message %u ms after connect request", xFirstMsgMs));
+	}
 	if (pRouter != NULL){
 		pRouter->route(topic, topicLen, payload, payloadLen, this);
 	}
@@ -19,6 +19,11 @@
 #include "MQTTAgentObserver.h"
 #include "MQTTInterface.h"
 #include "MQTTRouter.h"
+#include "MQTTPublishPool.h"
+#include "MQTTSubscribePool.h"
+#include "MQTTOfflineQueue.h"
+#include "MQTTBackoff.h"
+#include "MQTTConnStats.h"
 
 extern "C" {
 #include "freertos_agent_message.h"
@@ -37,10 +42,27 @@ extern "C" {
 #define MQTTKEEPALIVETIME 10
 #endif
 
-#ifndef MQTT_RECON_DELAY
-#define MQTT_RECON_DELAY 10
+#ifndef MQTT_CONN_STATS_JSON_LEN
+#define MQTT_CONN_STATS_JSON_LEN MQTT_CONN_STATS_JSON_MAX
 #endif
 
+#ifndef MQTT_PERSISTENT_SESSION
+#define MQTT_PERSISTENT_SESSION false //Clean session on each connect
+#endif
+
+#ifndef MQTT_PUB_QOS0_BLOCK_MS
+#define MQTT_PUB_QOS0_BLOCK_MS 0 //QoS0 publish does not wait on a full command queue
+#endif
+
+
+/***
+ * Command to drain the offline queue on the agent task. Context must be
+ * first member so the command complete callback can recover the agent.
+ */
+typedef struct {
+	MQTTAgentCommandContext_t 	xContext;
+	void * 						pOwner;
+} MQTTDrainCmd_t;
 
 // Enumerator used to control the state machine at centre of agent
 enum MQTTState {  Offline, TCPReq, TCPConned, MQTTReq, MQTTConned, MQTTRecon, Online};
@@ -119,7 +141,10 @@ public:
 	virtual unsigned int getStakHighWater();
 
 	/***
-	 * Publish message to topic
+	 * Publish message to topic. While not online, or while older messages
+	 * are still queued, the message is held in the offline queue and sent
+	 * in order once the connection is back.
+	 * Offline queue is single producer so only one task should publish
 	 * @param topic - zero terminated string. Copied by function
 	 * @param payload - payload as pointer to memory block
 	 * @param payloadLen - length of memory block
@@ -137,6 +162,62 @@ public:
 	 */
 	virtual bool subToTopic(const char * topic, const uint8_t QoS=0);
 
+	/***
+	 * Subscribe to a set of topics, packed MAXSUBS at a time into a
+	 * single SUBSCRIBE packet using pooled static storage
+	 * @param topics - array of zero terminated filters. Not copied so must remain valid
+	 * @param QoS - array of QoS, one per topic
+	 * @param count - number of topics
+	 * @return true if all requests were made
+	 */
+	virtual bool subToTopics(const char * const * topics, const uint8_t * QoS, size_t count);
+
+	/***
+	 * Time taken by the last connection from TCP request until all
+	 * subscriptions were acknowledged
+	 * @return milliseconds
+	 */
+	uint32_t getReadyTimeMs();
+
+	/***
+	 * Time taken by the last connection from TCP request until the
+	 * first message arrived from the broker
+	 * @return milliseconds
+	 */
+	uint32_t getFirstMessageTimeMs();
+
+	/***
+	 * Request a persistent session on the next connect. Broker keeps
+	 * subscriptions and QoS1 messages while offline so reconnect
+	 * skips resubscribing. Client id must be stable across restarts
+	 * @param persistent - true for persistent, false for clean session
+	 */
+	void setPersistentSession(bool persistent);
+
+	/***
+	 * Did the broker resume an existing session on the last connect
+	 * @return true if session was present
+	 */
+	bool isSessionPresent();
+
+	/***
+	 * Number of publishes rejected because no slot was free
+	 * @return count
+	 */
+	uint32_t getPublishSlotsExhausted();
+
+	/***
+	 * Per phase timings of connection attempts
+	 * @return stats object owned by the agent
+	 */
+	MQTTConnStats * getConnStats();
+
+	/***
+	 * Wake the state machine so it re-evaluates its state.
+	 * Agent task blocks whenever there is nothing to do
+	 */
+	void wake();
+
 	/***
 	 * Get the router object handling all received messages
 	 * @return
@@ -213,6 +294,75 @@ private:
 	 */
 	void run();
 
+	/***
+	 * Block the agent task until woken or timeout
+	 * @param ticks - max time to wait
+	 * @return true if woken before timeout
+	 */
+	bool waitForEvent(TickType_t ticks);
+
+	/***
+	 * Hand the message to the MQTT Agent to publish now
+	 * @param topic - zero terminated string. Copied by function
+	 * @param payload - payload as pointer to memory block
+	 * @param payloadLen - length of memory block
+	 * @param QoS - quality of service - 0, 1 or 2
+	 * @param retain - ask broker to retain message
+	 * @return true if queued with the agent
+	 */
+	bool publish(const char * topic, const void * payload,
+			size_t payloadLen, const uint8_t QoS, bool retain);
+
+	/***
+	 * Send messages held while offline, as far as free publish slots allow.
+	 * Only called on the agent task, which is the queue consumer
+	 */
+	void drainOffline();
+
+	/***
+	 * Ask the agent task to drain the offline queue
+	 */
+	void requestDrain();
+
+	/***
+	 * Call back function when a drain request runs on the agent task
+	 * @param pCmdCallbackContext
+	 * @param pReturnInfo
+	 */
+	static void drainCmdCompleteCb( MQTTAgentCommandContext_t * pCmdCallbackContext,
+            MQTTAgentReturnInfo_t * pReturnInfo );
+
+	/***
+	 * All subscriptions acknowledged, record time taken to be ready
+	 * and publish the connection stats on the lifecycle topic
+	 */
+	void markReady();
+
+	/***
+	 * Block for the next backoff delay before a reconnect attempt
+	 */
+	void backoffWait();
+
+	/***
+	 * Wifi join callback, link is up so retry without waiting out the delay
+	 * @param arg - MQTTAgent
+	 */
+	static void linkUpCB(void *arg);
+
+	/***
+	 * Socket has data, wake the command loop to process it rather than
+	 * having it poll the socket
+	 * @param arg - MQTTAgent
+	 */
+	static void socketDataCB(void *arg);
+
+	/***
+	 * Map a numeric QoS level onto the coreMQTT enumeration
+	 * @param QoS - 0, 1 or 2. Anything else is treated as 1
+	 * @return
+	 */
+	static MQTTQoS_t toMQTTQoS(uint8_t QoS);
+
 	/***
 	 * Connect to MQTT hub
 	 * @return
@@ -252,6 +402,35 @@ private:
 	//Topics and payload for connection
 	static const char * ONLINEPAYLOAD;
 	char *pOnlineTopic = NULL;
+	char *pConnTopic = NULL;
+
+	//Publish and subscribe slots, static as agent object may live on a task stack
+	static MQTTPublishPool xPublishPool;
+	static MQTTSubscribePool xSubscribePool;
+
+	//Publishes made while not online
+	static MQTTOfflineQueue xOfflineQueue;
+	MQTTDrainCmd_t xDrainCmd;
+	volatile bool xDrainPending = false;
+
+	//Reconnect to ready timing
+	volatile uint32_t xSubsPending = 0;
+	bool xReadyPending = false;
+	uint32_t xConnStartMs = 0;
+	uint32_t xReadyMs = 0;
+	bool xFirstMsgPending = false;
+	uint32_t xFirstMsgMs = 0;
+
+	//Reconnect pacing and per phase telemetry
+	MQTTBackoff xBackoff;
+	MQTTConnStats xConnStats;
+	uint32_t xOnlineMs = 0;
+	uint32_t xSubStartMs = 0;
+	bool xSubAckPending = false;
+
+	//Session handling
+	bool xPersistentSession = MQTT_PERSISTENT_SESSION;
+	bool xSessionPresent = false;
 
 	//Router object to handle all sub messages
 	MQTTRouter * pRouter = NULL;
@@ -0,0 +1,91 @@
+/*
+ * MQTTBackoff.cpp
+ *
+ * Reconnect delay engine. Exponential growth from a base delay up to a
+ * cap with full jitter, so a fleet of devices losing the same broker do
+ * not all retry in lockstep. Reset once a session has proved stable.
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#include "MQTTBackoff.h"
+
+/***
+ * Constructor
+ * @param baseMs - delay ceiling for the first retry
+ * @param capMs - maximum delay ceiling
+ */
+MQTTBackoff::MQTTBackoff(uint32_t baseMs, uint32_t capMs) {
+	xBaseMs = baseMs;
+	xCapMs = capMs;
+}
+
+/***
+ * Destructor
+ */
+MQTTBackoff::~MQTTBackoff() {
+	// NOP
+}
+
+/***
+ * Seed the jitter generator. Use something unique to the device
+ * so devices that boot together still spread their retries
+ * @param seed
+ */
+void MQTTBackoff::seed(uint32_t seed){
+	//xorshift must never hold zero
+	xRand = (seed != 0) ? seed : 0x9E3779B9;
+}
+
+/***
+ * xorshift32 step
+ * @return next pseudo random number
+ */
+uint32_t MQTTBackoff::rand32(){
+	xRand ^= xRand << 13;
+	xRand ^= xRand >> 17;
+	xRand ^= xRand << 5;
+	return xRand;
+}
+
+/***
+ * Delay before the next attempt. Random between zero and
+ * min(cap, base * 2^attempts), then attempts is increased
+ * @return milliseconds
+ */
+uint32_t MQTTBackoff::nextDelayMs(){
+	uint32_t ceiling = xBaseMs;
+	for (uint32_t i = 0; (i < xAttempts) && (ceiling < xCapMs); i++){
+		ceiling = ceiling * 2;
+	}
+	if (ceiling > xCapMs){
+		ceiling = xCapMs;
+	}
+
+	xLastDelayMs = rand32() % (ceiling + 1);
+	xAttempts++;
+	return xLastDelayMs;
+}
+
+/***
+ * Back to the base delay
+ */
+void MQTTBackoff::reset(){
+	xAttempts = 0;
+}
+
+/***
+ * Number of delays handed out since the last reset
+ * @return
+ */
+uint32_t MQTTBackoff::getAttempts(){
+	return xAttempts;
+}
+
+/***
+ * Last delay handed out
+ * @return milliseconds
+ */
+uint32_t MQTTBackoff::getLastDelayMs(){
+	return xLastDelayMs;
+}
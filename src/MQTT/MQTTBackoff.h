@@ -0,0 +1,89 @@
+/*
+ * MQTTBackoff.h
+ *
+ * Reconnect delay engine. Exponential growth from a base delay up to a
+ * cap with full jitter, so a fleet of devices losing the same broker do
+ * not all retry in lockstep. Reset once a session has proved stable.
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#ifndef MQTTBACKOFF_H_
+#define MQTTBACKOFF_H_
+
+#include <stdint.h>
+
+#ifndef MQTT_BACKOFF_BASE_MS
+#define MQTT_BACKOFF_BASE_MS 1000
+#endif
+
+#ifndef MQTT_BACKOFF_CAP_MS
+#define MQTT_BACKOFF_CAP_MS 60000
+#endif
+
+//Session must stay up this long before backoff is reset
+#ifndef MQTT_BACKOFF_STABLE_MS
+#define MQTT_BACKOFF_STABLE_MS 30000
+#endif
+
+class MQTTBackoff {
+public:
+	/***
+	 * Constructor
+	 * @param baseMs - delay ceiling for the first retry
+	 * @param capMs - maximum delay ceiling
+	 */
+	MQTTBackoff(uint32_t baseMs = MQTT_BACKOFF_BASE_MS,
+			uint32_t capMs = MQTT_BACKOFF_CAP_MS);
+
+	/***
+	 * Destructor
+	 */
+	virtual ~MQTTBackoff();
+
+	/***
+	 * Seed the jitter generator. Use something unique to the device
+	 * so devices that boot together still spread their retries
+	 * @param seed
+	 */
+	void seed(uint32_t seed);
+
+	/***
+	 * Delay before the next attempt. Random between zero and
+	 * min(cap, base * 2^attempts), then attempts is increased
+	 * @return milliseconds
+	 */
+	uint32_t nextDelayMs();
+
+	/***
+	 * Back to the base delay
+	 */
+	void reset();
+
+	/***
+	 * Number of delays handed out since the last reset
+	 * @return
+	 */
+	uint32_t getAttempts();
+
+	/***
+	 * Last delay handed out
+	 * @return milliseconds
+	 */
+	uint32_t getLastDelayMs();
+
+private:
+	/***
+	 * xorshift32 step
+	 * @return next pseudo random number
+	 */
+	uint32_t rand32();
+
+	uint32_t xBaseMs;
+	uint32_t xCapMs;
+	uint32_t xAttempts = 0;
+	uint32_t xLastDelayMs = 0;
+	uint32_t xRand = 0x9E3779B9;
+};
+
+#endif /* MQTTBACKOFF_H_ */
@@ -0,0 +1,139 @@
+/*
+ * MQTTConnStats.cpp
+ *
+ * Per phase connection telemetry: DNS lookup, TCP connect, MQTT CONNECT
+ * and first SUBACK. Keeps counts, failures, last duration and a coarse
+ * histogram for each so reconnect time can be attributed to a phase.
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#include "MQTTConnStats.h"
+#include "DNSCache.h"
+#include <string.h>
+#include <stdio.h>
+
+static const uint32_t BUCKET_LIMITS[MQTT_CONN_STATS_BUCKETS - 1] = {
+		50, 100, 250, 500, 1000, 2500, 5000, 10000
+};
+
+static const char * PHASE_NAMES[PhaseCount] = {
+		"dns", "tcp", "connect", "suback"
+};
+
+/***
+ * Constructor
+ */
+MQTTConnStats::MQTTConnStats() {
+	memset(xPhases, 0, sizeof(xPhases));
+}
+
+/***
+ * Destructor
+ */
+MQTTConnStats::~MQTTConnStats() {
+	// NOP
+}
+
+/***
+ * Record one attempt at a phase
+ * @param phase
+ * @param ms - time the phase took
+ * @param ok - false if the phase failed
+ */
+void MQTTConnStats::record(MQTTConnPhase phase, uint32_t ms, bool ok){
+	if (phase >= PhaseCount){
+		return;
+	}
+	conn_phase_stats_t *p = &xPhases[phase];
+	p->count++;
+	if (!ok){
+		p->failures++;
+	}
+	p->lastMs = ms;
+	if (ms > p->maxMs){
+		p->maxMs = ms;
+	}
+
+	unsigned int b = 0;
+	while ((b < (MQTT_CONN_STATS_BUCKETS - 1)) && (ms >= BUCKET_LIMITS[b])){
+		b++;
+	}
+	p->hist[b]++;
+}
+
+/***
+ * Stats for a phase
+ * @param phase
+ * @return
+ */
+const conn_phase_stats_t * MQTTConnStats::get(MQTTConnPhase phase){
+	if (phase >= PhaseCount){
+		return NULL;
+	}
+	return &xPhases[phase];
+}
+
+/***
+ * Write stats as a JSON object
+ * @param buf - destination
+ * @param len - size of destination
+ * @param backoffMs - last reconnect delay, included for context
+ * @return length written, 0 if buffer too small
+ */
+size_t MQTTConnStats::toJSON(char * buf, size_t len, uint32_t backoffMs){
+	size_t used = 0;
+	int n;
+
+	n = snprintf(buf, len, "{\"backoff\":%lu", (unsigned long)backoffMs);
+	if ((n < 0) || ((size_t)n >= len)){
+		return 0;
+	}
+	used = n;
+
+	for (unsigned int i = 0; i < PhaseCount; i++){
+		conn_phase_stats_t *p = &xPhases[i];
+		n = snprintf(&buf[used], len - used,
+				",\"%s\":{\"n\":%lu,\"fail\":%lu,\"last\":%lu,\"max\":%lu,\"hist\":[",
+				PHASE_NAMES[i],
+				(unsigned long)p->count,
+				(unsigned long)p->failures,
+				(unsigned long)p->lastMs,
+				(unsigned long)p->maxMs);
+		if ((n < 0) || ((size_t)n >= (len - used))){
+			return 0;
+		}
+		used += n;
+
+		for (unsigned int b = 0; b < MQTT_CONN_STATS_BUCKETS; b++){
+			n = snprintf(&buf[used], len - used, (b == 0) ? "%lu" : ",%lu",
+					(unsigned long)p->hist[b]);
+			if ((n < 0) || ((size_t)n >= (len - used))){
+				return 0;
+			}
+			used += n;
+		}
+
+		n = snprintf(&buf[used], len - used, "]}");
+		if ((n < 0) || ((size_t)n >= (len - used))){
+			return 0;
+		}
+		used += n;
+	}
+
+	//Shared resolver, shows whether reconnects waited on DNS
+	DNSCache *dns = DNSCache::getInstance();
+	n = snprintf(&buf[used], len - used,
+			",\"dnsCache\":{\"hit\":%lu,\"miss\":%lu,\"neg\":%lu,\"refresh\":%lu,\"last\":%lu,\"max\":%lu}}",
+			(unsigned long)dns->getHits(),
+			(unsigned long)dns->getMisses(),
+			(unsigned long)dns->getNegativeHits(),
+			(unsigned long)dns->getRefreshes(),
+			(unsigned long)dns->getLastLookupMs(),
+			(unsigned long)dns->getMaxLookupMs());
+	if ((n < 0) || ((size_t)n >= (len - used))){
+		return 0;
+	}
+	used += n;
+	return used;
+}
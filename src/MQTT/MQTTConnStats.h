@@ -0,0 +1,85 @@
+/*
+ * MQTTConnStats.h
+ *
+ * Per phase connection telemetry: DNS lookup, TCP connect, MQTT CONNECT
+ * and first SUBACK. Keeps counts, failures, last duration and a coarse
+ * histogram for each so reconnect time can be attributed to a phase.
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#ifndef MQTTCONNSTATS_H_
+#define MQTTCONNSTATS_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+//Buckets are < 50, 100, 250, 500, 1000, 2500, 5000, 10000 ms and above
+#define MQTT_CONN_STATS_BUCKETS 9
+
+enum MQTTConnPhase { PhaseDNS, PhaseTCP, PhaseConnect, PhaseSubAck, PhaseCount };
+
+//Longest JSON from toJSON, with every counter at its 10 digit maximum
+#define MQTT_CONN_STATS_U32_LEN 10
+#define MQTT_CONN_STATS_NAME_LEN 7 //Longest phase name, "connect"
+#define MQTT_CONN_STATS_PHASE_LEN \
+	(sizeof(",\"\":{\"n\":,\"fail\":,\"last\":,\"max\":,\"hist\":[]}") - 1 + \
+	MQTT_CONN_STATS_NAME_LEN + (MQTT_CONN_STATS_BUCKETS - 1) + \
+	(4 + MQTT_CONN_STATS_BUCKETS) * MQTT_CONN_STATS_U32_LEN)
+#define MQTT_CONN_STATS_DNS_LEN \
+	(sizeof(",\"dnsCache\":{\"hit\":,\"miss\":,\"neg\":,\"refresh\":,\"last\":,\"max\":}}") - 1 + \
+	6 * MQTT_CONN_STATS_U32_LEN)
+#define MQTT_CONN_STATS_JSON_MAX \
+	(sizeof("{\"backoff\":") - 1 + MQTT_CONN_STATS_U32_LEN + \
+	PhaseCount * MQTT_CONN_STATS_PHASE_LEN + MQTT_CONN_STATS_DNS_LEN + 1)
+
+typedef struct {
+	uint32_t count;
+	uint32_t failures;
+	uint32_t lastMs;
+	uint32_t maxMs;
+	uint32_t hist[MQTT_CONN_STATS_BUCKETS];
+} conn_phase_stats_t;
+
+class MQTTConnStats {
+public:
+	/***
+	 * Constructor
+	 */
+	MQTTConnStats();
+
+	/***
+	 * Destructor
+	 */
+	virtual ~MQTTConnStats();
+
+	/***
+	 * Record one attempt at a phase
+	 * @param phase
+	 * @param ms - time the phase took
+	 * @param ok - false if the phase failed
+	 */
+	void record(MQTTConnPhase phase, uint32_t ms, bool ok = true);
+
+	/***
+	 * Stats for a phase
+	 * @param phase
+	 * @return
+	 */
+	const conn_phase_stats_t * get(MQTTConnPhase phase);
+
+	/***
+	 * Write stats as a JSON object
+	 * @param buf - destination
+	 * @param len - size of destination
+	 * @param backoffMs - last reconnect delay, included for context.
+	 * Counters of the shared DNS cache are appended
+	 * @return length written, 0 if buffer too small
+	 */
+	size_t toJSON(char * buf, size_t len, uint32_t backoffMs);
+
+private:
+	conn_phase_stats_t xPhases[PhaseCount];
+};
+
+#endif /* MQTTCONNSTATS_H_ */
@@ -16,3 +16,20 @@ MQTTInterface::~MQTTInterface() {
 	// TODO Auto-generated destructor stub
 }
 
+/***
+ * Subscribe to a set of topics. Default makes one request per topic,
+ * implementations may pack them into fewer SUBSCRIBE packets
+ * @param topics - array of zero terminated filters. Not copied so must remain valid
+ * @param QoS - array of QoS, one per topic
+ * @param count - number of topics
+ * @return true if all requests were made
+ */
+bool MQTTInterface::subToTopics(const char * const * topics, const uint8_t * QoS, size_t count){
+	bool res = true;
+	for (size_t i=0; i < count; i++){
+		if (!subToTopic(topics[i], QoS[i])){
+			res = false;
+		}
+	}
+	return res;
+}
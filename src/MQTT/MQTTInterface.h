@@ -48,6 +48,16 @@ public:
 	 */
 	virtual bool subToTopic(const char * topic, const uint8_t QoS=0)=0;
 
+	/***
+	 * Subscribe to a set of topics. Default makes one request per topic,
+	 * implementations may pack them into fewer SUBSCRIBE packets
+	 * @param topics - array of zero terminated filters. Not copied so must remain valid
+	 * @param QoS - array of QoS, one per topic
+	 * @param count - number of topics
+	 * @return true if all requests were made
+	 */
+	virtual bool subToTopics(const char * const * topics, const uint8_t * QoS, size_t count);
+
 
 };
 
@@ -0,0 +1,273 @@
+/*
+ * MQTTOfflineQueue.cpp
+ *
+ * Bounded store and forward queue for publishes made while the MQTT
+ * connection is down. RAM ring is lock free single producer, single
+ * consumer so the publishing task never blocks. When the ring is full
+ * messages spill into NVS under their own keys and survive a reboot.
+ * A retained publish supersedes any queued retained publish to the same topic.
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#include "MQTTOfflineQueue.h"
+#include "NVSOnboard.h"
+#include <string.h>
+#include <stdio.h>
+#include <stddef.h>
+
+#define OFFLINE_HEADER_LEN offsetof(offline_entry_t, data)
+
+/***
+ * Constructor
+ */
+MQTTOfflineQueue::MQTTOfflineQueue() {
+	// NOP
+}
+
+/***
+ * Destructor
+ */
+MQTTOfflineQueue::~MQTTOfflineQueue() {
+	// NOP
+}
+
+/***
+ * Pick up any messages spilled to NVS before a restart
+ */
+void MQTTOfflineQueue::init(){
+	NVSOnboard *nvs = NVSOnboard::getInstance();
+	uint32_t head = 0;
+	uint32_t tail = 0;
+
+	//Tail is only written once a spilled message has been sent
+	if (nvs->get_u32(MQTT_OFFLINE_NVS_HEAD, &head) == NVS_OK){
+		nvs->get_u32(MQTT_OFFLINE_NVS_TAIL, &tail);
+		xSpillHead.store(head);
+		xSpillTail.store(tail);
+		if (head != tail){
+			LogInfo(("%lu offline messages in NVS", (unsigned long)(head - tail)));
+		}
+	}
+}
+
+/***
+ * Fill an entry
+ * @return false if message does not fit an entry
+ */
+bool MQTTOfflineQueue::fill(offline_entry_t * e, const char * topic,
+		const void * payload, size_t payloadLen, uint8_t QoS, bool retain){
+	size_t topicLen = strlen(topic);
+	if ((topicLen + 1 + payloadLen) > MQTT_OFFLINE_ENTRY_SIZE){
+		return false;
+	}
+	e->topicLen = topicLen;
+	e->payloadLen = payloadLen;
+	e->QoS = QoS;
+	e->retain = retain;
+	e->superseded = false;
+	memcpy(e->data, topic, topicLen + 1);
+	memcpy(&e->data[topicLen + 1], payload, payloadLen);
+	return true;
+}
+
+/***
+ * Queue a publish. Producer side, must only be called from one task
+ * @param topic - zero terminated string. Copied
+ * @param payload - payload memory block. Copied
+ * @param payloadLen - length of payload
+ * @param QoS - 0, 1 or 2
+ * @param retain - retained message, supersedes queued ones on same topic
+ * @return false if message dropped
+ */
+bool MQTTOfflineQueue::push(const char * topic, const void * payload,
+		size_t payloadLen, uint8_t QoS, bool retain){
+	uint32_t head = xHead.load(std::memory_order_relaxed);
+	uint32_t tail = xTail.load(std::memory_order_acquire);
+
+	//Only the newest retained value of a topic is worth sending
+	if (retain){
+		for (uint32_t i = tail; i != head; i++){
+			offline_entry_t * e = &xRing[i % MQTT_OFFLINE_SLOTS];
+			if (e->retain && !e->superseded && (strcmp(topic, (const char *)e->data) == 0)){
+				e->superseded = true;
+				xCoalesced++;
+			}
+		}
+	}
+
+	//Once spilling keep spilling so order is kept
+	bool spilling = (xSpillHead.load(std::memory_order_relaxed) !=
+			xSpillTail.load(std::memory_order_acquire));
+	if (spilling || ((head - tail) >= MQTT_OFFLINE_SLOTS)){
+		return spill(topic, payload, payloadLen, QoS, retain);
+	}
+
+	if (!fill(&xRing[head % MQTT_OFFLINE_SLOTS], topic, payload, payloadLen, QoS, retain)){
+		LogError(("Offline message too large for queue"));
+		xDropped++;
+		return false;
+	}
+	xHead.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+/***
+ * Write message to NVS as the ring is full
+ * @return false if dropped
+ */
+bool MQTTOfflineQueue::spill(const char * topic, const void * payload,
+		size_t payloadLen, uint8_t QoS, bool retain){
+	uint32_t head = xSpillHead.load(std::memory_order_relaxed);
+	uint32_t tail = xSpillTail.load(std::memory_order_acquire);
+	offline_entry_t e;
+	char key[NVS_MAX_KEY_LEN];
+
+	if ((head - tail) >= MQTT_OFFLINE_SPILL_MAX){
+		xDropped++;
+		return false;
+	}
+	if (!fill(&e, topic, payload, payloadLen, QoS, retain)){
+		LogError(("Offline message too large for queue"));
+		xDropped++;
+		return false;
+	}
+
+	NVSOnboard *nvs = NVSOnboard::getInstance();
+	sprintf(key, MQTT_OFFLINE_NVS_KEY, (unsigned long)head);
+	if (nvs->set_blob(key, &e, OFFLINE_HEADER_LEN + e.topicLen + 1 + e.payloadLen) != NVS_OK){
+		xDropped++;
+		return false;
+	}
+	//Consumer owns the tail in NVS as well
+	nvs->set_u32(MQTT_OFFLINE_NVS_HEAD, head + 1);
+	nvs->commit();
+
+	xSpilled++;
+	xSpillHead.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+/***
+ * Load the oldest spilled message into the scratch entry
+ * @return true if loaded
+ */
+bool MQTTOfflineQueue::loadSpill(){
+	uint32_t tail = xSpillTail.load(std::memory_order_relaxed);
+	char key[NVS_MAX_KEY_LEN];
+	size_t len = sizeof(xSpillEntry);
+
+	NVSOnboard *nvs = NVSOnboard::getInstance();
+	sprintf(key, MQTT_OFFLINE_NVS_KEY, (unsigned long)tail);
+	if (nvs->get_blob(key, &xSpillEntry, &len) != NVS_OK){
+		LogError(("Spilled message %s missing", key));
+		return false;
+	}
+	xSpillEntry.superseded = false;
+	xSpillLoaded = true;
+	return true;
+}
+
+/***
+ * Oldest message waiting. Consumer side
+ * @return entry, or NULL if queue is empty
+ */
+offline_entry_t * MQTTOfflineQueue::front(){
+	uint32_t tail = xTail.load(std::memory_order_relaxed);
+	uint32_t head = xHead.load(std::memory_order_acquire);
+
+	//Ring holds the oldest messages, spill follows
+	if (tail != head){
+		xFrontIsSpill = false;
+		return &xRing[tail % MQTT_OFFLINE_SLOTS];
+	}
+
+	while (xSpillTail.load(std::memory_order_relaxed) !=
+			xSpillHead.load(std::memory_order_acquire)){
+		xFrontIsSpill = true;
+		if (xSpillLoaded || loadSpill()){
+			return &xSpillEntry;
+		}
+		//Lost record, skip it
+		pop();
+	}
+	return NULL;
+}
+
+/***
+ * Remove the message returned by front. Consumer side
+ */
+void MQTTOfflineQueue::pop(){
+	if (!xFrontIsSpill){
+		xTail.store(xTail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		return;
+	}
+
+	uint32_t tail = xSpillTail.load(std::memory_order_relaxed);
+	char key[NVS_MAX_KEY_LEN];
+	NVSOnboard *nvs = NVSOnboard::getInstance();
+
+	sprintf(key, MQTT_OFFLINE_NVS_KEY, (unsigned long)tail);
+	nvs->erase_key(key);
+	tail++;
+	nvs->set_u32(MQTT_OFFLINE_NVS_TAIL, tail);
+	xSpillLoaded = false;
+	xFrontIsSpill = false;
+	xSpillTail.store(tail, std::memory_order_release);
+
+	//Write back once the spill is drained
+	if (tail == xSpillHead.load(std::memory_order_acquire)){
+		nvs->commit();
+	}
+}
+
+/***
+ * Is there anything to send
+ * @return true if empty
+ */
+bool MQTTOfflineQueue::isEmpty(){
+	return (xTail.load() == xHead.load()) &&
+			(xSpillTail.load() == xSpillHead.load());
+}
+
+/***
+ * Topic of an entry
+ * @param e - entry
+ * @return zero terminated topic
+ */
+const char * MQTTOfflineQueue::topic(offline_entry_t * e){
+	return (const char *) e->data;
+}
+
+/***
+ * Payload of an entry
+ * @param e - entry
+ * @return payload memory
+ */
+const void * MQTTOfflineQueue::payload(offline_entry_t * e){
+	return &e->data[e->topicLen + 1];
+}
+
+/***
+ * Number of messages dropped as queue and spill were full
+ * @return
+ */
+uint32_t MQTTOfflineQueue::getDropped(){
+	return xDropped;
+}
+
+/***
+ * Number of retained messages superseded before being sent
+ * @return
+ */
+uint32_t MQTTOfflineQueue::getCoalesced(){
+	return xCoalesced;
+}
+
+/***
+ * Number of messages written to NVS
+ * @return
+ */
+uint32_t MQTTOfflineQueue::getSpilled(){
+	return xSpilled;
+}
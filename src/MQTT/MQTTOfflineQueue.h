@@ -0,0 +1,167 @@
+/*
+ * MQTTOfflineQueue.h
+ *
+ * Bounded store and forward queue for publishes made while the MQTT
+ * connection is down. RAM ring is lock free single producer, single
+ * consumer so the publishing task never blocks. When the ring is full
+ * messages spill into NVS under their own keys and survive a reboot.
+ * A retained publish supersedes any queued retained publish to the same topic.
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#ifndef MQTTOFFLINEQUEUE_H_
+#define MQTTOFFLINEQUEUE_H_
+
+#include "MQTTConfig.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <atomic>
+
+#ifndef MQTT_OFFLINE_SLOTS
+#define MQTT_OFFLINE_SLOTS 8
+#endif
+
+//Inline storage per entry, holds zero terminated topic followed by payload
+#ifndef MQTT_OFFLINE_ENTRY_SIZE
+#define MQTT_OFFLINE_ENTRY_SIZE 256
+#endif
+
+//Maximum messages held in NVS once the ring is full
+#ifndef MQTT_OFFLINE_SPILL_MAX
+#define MQTT_OFFLINE_SPILL_MAX 16
+#endif
+
+#define MQTT_OFFLINE_NVS_HEAD "oqHead"
+#define MQTT_OFFLINE_NVS_TAIL "oqTail"
+#define MQTT_OFFLINE_NVS_KEY  "oq%lu"
+
+typedef struct {
+	uint16_t 	topicLen;
+	uint16_t 	payloadLen;
+	uint8_t 	QoS;
+	uint8_t 	retain;
+	volatile bool superseded;
+	uint8_t 	data[MQTT_OFFLINE_ENTRY_SIZE];
+} offline_entry_t;
+
+class MQTTOfflineQueue {
+public:
+	/***
+	 * Constructor
+	 */
+	MQTTOfflineQueue();
+
+	/***
+	 * Destructor
+	 */
+	virtual ~MQTTOfflineQueue();
+
+	/***
+	 * Pick up any messages spilled to NVS before a restart
+	 */
+	void init();
+
+	/***
+	 * Queue a publish. Producer side, must only be called from one task
+	 * @param topic - zero terminated string. Copied
+	 * @param payload - payload memory block. Copied
+	 * @param payloadLen - length of payload
+	 * @param QoS - 0, 1 or 2
+	 * @param retain - retained message, supersedes queued ones on same topic
+	 * @return false if message dropped
+	 */
+	bool push(const char * topic, const void * payload, size_t payloadLen,
+			uint8_t QoS, bool retain);
+
+	/***
+	 * Oldest message waiting. Consumer side
+	 * @return entry, or NULL if queue is empty
+	 */
+	offline_entry_t * front();
+
+	/***
+	 * Remove the message returned by front. Consumer side
+	 */
+	void pop();
+
+	/***
+	 * Is there anything to send
+	 * @return true if empty
+	 */
+	bool isEmpty();
+
+	/***
+	 * Topic of an entry
+	 * @param e - entry
+	 * @return zero terminated topic
+	 */
+	static const char * topic(offline_entry_t * e);
+
+	/***
+	 * Payload of an entry
+	 * @param e - entry
+	 * @return payload memory
+	 */
+	static const void * payload(offline_entry_t * e);
+
+	/***
+	 * Number of messages dropped as queue and spill were full
+	 * @return
+	 */
+	uint32_t getDropped();
+
+	/***
+	 * Number of retained messages superseded before being sent
+	 * @return
+	 */
+	uint32_t getCoalesced();
+
+	/***
+	 * Number of messages written to NVS
+	 * @return
+	 */
+	uint32_t getSpilled();
+
+private:
+	/***
+	 * Fill an entry
+	 * @return false if message does not fit an entry
+	 */
+	bool fill(offline_entry_t * e, const char * topic, const void * payload,
+			size_t payloadLen, uint8_t QoS, bool retain);
+
+	/***
+	 * Write message to NVS as the ring is full
+	 * @return false if dropped
+	 */
+	bool spill(const char * topic, const void * payload, size_t payloadLen,
+			uint8_t QoS, bool retain);
+
+	/***
+	 * Load the oldest spilled message into the scratch entry
+	 * @return true if loaded
+	 */
+	bool loadSpill();
+
+	offline_entry_t xRing[MQTT_OFFLINE_SLOTS];
+
+	// Free running counters, producer owns head, consumer owns tail
+	std::atomic<uint32_t> xHead{0};
+	std::atomic<uint32_t> xTail{0};
+
+	// NVS spill counters, producer owns head, consumer owns tail
+	std::atomic<uint32_t> xSpillHead{0};
+	std::atomic<uint32_t> xSpillTail{0};
+
+	// Consumer copy of oldest spilled message
+	offline_entry_t xSpillEntry;
+	bool xSpillLoaded = false;
+	bool xFrontIsSpill = false;
+
+	uint32_t xDropped = 0;
+	uint32_t xCoalesced = 0;
+	uint32_t xSpilled = 0;
+};
+
+#endif /* MQTTOFFLINEQUEUE_H_ */
@@ -0,0 +1,145 @@
+/*
+ * MQTTPublishPool.cpp
+ *
+ * Fixed capacity pool of publish slots. Each slot carries the command
+ * context for the MQTT Agent plus inline storage for the topic and payload,
+ * so publishing does not need to touch the heap.
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#include "MQTTPublishPool.h"
+#include <string.h>
+#include <stddef.h>
+
+/***
+ * Constructor
+ */
+MQTTPublishPool::MQTTPublishPool() {
+	// NOP
+}
+
+/***
+ * Destructor
+ */
+MQTTPublishPool::~MQTTPublishPool() {
+	if (xFree != NULL){
+		vQueueDelete(xFree);
+		xFree = NULL;
+	}
+}
+
+/***
+ * Create the free list. Must be called before any slot is requested
+ * @return true if pool is ready
+ */
+bool MQTTPublishPool::init(){
+	if (xFree != NULL){
+		return true;
+	}
+
+	xFree = xQueueCreateStatic(MQTT_PUBLISH_SLOTS,
+							   sizeof(MQTTPublishSlot_t *),
+							   xQueueStorage,
+							   &xQueueStruct);
+	if (xFree == NULL){
+		LogError(("Publish pool queue not created"));
+		return false;
+	}
+
+	for (size_t i=0; i < MQTT_PUBLISH_SLOTS; i++){
+		MQTTPublishSlot_t * slot = &xSlots[i];
+		xQueueSendToBack(xFree, &slot, 0);
+	}
+	return true;
+}
+
+/***
+ * Obtain a slot and copy topic and payload into it.
+ * Does not block, counts an exhausted event if no slot is free
+ * @param topic - zero terminated string
+ * @param payload - payload memory block
+ * @param payloadLen - length of payload
+ * @param owner - stored in the slot for the completion callback
+ * @return slot or NULL if none free or message too large
+ */
+MQTTPublishSlot_t * MQTTPublishPool::get(const char * topic,
+		const void * payload, size_t payloadLen, void * owner){
+	MQTTPublishSlot_t * slot = NULL;
+	size_t topicLen = strlen(topic);
+
+	if ((topicLen + 1 + payloadLen) > MQTT_PUBLISH_SLOT_SIZE){
+		LogError(("Publish of %lu bytes exceeds slot size %lu",
+				(unsigned long)(topicLen + 1 + payloadLen),
+				(unsigned long)MQTT_PUBLISH_SLOT_SIZE));
+		return NULL;
+	}
+
+	if (xFree == NULL){
+		return NULL;
+	}
+
+	if (xQueueReceive(xFree, &slot, 0) != pdTRUE){
+		xExhausted++;
+		return NULL;
+	}
+
+	MQTTAgentCommandContext_t * ctx = &slot->xContext;
+	ctx->topic = (char *)slot->xStorage;
+	memcpy(ctx->topic, topic, topicLen + 1);
+	ctx->payload = slot->xStorage + topicLen + 1;
+	memcpy(ctx->payload, payload, payloadLen);
+	ctx->subArgs = NULL;
+	slot->pOwner = owner;
+
+	MQTTPublishInfo_t * pPublishInfo = &ctx->publishInfo;
+	memset(pPublishInfo, 0, sizeof(MQTTPublishInfo_t));
+	pPublishInfo->pTopicName = ctx->topic;
+	pPublishInfo->topicNameLength = topicLen;
+	pPublishInfo->pPayload = ctx->payload;
+	pPublishInfo->payloadLength = payloadLen;
+
+	return slot;
+}
+
+/***
+ * Return slot to the pool
+ * @param slot
+ */
+void MQTTPublishPool::release(MQTTPublishSlot_t * slot){
+	if ((slot < xSlots) || (slot >= (xSlots + MQTT_PUBLISH_SLOTS))){
+		LogError(("Released slot not from pool"));
+		return;
+	}
+	xQueueSendToBack(xFree, &slot, 0);
+}
+
+/***
+ * Recover the slot from a command context handed back by the agent
+ * @param pContext
+ * @return slot
+ */
+MQTTPublishSlot_t * MQTTPublishPool::fromContext(MQTTAgentCommandContext_t * pContext){
+	static_assert(offsetof(MQTTPublishSlot_t, xContext) == 0,
+			"Context must be first member of slot");
+	return (MQTTPublishSlot_t *) pContext;
+}
+
+/***
+ * Number of times a publish found no free slot
+ * @return count
+ */
+uint32_t MQTTPublishPool::getExhausted(){
+	return xExhausted;
+}
+
+/***
+ * Number of slots currently free
+ * @return count
+ */
+UBaseType_t MQTTPublishPool::getFree(){
+	if (xFree == NULL){
+		return 0;
+	}
+	return uxQueueMessagesWaiting(xFree);
+}
@@ -0,0 +1,113 @@
+/*
+ * MQTTPublishPool.h
+ *
+ * Fixed capacity pool of publish slots. Each slot carries the command
+ * context for the MQTT Agent plus inline storage for the topic and payload,
+ * so publishing does not need to touch the heap.
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#ifndef MQTTPUBLISHPOOL_H_
+#define MQTTPUBLISHPOOL_H_
+
+#include "MQTTConfig.h"
+#include "FreeRTOS.h"
+#include "queue.h"
+#include "core_mqtt.h"
+#include "core_mqtt_agent.h"
+
+extern "C" {
+#include "freertos_agent_message.h"
+}
+
+#ifndef MQTT_AGENT_NETWORK_BUFFER_SIZE
+#define MQTT_AGENT_NETWORK_BUFFER_SIZE 2048
+#endif
+
+#ifndef MQTT_PUBLISH_SLOTS
+#define MQTT_PUBLISH_SLOTS 4
+#endif
+
+//Inline storage per slot, holds zero terminated topic followed by payload
+#ifndef MQTT_PUBLISH_SLOT_SIZE
+#define MQTT_PUBLISH_SLOT_SIZE MQTT_AGENT_NETWORK_BUFFER_SIZE
+#endif
+
+/***
+ * Publish slot. Context must be first member so the command complete
+ * callback can recover the slot from the context pointer.
+ */
+typedef struct {
+	MQTTAgentCommandContext_t 	xContext;
+	void * 						pOwner;
+	uint8_t 					xStorage[MQTT_PUBLISH_SLOT_SIZE];
+} MQTTPublishSlot_t;
+
+class MQTTPublishPool {
+public:
+	/***
+	 * Constructor
+	 */
+	MQTTPublishPool();
+
+	/***
+	 * Destructor
+	 */
+	virtual ~MQTTPublishPool();
+
+	/***
+	 * Create the free list. Must be called before any slot is requested
+	 * @return true if pool is ready
+	 */
+	bool init();
+
+	/***
+	 * Obtain a slot and copy topic and payload into it.
+	 * Does not block, counts an exhausted event if no slot is free
+	 * @param topic - zero terminated string
+	 * @param payload - payload memory block
+	 * @param payloadLen - length of payload
+	 * @param owner - stored in the slot for the completion callback
+	 * @return slot or NULL if none free or message too large
+	 */
+	MQTTPublishSlot_t * get(const char * topic, const void * payload,
+			size_t payloadLen, void * owner = NULL);
+
+	/***
+	 * Return slot to the pool
+	 * @param slot
+	 */
+	void release(MQTTPublishSlot_t * slot);
+
+	/***
+	 * Recover the slot from a command context handed back by the agent
+	 * @param pContext
+	 * @return slot
+	 */
+	static MQTTPublishSlot_t * fromContext(MQTTAgentCommandContext_t * pContext);
+
+	/***
+	 * Number of times a publish found no free slot
+	 * @return count
+	 */
+	uint32_t getExhausted();
+
+	/***
+	 * Number of slots currently free
+	 * @return count
+	 */
+	UBaseType_t getFree();
+
+private:
+	MQTTPublishSlot_t xSlots[MQTT_PUBLISH_SLOTS];
+
+	// Free list of slot pointers
+	uint8_t xQueueStorage[MQTT_PUBLISH_SLOTS * sizeof(MQTTPublishSlot_t *)];
+	StaticQueue_t xQueueStruct;
+	QueueHandle_t xFree = NULL;
+
+	volatile uint32_t xExhausted = 0;
+};
+
+#endif /* MQTTPUBLISHPOOL_H_ */
@@ -16,4 +16,12 @@ MQTTRouter::~MQTTRouter() {
 	// NOP
 }
 
+/***
+ * Called by a parent router once the subscriptions registered
+ * on behalf of this router have been requested
+ * @param interface - MQTT interface to use for any publication
+ */
+void MQTTRouter::subscribed(MQTTInterface *interface){
+	// NOP
+}
 
@@ -36,6 +36,13 @@ public:
 	  */
 	 virtual void route(const char *topic, size_t topicLen, const void * payload, size_t payloadLen, MQTTInterface *interface)=0;
 
+	 /***
+	  * Called by a parent router once the subscriptions registered
+	  * on behalf of this router have been requested
+	  * @param interface - MQTT interface to use for any publication
+	  */
+	 virtual void subscribed(MQTTInterface *interface);
+
 
 };
 
@@ -23,10 +23,11 @@ MQTTRouterBadger::~MQTTRouterBadger() {
 
 
 /***
- * Use the interface to setup all the subscriptions
- * @param interface
+ * Get the request topic for this badger, built on first call
+ * @param interface - used to get the thing id
+ * @return topic or NULL if it can not be allocated
  */
-void MQTTRouterBadger::subscribe(MQTTInterface *interface){
+const char * MQTTRouterBadger::getTopic(MQTTInterface *interface){
 	//Init topic if needed
 	if (pBadgerTopic == NULL){
 		const char *id = interface->getId();
@@ -39,15 +40,31 @@ void MQTTRouterBadger::subscribe(MQTTInterface *interface){
 			LogError( ("Unable to allocate topic") );
 		}
 	}
-	if (pBadgerTopic != NULL){
+	return pBadgerTopic;
+}
+
+/***
+ * Use the interface to setup all the subscriptions
+ * @param interface
+ */
+void MQTTRouterBadger::subscribe(MQTTInterface *interface){
+	if (getTopic(interface) != NULL){
 		LogInfo(("Subscribing to topic: %s",pBadgerTopic)); 
 		interface->subToTopic(pBadgerTopic, 1);
-		//Refresh screen once initialization is done
-		pAgent->sendAction(RefreshScreen);
-		pAgent->sendAction(GetWeather);
+		subscribed(interface);
 	}
 }
 
+/***
+ * Subscriptions are in place, ask the agent to refresh
+ * @param interface
+ */
+void MQTTRouterBadger::subscribed(MQTTInterface *interface){
+	//Refresh screen once initialization is done
+	pAgent->sendAction(RefreshScreen);
+	pAgent->sendAction(GetWeather);
+}
+
 /***
  * Route the message the appropriate part of the application
  * @param topic
@@ -41,6 +41,19 @@ public:
 	virtual void route(const char *topic, size_t topicLen, const void * payload,
 			size_t payloadLen, MQTTInterface *interface);
 
+	/***
+	 * Subscriptions are in place, ask the agent to refresh
+	 * @param interface
+	 */
+	virtual void subscribed(MQTTInterface *interface);
+
+	/***
+	 * Get the request topic for this badger, built on first call
+	 * @param interface - used to get the thing id
+	 * @return topic or NULL if it can not be allocated
+	 */
+	const char * getTopic(MQTTInterface *interface);
+
 
 
 private:
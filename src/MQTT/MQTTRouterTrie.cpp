@@ -0,0 +1,314 @@
+/*
+ * MQTTRouterTrie.cpp
+ *
+ * Router that dispatches to many handlers registered against MQTT topic
+ * filters, including + and # wildcards. Filters are held in a pre-built
+ * trie so matching an incoming topic walks it level by level with no
+ * allocation. The SUBSCRIBE list is produced from the registered filters.
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#include "MQTTRouterTrie.h"
+#include <string.h>
+
+/***
+ * Constructor
+ */
+MQTTRouterTrie::MQTTRouterTrie() {
+	//Root node has no label
+	newNode(0, 0);
+}
+
+/***
+ * Destructor
+ */
+MQTTRouterTrie::~MQTTRouterTrie() {
+	// NOP
+}
+
+/***
+ * Create a new empty node
+ * @param label - offset of label in arena
+ * @param labelLen - length of label
+ * @return node index or MQTT_TRIE_NONE if full
+ */
+int16_t MQTTRouterTrie::newNode(uint16_t label, uint16_t labelLen){
+	if (xNodeCount >= MQTT_TRIE_MAX_NODES){
+		LogError(("Topic trie out of nodes"));
+		return MQTT_TRIE_NONE;
+	}
+	trie_node_t *n = &xNodes[xNodeCount];
+	n->label = label;
+	n->labelLen = labelLen;
+	n->child = MQTT_TRIE_NONE;
+	n->sibling = MQTT_TRIE_NONE;
+	n->plus = MQTT_TRIE_NONE;
+	n->hash = MQTT_TRIE_NONE;
+	n->route = MQTT_TRIE_NONE;
+	return (int16_t)xNodeCount++;
+}
+
+/***
+ * Register a handler against a topic filter. Filter is copied.
+ * A handler may be registered against several filters
+ * @param filter - MQTT topic filter, may contain + and #
+ * @param handler - router that will be passed matching messages
+ * @param QoS - QoS to subscribe with
+ * @return false if filter is invalid or tables are full
+ */
+bool MQTTRouterTrie::addRoute(const char *filter, MQTTRouter *handler, uint8_t QoS){
+	if ((filter == NULL) || (handler == NULL)){
+		return false;
+	}
+	size_t len = strlen(filter);
+	if (len == 0){
+		return false;
+	}
+	if (xRouteCount >= MQTT_TRIE_MAX_ROUTES){
+		LogError(("Topic trie out of routes"));
+		return false;
+	}
+	if ((xArenaUsed + len + 1) > MQTT_TRIE_ARENA_SIZE){
+		LogError(("Topic trie out of filter storage"));
+		return false;
+	}
+
+	//Validate wildcards occupy a whole level and # is last
+	size_t start = 0;
+	while (start <= len){
+		size_t end = start;
+		while ((end < len) && (filter[end] != '/')){
+			end++;
+		}
+		for (size_t i = start; i < end; i++){
+			if ((filter[i] == '+') || (filter[i] == '#')){
+				if ((end - start) != 1){
+					LogError(("Invalid filter %s", filter));
+					return false;
+				}
+				if ((filter[i] == '#') && (end != len)){
+					LogError(("Invalid filter %s", filter));
+					return false;
+				}
+			}
+		}
+		start = end + 1;
+	}
+
+	//Copy filter, node labels reference the copy
+	uint16_t base = xArenaUsed;
+	char *copy = &xArena[base];
+	memcpy(copy, filter, len + 1);
+	xArenaUsed += len + 1;
+
+	int16_t node = 0;
+	start = 0;
+	while (start <= len){
+		size_t end = start;
+		while ((end < len) && (copy[end] != '/')){
+			end++;
+		}
+		size_t levelLen = end - start;
+		trie_node_t *n = &xNodes[node];
+		int16_t next = MQTT_TRIE_NONE;
+
+		if ((levelLen == 1) && (copy[start] == '+')){
+			if (n->plus == MQTT_TRIE_NONE){
+				n->plus = newNode(base + start, 1);
+			}
+			next = n->plus;
+		} else if ((levelLen == 1) && (copy[start] == '#')){
+			if (n->hash == MQTT_TRIE_NONE){
+				n->hash = newNode(base + start, 1);
+			}
+			next = n->hash;
+		} else {
+			for (int16_t c = n->child; c != MQTT_TRIE_NONE; c = xNodes[c].sibling){
+				if ((xNodes[c].labelLen == levelLen) &&
+						(memcmp(&xArena[xNodes[c].label], &copy[start], levelLen) == 0)){
+					next = c;
+					break;
+				}
+			}
+			if (next == MQTT_TRIE_NONE){
+				next = newNode(base + start, levelLen);
+				if (next != MQTT_TRIE_NONE){
+					xNodes[next].sibling = n->child;
+					n->child = next;
+				}
+			}
+		}
+
+		if (next == MQTT_TRIE_NONE){
+			return false;
+		}
+		node = next;
+		start = end + 1;
+	}
+
+	trie_route_t *r = &xRoutes[xRouteCount];
+	r->handler = handler;
+	r->filter = copy;
+	r->QoS = QoS;
+	r->next = xNodes[node].route;
+	xNodes[node].route = (int16_t)xRouteCount;
+	xRouteCount++;
+
+	return true;
+}
+
+/***
+ * Subscribe to every registered filter, then tell each handler
+ * @param interface
+ */
+void MQTTRouterTrie::subscribe(MQTTInterface *interface){
+	const char * topics[MQTT_TRIE_MAX_ROUTES];
+	uint8_t QoS[MQTT_TRIE_MAX_ROUTES];
+	size_t count = 0;
+
+	for (unsigned int i = 0; i < xRouteCount; i++){
+		//Skip filters already listed by an earlier route
+		bool dup = false;
+		for (unsigned int j = 0; j < i; j++){
+			if (strcmp(xRoutes[i].filter, xRoutes[j].filter) == 0){
+				dup = true;
+				break;
+			}
+		}
+		if (!dup){
+			LogInfo(("Subscribing to topic: %s", xRoutes[i].filter));
+			topics[count] = xRoutes[i].filter;
+			QoS[count] = xRoutes[i].QoS;
+			count++;
+		}
+	}
+	if (count > 0){
+		interface->subToTopics(topics, QoS, count);
+	}
+
+	for (unsigned int i = 0; i < xRouteCount; i++){
+		bool dup = false;
+		for (unsigned int j = 0; j < i; j++){
+			if (xRoutes[i].handler == xRoutes[j].handler){
+				dup = true;
+				break;
+			}
+		}
+		if (!dup){
+			xRoutes[i].handler->subscribed(interface);
+		}
+	}
+}
+
+/***
+ * Add the route chain from a node to the match list
+ * @param route - first route
+ * @param m - matches collected
+ */
+void MQTTRouterTrie::collect(int16_t route, trie_match_t *m){
+	while ((route != MQTT_TRIE_NONE) && (m->count < MQTT_TRIE_MAX_ROUTES)){
+		m->routes[m->count++] = route;
+		route = xRoutes[route].next;
+	}
+}
+
+/***
+ * Walk the trie matching topic levels from start
+ * @param node - current node
+ * @param topic - full topic
+ * @param topicLen - length of topic
+ * @param start - offset of level to match, > topicLen when consumed
+ * @param m - matches collected
+ */
+void MQTTRouterTrie::match(int16_t node, const char *topic, size_t topicLen,
+		size_t start, trie_match_t *m){
+	const trie_node_t *n = &xNodes[node];
+
+	if (start > topicLen){
+		collect(n->route, m);
+		// "a/#" also matches "a"
+		if (n->hash != MQTT_TRIE_NONE){
+			collect(xNodes[n->hash].route, m);
+		}
+		return;
+	}
+
+	// Wildcards do not match $ topics at the first level
+	bool dollar = (start == 0) && (topicLen > 0) && (topic[0] == '$');
+
+	if ((n->hash != MQTT_TRIE_NONE) && !dollar){
+		collect(xNodes[n->hash].route, m);
+	}
+
+	size_t end = start;
+	while ((end < topicLen) && (topic[end] != '/')){
+		end++;
+	}
+	size_t levelLen = end - start;
+
+	if ((n->plus != MQTT_TRIE_NONE) && !dollar){
+		match(n->plus, topic, topicLen, end + 1, m);
+	}
+
+	for (int16_t c = n->child; c != MQTT_TRIE_NONE; c = xNodes[c].sibling){
+		if ((xNodes[c].labelLen == levelLen) &&
+				(memcmp(&xArena[xNodes[c].label], &topic[start], levelLen) == 0)){
+			match(c, topic, topicLen, end + 1, m);
+			break;
+		}
+	}
+}
+
+/***
+ * Route the message to every handler with a matching filter.
+ * A handler receives a message once even if several of its filters match
+ * @param topic - non zero terminated string
+ * @param topicLen - length of topic
+ * @param payload - memory structure of payload
+ * @param payloadLen - payload length
+ * @param interface - MQTT interface to use for any response publication
+ */
+void MQTTRouterTrie::route(const char *topic, size_t topicLen,
+		const void * payload, size_t payloadLen, MQTTInterface *interface){
+	trie_match_t m;
+	m.count = 0;
+
+	match(0, topic, topicLen, 0, &m);
+
+	if (m.count == 0){
+		xUnmatched++;
+		LogDebug(("No route for %.*s", (int)topicLen, topic));
+		return;
+	}
+
+	for (unsigned int i = 0; i < m.count; i++){
+		MQTTRouter *handler = xRoutes[m.routes[i]].handler;
+		bool dup = false;
+		for (unsigned int j = 0; j < i; j++){
+			if (xRoutes[m.routes[j]].handler == handler){
+				dup = true;
+				break;
+			}
+		}
+		if (!dup){
+			handler->route(topic, topicLen, payload, payloadLen, interface);
+		}
+	}
+}
+
+/***
+ * Number of routes registered
+ * @return
+ */
+unsigned int MQTTRouterTrie::getRouteCount(){
+	return xRouteCount;
+}
+
+/***
+ * Number of messages that matched no filter
+ * @return
+ */
+uint32_t MQTTRouterTrie::getUnmatched(){
+	return xUnmatched;
+}
@@ -0,0 +1,149 @@
+/*
+ * MQTTRouterTrie.h
+ *
+ * Router that dispatches to many handlers registered against MQTT topic
+ * filters, including + and # wildcards. Filters are held in a pre-built
+ * trie so matching an incoming topic walks it level by level with no
+ * allocation. The SUBSCRIBE list is produced from the registered filters.
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#ifndef MQTTROUTERTRIE_H_
+#define MQTTROUTERTRIE_H_
+
+#include "MQTTConfig.h"
+#include "MQTTRouter.h"
+#include <stdint.h>
+
+#ifndef MQTT_TRIE_MAX_NODES
+#define MQTT_TRIE_MAX_NODES 32 //Levels across all filters, including root
+#endif
+
+#ifndef MQTT_TRIE_MAX_ROUTES
+#define MQTT_TRIE_MAX_ROUTES 16
+#endif
+
+#ifndef MQTT_TRIE_ARENA_SIZE
+#define MQTT_TRIE_ARENA_SIZE 512 //Storage for filter strings
+#endif
+
+#define MQTT_TRIE_NONE -1
+
+typedef struct {
+	uint16_t label;		//Offset of level name in arena
+	uint16_t labelLen;
+	int16_t child;		//First literal child
+	int16_t sibling;	//Next literal sibling
+	int16_t plus;		//Single level wildcard child
+	int16_t hash;		//Multi level wildcard child
+	int16_t route;		//First route ending at this node
+} trie_node_t;
+
+typedef struct {
+	MQTTRouter *handler;
+	const char *filter;	//Zero terminated copy in arena
+	uint8_t 	QoS;
+	int16_t 	next;		//Next route on the same node
+} trie_route_t;
+
+class MQTTRouterTrie : public MQTTRouter {
+public:
+	/***
+	 * Constructor
+	 */
+	MQTTRouterTrie();
+
+	/***
+	 * Destructor
+	 */
+	virtual ~MQTTRouterTrie();
+
+	/***
+	 * Register a handler against a topic filter. Filter is copied.
+	 * A handler may be registered against several filters
+	 * @param filter - MQTT topic filter, may contain + and #
+	 * @param handler - router that will be passed matching messages
+	 * @param QoS - QoS to subscribe with
+	 * @return false if filter is invalid or tables are full
+	 */
+	bool addRoute(const char *filter, MQTTRouter *handler, uint8_t QoS=1);
+
+	/***
+	 * Subscribe to every registered filter, then tell each handler
+	 * @param interface
+	 */
+	virtual void subscribe(MQTTInterface *interface);
+
+	/***
+	 * Route the message to every handler with a matching filter.
+	 * A handler receives a message once even if several of its filters match
+	 * @param topic - non zero terminated string
+	 * @param topicLen - length of topic
+	 * @param payload - memory structure of payload
+	 * @param payloadLen - payload length
+	 * @param interface - MQTT interface to use for any response publication
+	 */
+	virtual void route(const char *topic, size_t topicLen, const void * payload,
+			size_t payloadLen, MQTTInterface *interface);
+
+	/***
+	 * Number of routes registered
+	 * @return
+	 */
+	unsigned int getRouteCount();
+
+	/***
+	 * Number of messages that matched no filter
+	 * @return
+	 */
+	uint32_t getUnmatched();
+
+private:
+	/***
+	 * Collected routes for one incoming message
+	 */
+	typedef struct {
+		int16_t routes[MQTT_TRIE_MAX_ROUTES];
+		unsigned int count;
+	} trie_match_t;
+
+	/***
+	 * Create a new empty node
+	 * @param label - offset of label in arena
+	 * @param labelLen - length of label
+	 * @return node index or MQTT_TRIE_NONE if full
+	 */
+	int16_t newNode(uint16_t label, uint16_t labelLen);
+
+	/***
+	 * Walk the trie matching topic levels from start
+	 * @param node - current node
+	 * @param topic - full topic
+	 * @param topicLen - length of topic
+	 * @param start - offset of level to match, > topicLen when consumed
+	 * @param m - matches collected
+	 */
+	void match(int16_t node, const char *topic, size_t topicLen,
+			size_t start, trie_match_t *m);
+
+	/***
+	 * Add the route chain from a node to the match list
+	 * @param route - first route
+	 * @param m - matches collected
+	 */
+	void collect(int16_t route, trie_match_t *m);
+
+	trie_node_t xNodes[MQTT_TRIE_MAX_NODES];
+	unsigned int xNodeCount = 0;
+
+	trie_route_t xRoutes[MQTT_TRIE_MAX_ROUTES];
+	unsigned int xRouteCount = 0;
+
+	char xArena[MQTT_TRIE_ARENA_SIZE];
+	unsigned int xArenaUsed = 0;
+
+	uint32_t xUnmatched = 0;
+};
+
+#endif /* MQTTROUTERTRIE_H_ */
@@ -0,0 +1,141 @@
+/*
+ * MQTTRxBufferPool.cpp
+ *
+ * Fixed pool of reference counted receive buffers. An incoming payload
+ * is copied once out of the MQTT network buffer, then the buffer pointer
+ * is handed between tasks and parsed in place. The buffer returns to the
+ * pool when the last reference is released.
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#include "MQTTRxBufferPool.h"
+#include <string.h>
+
+/***
+ * Constructor
+ */
+MQTTRxBufferPool::MQTTRxBufferPool() {
+	// NOP
+}
+
+/***
+ * Destructor
+ */
+MQTTRxBufferPool::~MQTTRxBufferPool() {
+	if (xFree != NULL){
+		vQueueDelete(xFree);
+		xFree = NULL;
+	}
+}
+
+/***
+ * Create the free list. Must be called before any buffer is requested
+ * @return true if pool is ready
+ */
+bool MQTTRxBufferPool::init(){
+	if (xFree != NULL){
+		return true;
+	}
+
+	xFree = xQueueCreateStatic(MQTT_RX_BUFFERS,
+							   sizeof(rx_buffer_t *),
+							   xQueueStorage,
+							   &xQueueStruct);
+	if (xFree == NULL){
+		LogError(("Receive pool queue not created"));
+		return false;
+	}
+
+	for (size_t i=0; i < MQTT_RX_BUFFERS; i++){
+		rx_buffer_t * buf = &xBuffers[i];
+		buf->refs.store(0);
+		xQueueSendToBack(xFree, &buf, 0);
+	}
+	return true;
+}
+
+/***
+ * Obtain a buffer holding a zero terminated copy of the payload.
+ * Does not block. Caller holds the only reference
+ * @param payload - memory to copy
+ * @param len - length of payload
+ * @return buffer or NULL if none free or payload too large
+ */
+rx_buffer_t * MQTTRxBufferPool::get(const void * payload, size_t len){
+	rx_buffer_t * buf = NULL;
+
+	if (len > MQTT_RX_BUFFER_SIZE){
+		LogError(("Payload of %lu bytes exceeds buffer size %lu",
+				(unsigned long)len, (unsigned long)MQTT_RX_BUFFER_SIZE));
+		return NULL;
+	}
+
+	if (xFree == NULL){
+		return NULL;
+	}
+
+	if (xQueueReceive(xFree, &buf, 0) != pdTRUE){
+		xExhausted++;
+		return NULL;
+	}
+
+	UBaseType_t inUse = MQTT_RX_BUFFERS - uxQueueMessagesWaiting(xFree);
+	if (inUse > xPeakInUse){
+		xPeakInUse = inUse;
+	}
+
+	memcpy(buf->data, payload, len);
+	buf->data[len] = 0;
+	buf->len = len;
+	buf->refs.store(1);
+	xBytesCopied += len;
+
+	return buf;
+}
+
+/***
+ * Add a reference to a buffer
+ * @param buf
+ */
+void MQTTRxBufferPool::ref(rx_buffer_t * buf){
+	buf->refs.fetch_add(1);
+}
+
+/***
+ * Drop a reference, buffer returns to the pool on the last one
+ * @param buf
+ */
+void MQTTRxBufferPool::release(rx_buffer_t * buf){
+	if ((buf < xBuffers) || (buf >= (xBuffers + MQTT_RX_BUFFERS))){
+		LogError(("Released buffer not from pool"));
+		return;
+	}
+	if (buf->refs.fetch_sub(1) == 1){
+		xQueueSendToBack(xFree, &buf, 0);
+	}
+}
+
+/***
+ * Number of times no buffer was free
+ * @return count
+ */
+uint32_t MQTTRxBufferPool::getExhausted(){
+	return xExhausted;
+}
+
+/***
+ * Total payload bytes copied into buffers
+ * @return bytes
+ */
+uint64_t MQTTRxBufferPool::getBytesCopied(){
+	return xBytesCopied;
+}
+
+/***
+ * Most buffers in use at once
+ * @return count
+ */
+UBaseType_t MQTTRxBufferPool::getPeakInUse(){
+	return xPeakInUse;
+}
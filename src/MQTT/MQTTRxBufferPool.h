@@ -0,0 +1,106 @@
+/*
+ * MQTTRxBufferPool.h
+ *
+ * Fixed pool of reference counted receive buffers. An incoming payload
+ * is copied once out of the MQTT network buffer, then the buffer pointer
+ * is handed between tasks and parsed in place. The buffer returns to the
+ * pool when the last reference is released.
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#ifndef MQTTRXBUFFERPOOL_H_
+#define MQTTRXBUFFERPOOL_H_
+
+#include "MQTTConfig.h"
+#include "FreeRTOS.h"
+#include "queue.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <atomic>
+
+#ifndef MQTT_RX_BUFFERS
+#define MQTT_RX_BUFFERS 2
+#endif
+
+#ifndef MQTT_RX_BUFFER_SIZE
+#define MQTT_RX_BUFFER_SIZE 2048
+#endif
+
+typedef struct {
+	std::atomic<uint16_t> 	refs;
+	size_t 					len;
+	char 					data[MQTT_RX_BUFFER_SIZE + 1]; //Room for terminator
+} rx_buffer_t;
+
+class MQTTRxBufferPool {
+public:
+	/***
+	 * Constructor
+	 */
+	MQTTRxBufferPool();
+
+	/***
+	 * Destructor
+	 */
+	virtual ~MQTTRxBufferPool();
+
+	/***
+	 * Create the free list. Must be called before any buffer is requested
+	 * @return true if pool is ready
+	 */
+	bool init();
+
+	/***
+	 * Obtain a buffer holding a zero terminated copy of the payload.
+	 * Does not block. Caller holds the only reference
+	 * @param payload - memory to copy
+	 * @param len - length of payload
+	 * @return buffer or NULL if none free or payload too large
+	 */
+	rx_buffer_t * get(const void * payload, size_t len);
+
+	/***
+	 * Add a reference to a buffer
+	 * @param buf
+	 */
+	void ref(rx_buffer_t * buf);
+
+	/***
+	 * Drop a reference, buffer returns to the pool on the last one
+	 * @param buf
+	 */
+	void release(rx_buffer_t * buf);
+
+	/***
+	 * Number of times no buffer was free
+	 * @return count
+	 */
+	uint32_t getExhausted();
+
+	/***
+	 * Total payload bytes copied into buffers
+	 * @return bytes
+	 */
+	uint64_t getBytesCopied();
+
+	/***
+	 * Most buffers in use at once
+	 * @return count
+	 */
+	UBaseType_t getPeakInUse();
+
+private:
+	rx_buffer_t xBuffers[MQTT_RX_BUFFERS];
+
+	// Free list of buffer pointers
+	uint8_t xQueueStorage[MQTT_RX_BUFFERS * sizeof(rx_buffer_t *)];
+	StaticQueue_t xQueueStruct;
+	QueueHandle_t xFree = NULL;
+
+	volatile uint32_t xExhausted = 0;
+	volatile uint64_t xBytesCopied = 0;
+	volatile UBaseType_t xPeakInUse = 0;
+};
+
+#endif /* MQTTRXBUFFERPOOL_H_ */
@@ -0,0 +1,115 @@
+/*
+ * MQTTSubscribePool.cpp
+ *
+ * Fixed capacity pool of subscribe slots. Each slot carries the command
+ * context, the subscribe arguments and room for MAXSUBS filters so one
+ * SUBSCRIBE packet can carry many filters without touching the heap.
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#include "MQTTSubscribePool.h"
+#include <string.h>
+#include <stddef.h>
+
+/***
+ * Constructor
+ */
+MQTTSubscribePool::MQTTSubscribePool() {
+	// NOP
+}
+
+/***
+ * Destructor
+ */
+MQTTSubscribePool::~MQTTSubscribePool() {
+	if (xFree != NULL){
+		vQueueDelete(xFree);
+		xFree = NULL;
+	}
+}
+
+/***
+ * Create the free list. Must be called before any slot is requested
+ * @return true if pool is ready
+ */
+bool MQTTSubscribePool::init(){
+	if (xFree != NULL){
+		return true;
+	}
+
+	xFree = xQueueCreateStatic(MQTT_SUBSCRIBE_SLOTS,
+							   sizeof(MQTTSubscribeSlot_t *),
+							   xQueueStorage,
+							   &xQueueStruct);
+	if (xFree == NULL){
+		LogError(("Subscribe pool queue not created"));
+		return false;
+	}
+
+	for (size_t i=0; i < MQTT_SUBSCRIBE_SLOTS; i++){
+		MQTTSubscribeSlot_t * slot = &xSlots[i];
+		xQueueSendToBack(xFree, &slot, 0);
+	}
+	return true;
+}
+
+/***
+ * Obtain an empty slot, arguments point at the inline filter array
+ * @param blockTimeMs - time to wait for a slot to be released
+ * @param owner - stored in the slot for the completion callback
+ * @return slot or NULL if none free
+ */
+MQTTSubscribeSlot_t * MQTTSubscribePool::get(uint32_t blockTimeMs, void * owner){
+	MQTTSubscribeSlot_t * slot = NULL;
+
+	if (xFree == NULL){
+		return NULL;
+	}
+
+	if (xQueueReceive(xFree, &slot, pdMS_TO_TICKS(blockTimeMs)) != pdTRUE){
+		xExhausted++;
+		return NULL;
+	}
+
+	memset(slot->xInfo, 0, sizeof(slot->xInfo));
+	slot->xArgs.pSubscribeInfo = slot->xInfo;
+	slot->xArgs.numSubscriptions = 0;
+	slot->xContext.subArgs = &slot->xArgs;
+	slot->xContext.topic = NULL;
+	slot->xContext.payload = NULL;
+	slot->pOwner = owner;
+
+	return slot;
+}
+
+/***
+ * Return slot to the pool
+ * @param slot
+ */
+void MQTTSubscribePool::release(MQTTSubscribeSlot_t * slot){
+	if ((slot < xSlots) || (slot >= (xSlots + MQTT_SUBSCRIBE_SLOTS))){
+		LogError(("Released slot not from pool"));
+		return;
+	}
+	xQueueSendToBack(xFree, &slot, 0);
+}
+
+/***
+ * Recover the slot from a command context handed back by the agent
+ * @param pContext
+ * @return slot
+ */
+MQTTSubscribeSlot_t * MQTTSubscribePool::fromContext(MQTTAgentCommandContext_t * pContext){
+	static_assert(offsetof(MQTTSubscribeSlot_t, xContext) == 0,
+			"Context must be first member of slot");
+	return (MQTTSubscribeSlot_t *) pContext;
+}
+
+/***
+ * Number of times a subscribe found no free slot
+ * @return count
+ */
+uint32_t MQTTSubscribePool::getExhausted(){
+	return xExhausted;
+}
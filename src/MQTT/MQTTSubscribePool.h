@@ -0,0 +1,99 @@
+/*
+ * MQTTSubscribePool.h
+ *
+ * Fixed capacity pool of subscribe slots. Each slot carries the command
+ * context, the subscribe arguments and room for MAXSUBS filters so one
+ * SUBSCRIBE packet can carry many filters without touching the heap.
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#ifndef MQTTSUBSCRIBEPOOL_H_
+#define MQTTSUBSCRIBEPOOL_H_
+
+#include "MQTTConfig.h"
+#include "FreeRTOS.h"
+#include "queue.h"
+#include "core_mqtt.h"
+#include "core_mqtt_agent.h"
+
+extern "C" {
+#include "freertos_agent_message.h"
+}
+
+#ifndef MAXSUBS
+#define MAXSUBS 12
+#endif
+
+#ifndef MQTT_SUBSCRIBE_SLOTS
+#define MQTT_SUBSCRIBE_SLOTS 2
+#endif
+
+/***
+ * Subscribe slot. Context must be first member so the command complete
+ * callback can recover the slot from the context pointer.
+ */
+typedef struct {
+	MQTTAgentCommandContext_t 	xContext;
+	MQTTAgentSubscribeArgs_t 	xArgs;
+	MQTTSubscribeInfo_t 		xInfo[MAXSUBS];
+	void * 						pOwner;
+} MQTTSubscribeSlot_t;
+
+class MQTTSubscribePool {
+public:
+	/***
+	 * Constructor
+	 */
+	MQTTSubscribePool();
+
+	/***
+	 * Destructor
+	 */
+	virtual ~MQTTSubscribePool();
+
+	/***
+	 * Create the free list. Must be called before any slot is requested
+	 * @return true if pool is ready
+	 */
+	bool init();
+
+	/***
+	 * Obtain an empty slot, arguments point at the inline filter array
+	 * @param blockTimeMs - time to wait for a slot to be released
+	 * @param owner - stored in the slot for the completion callback
+	 * @return slot or NULL if none free
+	 */
+	MQTTSubscribeSlot_t * get(uint32_t blockTimeMs, void * owner);
+
+	/***
+	 * Return slot to the pool
+	 * @param slot
+	 */
+	void release(MQTTSubscribeSlot_t * slot);
+
+	/***
+	 * Recover the slot from a command context handed back by the agent
+	 * @param pContext
+	 * @return slot
+	 */
+	static MQTTSubscribeSlot_t * fromContext(MQTTAgentCommandContext_t * pContext);
+
+	/***
+	 * Number of times a subscribe found no free slot
+	 * @return count
+	 */
+	uint32_t getExhausted();
+
+private:
+	MQTTSubscribeSlot_t xSlots[MQTT_SUBSCRIBE_SLOTS];
+
+	// Free list of slot pointers
+	uint8_t xQueueStorage[MQTT_SUBSCRIBE_SLOTS * sizeof(MQTTSubscribeSlot_t *)];
+	StaticQueue_t xQueueStruct;
+	QueueHandle_t xFree = NULL;
+
+	volatile uint32_t xExhausted = 0;
+};
+
+#endif /* MQTTSUBSCRIBEPOOL_H_ */
@@ -31,6 +31,9 @@
 #ifndef MQTT_TOPIC_LIFECYCLE_KEEP_ALIVE
 #define MQTT_TOPIC_LIFECYCLE_KEEP_ALIVE "KEEP"
 #endif
+#ifndef MQTT_TOPIC_LIFECYCLE_CONN
+#define MQTT_TOPIC_LIFECYCLE_CONN "CONN"
+#endif
 
 #ifndef MQTT_STATE_TOPIC
 #define MQTT_STATE_TOPIC "STATE"
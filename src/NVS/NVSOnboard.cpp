@@ -9,6 +9,13 @@
 
 #include "hardware/sync.h"
 
+//Round up to whole flash pages
+#define pageAlign(x) ((((x) + FLASH_PAGE_SIZE - 1) / FLASH_PAGE_SIZE) * FLASH_PAGE_SIZE)
+//Round up to whole words
+#define wordAlign(x) ((((x) + 3) / 4) * 4)
+
+static_assert((NVS_BANK_SIZE % FLASH_SECTOR_SIZE) == 0, "NVS bank must be whole sectors");
+
 #if NVS_CORES == 2
 #include "pico/multicore.h"
 #include "hardware/structs/sio.h"
@@ -41,6 +48,7 @@ NVSOnboard::NVSOnboard(bool cleanNVS) {
 	} else {
 		xSemaphoreGive(xWriteSemaphore);
 	}
+	xCommitSemaphore = xSemaphoreCreateMutex();
 #endif
 	if (! cleanNVS){
 		init();
@@ -50,9 +58,15 @@ NVSOnboard::NVSOnboard(bool cleanNVS) {
 NVSOnboard::~NVSOnboard() {
 	rollback();
 #ifdef LIB_FREERTOS_KERNEL
+	if (xWriteBackTask != NULL){
+		vTaskDelete(xWriteBackTask);
+	}
 	if (xWriteSemaphore != NULL){
 		vSemaphoreDelete(xWriteSemaphore);
 	}
+	if (xCommitSemaphore != NULL){
+		vSemaphoreDelete(xCommitSemaphore);
+	}
 #endif
 }
 
@@ -71,17 +85,16 @@ nvs_err_t NVSOnboard::set(
 	if (res != NVS_OK){
 		return res;
 	}
-
-	//Create new entry
-	nvs_entry_t * entry = (nvs_entry_t *)malloc(sizeof(nvs_entry_t));
-	if (entry == NULL){
+	if ((len > NVS_BANK_SIZE) || (len > NVS_ARENA_SIZE)){
 		return NVS_ERR_NOT_ENOUGH_MEM;
 	}
-	strcpy(entry->key, key);
-	entry->type = type;
-	entry->len = len;
-	entry->value = malloc(entry->len);
-	memcpy(entry->value,  value, entry->len);
+	uint32_t hash = keyHash(key);
+	size_t keyLen = strlen(key) + 1;
+
+	//Write back holds changes in the arena, so make room by writing them
+	if (xWriteBack && ((xArenaUsed + wordAlign(keyLen) + wordAlign(len)) > NVS_ARENA_SIZE)){
+		writeBatch();
+	}
 
 	// *** START THREAD SEMAPHORE
 #ifdef LIB_FREERTOS_KERNEL
@@ -91,15 +104,40 @@ nvs_err_t NVSOnboard::set(
 		}
 	}
 #endif
-	//If existing dirty value then clean it up
-	if (xDirty.count(key) > 0){
-		nvs_entry_t * old = xDirty[key];
-		free(old->value);
-		free(old);
+	nvs_index_t * entry = find(key, hash);
+	bool added = false;
+	if (entry == NULL){
+		entry = insert(hash);
+		if (entry != NULL){
+			entry->key = key;
+			added = true;
+		}
 	}
 
-	//Store new entry
-	xDirty[key]=entry;
+	//New block holds key and value, any previous block becomes free
+	uint8_t * block = NULL;
+	if (entry != NULL){
+		block = arenaAlloc(wordAlign(keyLen) + wordAlign(len));
+		//Arena may have moved, find the entry again
+		entry = find(key, hash);
+	}
+	if (block == NULL){
+		if (added){
+			remove(entry);
+		}
+		res = NVS_ERR_NOT_ENOUGH_MEM;
+	} else {
+		memcpy(block, key, keyLen);
+		memcpy(block + wordAlign(keyLen), value, len);
+		if (entry->type == NVS_TYPE_ANY){
+			entry->key = (const char *) block;
+		}
+		entry->block = block;
+		entry->dirtyType = type;
+		entry->dirtyLen = len;
+		entry->gen = ++xGeneration;
+		res = NVS_OK;
+	}
 #ifdef LIB_FREERTOS_KERNEL
 	if (xWriteSemaphore != NULL){
 		xSemaphoreGive(xWriteSemaphore);
@@ -107,7 +145,7 @@ nvs_err_t NVSOnboard::set(
 #endif
 	// *** END THREAD SEMAPHORE
 
-	return NVS_OK;
+	return res;
 }
 
 nvs_err_t NVSOnboard::get(
@@ -122,60 +160,92 @@ nvs_err_t NVSOnboard::get(
 	if (res != NVS_OK){
 		return res;
 	}
+	uint32_t hash = keyHash(key);
 
-	// Check if on dirty list
-	// On Change the dirty list briefly become unstable, so puting in a semaphore
-	if (xDirty.count(key) > 0){
+	// On Change the index briefly become unstable, so puting in a semaphore
 #ifdef LIB_FREERTOS_KERNEL
-		if (xWriteSemaphore != NULL){
-			if (xSemaphoreTake(xWriteSemaphore, NVS_WAIT/1000) != pdTRUE){
-				return NVS_ERR_LOCK_FAILED;
-			}
+	if (xWriteSemaphore != NULL){
+		if (xSemaphoreTake(xWriteSemaphore, NVS_WAIT/1000) != pdTRUE){
+			return NVS_ERR_LOCK_FAILED;
 		}
+	}
 #endif
-		nvs_entry_t * old = xDirty[key];
-		if (old->type == NVS_TYPE_ERASE){
-			res = NVS_ERR_NOT_FOUND;
-		} else if (old->type == type){
-			if (old->len <= *len) {
-				memcpy(out_value, old->value, old->len);
-				*len = old->len;
-				res = NVS_OK;
-			} else {
-				res = NVS_ERR_NOT_ENOUGH_MEM;
-			}
+	const nvs_index_t * entry = find(key, hash);
+	nvs_type_t liveType = NVS_TYPE_ANY;
+	size_t liveLen = 0;
+	const void * liveValue = NULL;
+	if (entry != NULL){
+		liveType = live(entry, &liveLen, &liveValue);
+	}
+
+	if ((liveType == NVS_TYPE_ANY) || (liveType == NVS_TYPE_ERASE)){
+		res = NVS_ERR_NOT_FOUND;
+	} else if (liveType == type){
+		if (liveLen <= *len) {
+			memcpy(out_value, liveValue, liveLen);
+			*len = liveLen;
+			res = NVS_OK;
 		} else {
-			res = NVS_ERR_INVALID_TYPE;
+			res = NVS_ERR_NOT_ENOUGH_MEM;
 		}
+	} else {
+		res = NVS_ERR_INVALID_TYPE;
+	}
 #ifdef LIB_FREERTOS_KERNEL
-		if (xWriteSemaphore != NULL){
-			xSemaphoreGive(xWriteSemaphore);
-		}
+	if (xWriteSemaphore != NULL){
+		xSemaphoreGive(xWriteSemaphore);
+	}
 #endif
+	return res;
+}
+
+
+
+nvs_err_t NVSOnboard::view(
+		const char* key,
+		nvs_type_t type,
+		size_t * len,
+		const void ** out_value){
+
+	nvs_err_t res;
+	res = validKey(key);
+	if (res != NVS_OK){
 		return res;
 	}
+	uint32_t hash = keyHash(key);
 
-
-	if (xClean.count(key) > 0){
-		nvs_entry_t * old = xClean[key];
-		if (old->type == type){
-			if (old->len <= *len) {
-				memcpy(out_value, old->value, old->len);
-				*len = old->len;
-				return NVS_OK;
-			} else {
-				return NVS_ERR_NOT_ENOUGH_MEM;
-			}
-		} else {
-			return NVS_ERR_INVALID_TYPE;
+#ifdef LIB_FREERTOS_KERNEL
+	if (xWriteSemaphore != NULL){
+		if (xSemaphoreTake(xWriteSemaphore, NVS_WAIT/1000) != pdTRUE){
+			return NVS_ERR_LOCK_FAILED;
 		}
 	}
+#endif
+	const nvs_index_t * entry = find(key, hash);
+	nvs_type_t liveType = NVS_TYPE_ANY;
+	size_t liveLen = 0;
+	const void * liveValue = NULL;
+	if (entry != NULL){
+		liveType = live(entry, &liveLen, &liveValue);
+	}
 
-	return NVS_ERR_NOT_FOUND;
+	if ((liveType == NVS_TYPE_ANY) || (liveType == NVS_TYPE_ERASE)){
+		res = NVS_ERR_NOT_FOUND;
+	} else if (liveType == type){
+		*out_value = liveValue;
+		*len = liveLen;
+		res = NVS_OK;
+	} else {
+		res = NVS_ERR_INVALID_TYPE;
+	}
+#ifdef LIB_FREERTOS_KERNEL
+	if (xWriteSemaphore != NULL){
+		xSemaphoreGive(xWriteSemaphore);
+	}
+#endif
+	return res;
 }
 
-
-
 nvs_err_t NVSOnboard::set_i8 ( const char* key, int8_t value){
 	return set(key, NVS_TYPE_I8, 1, &value);
 }
@@ -275,6 +345,24 @@ nvs_err_t NVSOnboard::get_blob(
 }
 
 
+nvs_err_t NVSOnboard::view_str (
+		const char* key,
+		const char** value,
+		size_t* length){
+	return view(key, NVS_TYPE_STR, length, (const void **) value);
+}
+
+nvs_err_t NVSOnboard::view_blob(
+		const char* key,
+		const void** value,
+		size_t* length){
+	return view(key, NVS_TYPE_BLOB, length, value);
+}
+
+uint32_t NVSOnboard::getGeneration(){
+	return xGeneration;
+}
+
 
 nvs_err_t NVSOnboard::erase_key( const char* key){
 	nvs_err_t res;
@@ -283,107 +371,337 @@ nvs_err_t NVSOnboard::erase_key( const char* key){
 		return res;
 	}
 
-	if (xDirty.count(key) > 0){
-		nvs_entry_t * entry = xDirty[key];
-		if (entry->type != NVS_TYPE_ERASE){
-			free(entry->value);
-		}
-		if (xClean.count(key) == 0){
-			free(entry);
-			xDirty.erase(key);
-			return NVS_OK;
-		} else {
-			entry->type = NVS_TYPE_ERASE;
-			entry->len =0;
-			return NVS_OK;
-		}
-	} else if (xClean.count(key) > 0){
-		nvs_entry_t * entry = (nvs_entry_t *) malloc(sizeof(nvs_entry_t));
-		if (entry == NULL){
-			return NVS_ERR_NOT_ENOUGH_MEM;
+	if (!lock()){
+		return NVS_ERR_LOCK_FAILED;
+	}
+	nvs_index_t * entry = find(key, keyHash(key));
+	if (entry == NULL){
+		res = NVS_ERR_NOT_FOUND;
+	} else {
+		eraseEntry(entry);
+	}
+	unlock();
+	return res;
+}
+
+void NVSOnboard::eraseEntry(nvs_index_t *entry){
+	xGeneration++;
+	//A commit in flight may be writing it, so record the erase
+	if ((entry->type == NVS_TYPE_ANY) && !xCommitting){
+		//Never commited, just forget it
+		remove(entry);
+	} else {
+		//Keep the block while the key lives in it, without the value
+		if (entry->key != (const char *) entry->block){
+			entry->block = NULL;
 		}
-		strcpy(entry->key, key);
-		entry->type = NVS_TYPE_ERASE;
-		entry->len =0;
-		entry->value=NULL;
-		xDirty[key] = entry;
-		return NVS_OK;
+		entry->dirtyType = NVS_TYPE_ERASE;
+		entry->dirtyLen = 0;
+		entry->gen = xGeneration;
 	}
+}
 
+nvs_err_t NVSOnboard::erase_all(){
+	if (!lock()){
+		return NVS_ERR_LOCK_FAILED;
+	}
+	//Backwards as entries may be removed
+	for (int i = xCount - 1; i >= 0; i--){
+		eraseEntry(&xIndex[i]);
+	}
+	unlock();
+	return NVS_OK;
+}
 
-	return NVS_ERR_NOT_FOUND;
+nvs_err_t NVSOnboard::commit(){
+	if (!lock()){
+		return NVS_ERR_LOCK_FAILED;
+	}
+	if (!isDirtyLocked() && !xNeedsCompact){
+		unlock();
+		return NVS_OK;
+	}
+	size_t delta = deltaSize();
+	xCommitRequests++;
+	xRequestedBytes += pageAlign(sizeof(nvs_batch_t) + delta);
+	unlock();
+
+#ifdef LIB_FREERTOS_KERNEL
+	//Defer to the write back task unless enough is dirty
+	if (xWriteBack && (delta < NVS_WRITE_BACK_BYTES)){
+		xTaskNotifyGive(xWriteBackTask);
+		return NVS_OK;
+	}
+#endif
+	return writeBatch();
 }
 
-nvs_err_t NVSOnboard::erase_all(){
+nvs_err_t NVSOnboard::flush(){
+	if (!lock()){
+		return NVS_ERR_LOCK_FAILED;
+	}
+	if (!isDirtyLocked() && !xNeedsCompact){
+		unlock();
+		return NVS_OK;
+	}
+	xCommitRequests++;
+	xRequestedBytes += pageAlign(sizeof(nvs_batch_t) + deltaSize());
+	unlock();
+	return writeBatch();
+}
 
+nvs_err_t NVSOnboard::writeBatch(){
 	nvs_err_t res = NVS_OK;
-	map<string, nvs_entry_t *>::iterator it = xDirty.begin();
-	while (it != xDirty.end()){
-		res = erase_key(it->first.c_str());
-		if (res != NVS_OK)
-			return res;
-		it++;
+
+#ifdef LIB_FREERTOS_KERNEL
+	if (xCommitSemaphore != NULL){
+		xSemaphoreTake(xCommitSemaphore, portMAX_DELAY);
 	}
-	it = xClean.begin();
-	while (it != xClean.end()){
-		res = erase_key(it->first.c_str());
-		if (res != NVS_OK)
-		    return res;
-		 it++;
+#endif
+	if (!lock()){
+		res = NVS_ERR_LOCK_FAILED;
+	} else if (!isDirtyLocked() && !xNeedsCompact){
+		//Already written by an earlier commit
+		unlock();
+	} else {
+		res = writeLocked();
 	}
-
+#ifdef LIB_FREERTOS_KERNEL
+	if (xCommitSemaphore != NULL){
+		xSemaphoreGive(xCommitSemaphore);
+	}
+#endif
 	return res;
 }
 
-nvs_err_t NVSOnboard::commit(){
-	size_t size = pagesSize();
-
-	if (size == 0){
+nvs_err_t NVSOnboard::writeLocked(){
+	uint64_t start = time_us_64();
+	//Append changes, unless bank is full or needs rewriting
+	size_t delta = deltaSize();
+	size_t size = pageAlign(sizeof(nvs_batch_t) + delta);
+	bool compact = xNeedsCompact || (xOffset == 0) ||
+			((xOffset + size) > NVS_BANK_SIZE);
+	size_t body = delta;
+	if (compact){
+		body = snapshotSize();
+		size = pageAlign(sizeof(nvs_batch_t) + body);
+	}
+	if ((body > NVS_BANK_SIZE) || (size > NVS_BANK_SIZE)){
+		unlock();
 		return NVS_ERR_NOT_ENOUGH_MEM;
 	}
 
 	uint8_t *mem = (uint8_t *)malloc(size);
 	if (mem == NULL){
+		unlock();
 		return NVS_ERR_NOT_ENOUGH_MEM;
 	}
-	nvs_header_t * header = (nvs_header_t *) mem;
-	nvs_entry_t * entry = (nvs_entry_t *) (mem + sizeof(nvs_header_t));
-	uint32_t offset = sizeof(nvs_header_t) + (numKeys() * sizeof(nvs_entry_t));
+	memset(mem, 0xFF, size);
+	nvs_batch_t * batch = (nvs_batch_t *) mem;
+	uint8_t * rec = mem + sizeof(nvs_batch_t);
+
+	for (unsigned int i = 0; i < xCount; i++){
+		const nvs_index_t * entry = &xIndex[i];
+		if (entry->dirtyType != NVS_TYPE_ANY){
+			//Snapshot only holds live keys
+			if (!compact || (entry->dirtyType != NVS_TYPE_ERASE)){
+				rec += packRecord(rec, entry->key, (nvs_type_t) entry->dirtyType,
+						entry->dirtyLen, dirtyValue(entry));
+			}
+		} else if (compact){
+			rec += packRecord(rec, entry->key, (nvs_type_t) entry->type,
+					entry->len, entry->value);
+		}
+	}
+
+	batch->magic = NVS_LOG_MAGIC;
+	batch->seq = xSeq + 1;
+	batch->len = body;
+	batch->hash = oat_hash((const char *)(mem + sizeof(nvs_batch_t)), body);
+
+	uint32_t bank = xBank;
+	uint32_t offset = xOffset;
+	size_t eraseLen = 0;
+	if (compact){
+		//Keep the current bank intact until the new one is written
+		if ((xOffset != 0) || xNeedsCompact){
+			bank = 1 - xBank;
+		}
+		offset = 0;
+		eraseLen = NVS_BANK_SIZE;
+		xCompactions++;
+	}
+
+	//Other tasks may set keys while flash is written
+	uint32_t snapGen = xGeneration;
+	xCommitting = true;
+	unlock();
+
+	uint32_t blockedUs = flashWrite(FLASH_WRITE_START + bank * NVS_BANK_SIZE + offset,
+			mem, size, eraseLen);
+
+	//Must apply what was written
+	lock(true);
+	if (blockedUs > xMaxBlockedUs){
+		xMaxBlockedUs = blockedUs;
+	}
 
-	map<string, nvs_entry_t *>::iterator it = xDirty.begin();
-	while (it != xDirty.end()){
-		if (it->second->type != NVS_TYPE_ERASE){
-			 memcpy(entry,   it->second, sizeof(nvs_entry_t));
-			 void * data = (void *) (mem + offset);
-			 memcpy(data, it->second->value, it->second->len);
-			 entry->value = (void *)(FLASH_READ_START + offset);
-			 offset += it->second->len;
+	xCommits++;
+	xErases += eraseLen / FLASH_SECTOR_SIZE;
+	xBytesProgrammed += size;
+	xBytesWritten += delta;
+	uint32_t seq = batch->seq;
+	free(mem);
+
+	//Read back before trusting it, keeping changes dirty if it failed
+	if (!batchValid(batchAt(bank, offset), NVS_BANK_SIZE - offset)){
+		printf("NVSOnboard: Batch failed to write\n");
+		xNeedsCompact = true;
+		xCommitting = false;
+		unlock();
+		return NVS_ERR_WRITE_FAILED;
+	}
 
-			 //printf("Commit %s = %s %u\n", it->first.c_str(), it->second->key, it->second->len);
-			 entry ++;
+	//Point index at the batch just written, changes made since stay dirty
+	xSeq = seq;
+	xBank = bank;
+	xOffset = offset + size;
+	xNeedsCompact = false;
+	if (compact){
+		//Snapshot replaces the old bank, keys not in it are not commited
+		for (unsigned int i = 0; i < xCount; i++){
+			nvs_index_t * entry = &xIndex[i];
+			entry->type = NVS_TYPE_ANY;
+			entry->value = NULL;
+			entry->len = 0;
+			if (entry->block != NULL){
+				entry->key = (const char *) entry->block;
+			}
 		}
-		it++;
 	}
-	it = xClean.begin();
-	while (it != xClean.end()){
-		if (xDirty.count(it->first) == 0){
-			 memcpy(entry,   it->second, sizeof(nvs_entry_t));
-			 void * data = (void *) (mem + offset);
-			 memcpy(data, it->second->value, it->second->len);
-			 entry->value = (void *)(FLASH_READ_START + offset);
-			 offset += it->second->len;
-			 entry ++;
+	applyBatch(batchAt(bank, offset), snapGen);
+	for (int i = xCount - 1; i >= 0; i--){
+		nvs_index_t * entry = &xIndex[i];
+		if ((entry->type == NVS_TYPE_ANY) && (entry->dirtyType == NVS_TYPE_ERASE)){
+			//Erase of a key no longer in flash
+			remove(entry);
+		} else if ((entry->dirtyType != NVS_TYPE_ANY) && ((int32_t)(entry->gen - snapGen) <= 0)){
+			if (entry->dirtyType == NVS_TYPE_ERASE){
+				remove(entry);
+			} else {
+				entry->block = NULL;
+				entry->dirtyType = NVS_TYPE_ANY;
+				entry->dirtyLen = 0;
+			}
+		}
+	}
+	if (!isDirtyLocked()){
+		xArenaUsed = 0;
+	}
+	xCommitting = false;
+	xGeneration++;
+	unlock();
+
+	xLastCommitUs = (uint32_t)(time_us_64() - start);
+	return NVS_OK;
+}
+
+bool NVSOnboard::lock(bool forever){
+#ifdef LIB_FREERTOS_KERNEL
+	if (xWriteSemaphore != NULL){
+		if (xSemaphoreTake(xWriteSemaphore,
+				forever ? portMAX_DELAY : NVS_WAIT/1000) != pdTRUE){
+			return false;
+		}
+	}
+#endif
+	return true;
+}
+
+void NVSOnboard::unlock(){
+#ifdef LIB_FREERTOS_KERNEL
+	if (xWriteSemaphore != NULL){
+		xSemaphoreGive(xWriteSemaphore);
+	}
+#endif
+}
+
+bool NVSOnboard::setWriteBack(bool on){
+#ifdef LIB_FREERTOS_KERNEL
+	if (on && (xWriteBackTask == NULL)){
+		if (xTaskCreate(NVSOnboard::writeBackTask, "NVSWriteBack",
+				NVS_WRITE_BACK_STACK, this, NVS_WRITE_BACK_PRIORITY,
+				&xWriteBackTask) != pdPASS){
+			printf("NVSOnboard: Failed to create write back task\n");
+			xWriteBackTask = NULL;
+			return false;
 		}
-		 it++;
 	}
+	xWriteBack = on;
+	if (!on){
+		writeBatch();
+	}
+	return xWriteBack;
+#else
+	return false;
+#endif
+}
+
+#ifdef LIB_FREERTOS_KERNEL
+void NVSOnboard::writeBackTask(void *pvParameters){
+	NVSOnboard * nvs = (NVSOnboard *) pvParameters;
 
-	header->count = numKeys();
-	entry = (nvs_entry_t *) (mem + sizeof(nvs_header_t));
-	header->hash = oat_hash((const char *)entry, size - sizeof(nvs_header_t));
-	header->pages = size;
+	for (;;){
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
 
-	//printf("Flashing header %u, %u, %u\n", header->count, header->pages, header->hash);
+		//Wait for commits to go quiet, but not for ever
+		TickType_t start = xTaskGetTickCount();
+		while ((xTaskGetTickCount() - start) < pdMS_TO_TICKS(NVS_WRITE_BACK_MAX_MS)){
+			if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(NVS_WRITE_BACK_MS)) == 0){
+				break;
+			}
+		}
+		nvs->writeBatch();
+	}
+}
+#endif
 
+uint32_t NVSOnboard::flashWrite(uint32_t offset, const uint8_t *data, size_t len, size_t eraseLen){
+	uint32_t maxUs = 0;
+	uint32_t us;
+
+	//Each operation is bounded, yield between them so the other
+	//tasks, MQTT keep alive included, are never held for a whole commit
+	for (size_t done = 0; done < eraseLen; done += FLASH_SECTOR_SIZE){
+		us = flashOp(offset + done, NULL, FLASH_SECTOR_SIZE);
+		if (us > maxUs){
+			maxUs = us;
+		}
+#ifdef LIB_FREERTOS_KERNEL
+		if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING){
+			taskYIELD();
+		}
+#endif
+	}
+	for (size_t done = 0; done < len; done += NVS_PROGRAM_CHUNK){
+		size_t chunk = len - done;
+		if (chunk > NVS_PROGRAM_CHUNK){
+			chunk = NVS_PROGRAM_CHUNK;
+		}
+		us = flashOp(offset + done, data + done, chunk);
+		if (us > maxUs){
+			maxUs = us;
+		}
+#ifdef LIB_FREERTOS_KERNEL
+		if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING){
+			taskYIELD();
+		}
+#endif
+	}
+	return maxUs;
+}
+
+uint32_t NVSOnboard::flashOp(uint32_t offset, const uint8_t *data, size_t len){
 	 //CRITICAL SECTION - NO INTRUP1GT OF MULTIPROCESSOR
 #ifdef LIB_FREERTOS_KERNEL
 #ifdef FREE_RTOS_KERNEL_SMP
@@ -406,8 +724,13 @@ nvs_err_t NVSOnboard::commit(){
 #endif //NVS_CORES
 #endif //LIB_FREERTOS_KERNEL
 
-	 flash_range_erase(FLASH_WRITE_START, NVS_SIZE);
-     flash_range_program(FLASH_WRITE_START, mem, size);
+	uint64_t start = time_us_64();
+	if (data == NULL){
+		flash_range_erase(offset, len);
+	} else {
+		flash_range_program(offset, data, len);
+	}
+	uint32_t us = (uint32_t)(time_us_64() - start);
 
 #ifdef LIB_FREERTOS_KERNEL
 #ifdef FREE_RTOS_KERNEL_SMP
@@ -425,65 +748,74 @@ nvs_err_t NVSOnboard::commit(){
 #endif //NVS_CORES
 #endif //LIB_FREERTOS_KERNEL
 
-     free(mem);
-     rollback();
-     init();
-
-     return NVS_OK;
-
+	return us;
 }
 
+size_t NVSOnboard::recordSize(size_t keyLen, size_t len){
+	return sizeof(nvs_record_t) + wordAlign(keyLen) + wordAlign(len);
+}
 
-size_t NVSOnboard::pagesSize(){
-	size_t size;
-	size_t indexSize;
-	size_t dataSize = 0;
-	size_t pagesSize;
-
-	indexSize = numKeys() * sizeof(nvs_entry_t);
-	map<string, nvs_entry_t *>::iterator it = xDirty.begin();
-	while (it != xDirty.end()){
-		 nvs_entry_t * entry = it->second;
-		if (entry->len > NVS_SIZE){
-			return 0; // Corrupt
-		}
-		 dataSize +=entry->len;
-		 it++;
+size_t NVSOnboard::packRecord(uint8_t *buf, const char *key, nvs_type_t type,
+		size_t len, const void *value){
+	nvs_record_t * rec = (nvs_record_t *) buf;
+	size_t keyLen = strlen(key) + 1;
+
+	rec->type = (uint8_t) type;
+	rec->keyLen = (uint8_t) keyLen;
+	rec->len = (uint16_t) len;
+	memcpy(buf + sizeof(nvs_record_t), key, keyLen);
+	if (len > 0){
+		memcpy(buf + sizeof(nvs_record_t) + wordAlign(keyLen), value, len);
 	}
-	it = xClean.begin();
-	while (it != xClean.end()){
-		if (xDirty.count(it->first) == 0){
-		    nvs_entry_t * entry = it->second;
-		    if (entry->len > NVS_SIZE){
-		    	return 0; // Corrupt
-		    }
-		    dataSize +=entry->len;
+	return recordSize(keyLen, len);
+}
+
+size_t NVSOnboard::deltaSize(){
+	size_t size = 0;
+	for (unsigned int i = 0; i < xCount; i++){
+		const nvs_index_t * entry = &xIndex[i];
+		if (entry->dirtyType != NVS_TYPE_ANY){
+			size += recordSize(strlen(entry->key) + 1, entry->dirtyLen);
 		}
-		 it++;
-	}
-	size = 2 * sizeof(uint32_t ) + indexSize + dataSize;
-	pagesSize = (size / 256) * 256;
-	if (size > (pagesSize)){
-		pagesSize += 256;
 	}
+	return size;
+}
 
-	//printf("Size %u, index %u, data %u, Pages %u\n", size, indexSize, dataSize, pagesSize);
-
+size_t NVSOnboard::snapshotSize(){
+	size_t size = 0;
+	size_t len;
+	const void * value;
 
-	return pagesSize;
+	for (unsigned int i = 0; i < xCount; i++){
+		nvs_type_t type = live(&xIndex[i], &len, &value);
+		if ((type != NVS_TYPE_ANY) && (type != NVS_TYPE_ERASE)){
+			size += recordSize(strlen(xIndex[i].key) + 1, len);
+		}
+	}
+	return size;
 }
 
 nvs_err_t NVSOnboard::rollback(){
-	map<string, nvs_entry_t *>::iterator it = xDirty.begin();
-	while (it != xDirty.end()){
-		 nvs_entry_t * entry = it->second;
-		 if (entry->type != NVS_TYPE_ERASE){
-			 free(entry->value);
-		 }
-		 free(entry);
-		 it++;
-	}
-	xDirty.clear();
+	lock(true);
+	nvs_err_t res = rollbackLocked();
+	unlock();
+	return res;
+}
+
+nvs_err_t NVSOnboard::rollbackLocked(){
+	//Backwards as entries may be removed
+	for (int i = xCount - 1; i >= 0; i--){
+		nvs_index_t * entry = &xIndex[i];
+		if (entry->type == NVS_TYPE_ANY){
+			remove(entry);
+		} else {
+			entry->block = NULL;
+			entry->dirtyType = NVS_TYPE_ANY;
+			entry->dirtyLen = 0;
+		}
+	}
+	xArenaUsed = 0;
+	xGeneration++;
 	return NVS_OK;
 }
 
@@ -497,74 +829,322 @@ nvs_err_t NVSOnboard::validKey(const char* key){
 
 
 unsigned int NVSOnboard::numKeys(){
-	if (!isDirty()){
-		return xClean.size();
-	}
-	unsigned int count = xClean.size();
-
-	map<string, nvs_entry_t *>::iterator it = xDirty.begin();
-	while (it != xDirty.end()){
-		  if (xClean.count(it->first) > 0){
-			  if (it->second->type == NVS_TYPE_ERASE){
-				  count--;
-			  }
-		  } else {
-			  if (it->second->type != NVS_TYPE_ERASE){
-				  count++;
-			  }
-		  }
-	      it++;
+	lock(true);
+	unsigned int count = numKeysLocked();
+	unlock();
+	return count;
+}
+
+unsigned int NVSOnboard::numKeysLocked(){
+	unsigned int count = 0;
+	size_t len;
+	const void * value;
+
+	for (unsigned int i = 0; i < xCount; i++){
+		nvs_type_t type = live(&xIndex[i], &len, &value);
+		if ((type != NVS_TYPE_ANY) && (type != NVS_TYPE_ERASE)){
+			count++;
+		}
 	}
 	return count;
 }
 
 bool NVSOnboard::isDirty(){
-	return  !xDirty.empty();
+	lock(true);
+	bool dirty = isDirtyLocked();
+	unlock();
+	return dirty;
+}
+
+bool NVSOnboard::isDirtyLocked(){
+	for (unsigned int i = 0; i < xCount; i++){
+		if (xIndex[i].dirtyType != NVS_TYPE_ANY){
+			return true;
+		}
+	}
+	return false;
 }
 
 bool NVSOnboard::contains(const char *key){
 	nvs_err_t res;
-		res = validKey(key);
-		if (res != NVS_OK){
-			return false;
+	size_t len;
+	const void * value;
+
+	res = validKey(key);
+	if (res != NVS_OK){
+		return false;
+	}
+
+	bool found = false;
+	lock(true);
+	const nvs_index_t * entry = find(key, keyHash(key));
+	if (entry != NULL){
+		nvs_type_t type = live(entry, &len, &value);
+		found = ((type != NVS_TYPE_ANY) && (type != NVS_TYPE_ERASE));
+	}
+	unlock();
+	return found;
+}
+
+
+void NVSOnboard::init(){
+	int bank = -1;
+	uint32_t seq = 0;
+
+    xCount = 0;
+    xArenaUsed = 0;
+    xGeneration++;
+    xBank = 0;
+    xOffset = 0;
+    xSeq = 0;
+    xNeedsCompact = false;
+
+	//Newest bank with a valid snapshot holds the log
+	for (uint32_t b = 0; b < 2; b++){
+		const nvs_batch_t * first = batchAt(b, 0);
+		if (batchValid(first, NVS_BANK_SIZE)){
+			if ((bank < 0) || ((int32_t)(first->seq - seq) > 0)){
+				bank = b;
+				seq = first->seq;
+			}
+		}
+	}
+
+	if (bank < 0){
+		if (loadLegacy()){
+			printf("NVS legacy image loaded, migrating on next commit\n");
 		}
+		return;
+	}
+
+	xBank = bank;
+	replay();
+}
+
+void NVSOnboard::replay(){
+	uint32_t offset = 0;
 
-		if (xDirty.count(key) > 0){
-			return  true;
+	while ((offset + sizeof(nvs_batch_t)) <= NVS_BANK_SIZE){
+		const nvs_batch_t * batch = batchAt(xBank, offset);
+		if (batch->magic == 0xFFFFFFFF){
+			break;	//Erased, end of the log
 		}
-		if (xClean.count(key) > 0){
-			return  true;
+		if (!batchValid(batch, NVS_BANK_SIZE - offset)){
+			printf("ERROR NVS batch at %u is torn\n", offset);
+			xNeedsCompact = true;
+			break;
 		}
+
+		applyBatch(batch, xGeneration);
+
+		xSeq = batch->seq;
+		offset = pageAlign(offset + sizeof(nvs_batch_t) + batch->len);
+	}
+	xOffset = offset;
+}
+
+bool NVSOnboard::loadLegacy(){
+	const uint8_t * mem = (const uint8_t *)(FLASH_READ_START + NVS_SIZE - NVS_LEGACY_SIZE);
+	const nvs_header_t * header = (const nvs_header_t *) mem;
+	const nvs_entry_t * entry = (const nvs_entry_t *) (mem + sizeof(nvs_header_t));
+
+	if ((header->pages < sizeof(nvs_header_t)) || (header->pages > NVS_LEGACY_SIZE)){
 		return false;
+	}
+	if ((header->count * sizeof(nvs_entry_t)) > header->pages){
+		return false;
+	}
+	if (oat_hash((const char *)entry, header->pages - sizeof(nvs_header_t)) != header->hash){
+		return false;
+	}
+	for (uint32_t i=0; i < header->count; i++){
+		putClean(entry[i].key, entry[i].type, entry[i].len, entry[i].value);
+	}
+	//Compact into the bank clear of the legacy image where possible,
+	//as other tasks may read it between flash operations
+	xBank = (NVS_SIZE - NVS_LEGACY_SIZE) / NVS_BANK_SIZE;
+	xNeedsCompact = true;
+	return true;
 }
 
+const nvs_batch_t * NVSOnboard::batchAt(uint32_t bank, uint32_t offset){
+	return (const nvs_batch_t *)(FLASH_READ_START + bank * NVS_BANK_SIZE + offset);
+}
 
-void NVSOnboard::init(){
-	void *mem = (void *)FLASH_READ_START;
-	nvs_header_t * header = (nvs_header_t *) mem;
-    nvs_entry_t * entry = (nvs_entry_t *) ((uint32_t)mem + sizeof(nvs_header_t));
+bool NVSOnboard::batchValid(const nvs_batch_t *batch, uint32_t room){
+	if (batch->magic != NVS_LOG_MAGIC){
+		return false;
+	}
+	if (batch->len > (room - sizeof(nvs_batch_t))){
+		return false;
+	}
+	return (oat_hash((const char *)batch + sizeof(nvs_batch_t), batch->len) == batch->hash);
+}
 
-    xDirty.clear();
-    xClean.clear();
+void NVSOnboard::putClean(const char *key, nvs_type_t type, size_t len, const void *value){
+	uint32_t hash = keyHash(key);
+	nvs_index_t * entry = find(key, hash);
+	if (entry == NULL){
+		entry = insert(hash);
+		if (entry == NULL){
+			printf("ERROR NVS index full\n");
+			return;
+		}
+	}
+	entry->key = key;
+	entry->type = type;
+	entry->len = len;
+	entry->value = value;
+}
 
-    //printf("Loading header %u, %u, %u\n", header->count, header->pages, header->hash);
-    if (header->pages > NVS_SIZE ){
-    	printf("ERROR NVS is corrupt\n");
-    	return;
-    }
+void NVSOnboard::applyBatch(const nvs_batch_t *batch, uint32_t snapGen){
+	const uint8_t * rec = (const uint8_t *)batch + sizeof(nvs_batch_t);
+	const uint8_t * end = rec + batch->len;
 
-	uint32_t hash = oat_hash((const char *)entry, header->pages - sizeof(nvs_header_t));
-	if (hash != header->hash){
-		printf("ERROR NVS Hash Check Failed\n");
-		return;
-	} else {
-		//Hash Passed
-		for (int i=0; i < header->count; i++){
-			xClean[entry[i].key] = &entry[i];
+	while ((rec + sizeof(nvs_record_t)) <= end){
+		const nvs_record_t * r = (const nvs_record_t *) rec;
+		const char * key = (const char *)(rec + sizeof(nvs_record_t));
+		const void * value = rec + sizeof(nvs_record_t) + wordAlign(r->keyLen);
+
+		if (r->type != NVS_TYPE_ERASE){
+			putClean(key, (nvs_type_t) r->type, r->len, value);
+		} else {
+			nvs_index_t * entry = find(key, keyHash(key));
+			if (entry != NULL){
+				if ((entry->dirtyType != NVS_TYPE_ANY) &&
+						((int32_t)(entry->gen - snapGen) > 0)){
+					//Set again since the batch was built, now never commited
+					entry->type = NVS_TYPE_ANY;
+					entry->value = NULL;
+					entry->len = 0;
+					entry->key = (entry->block != NULL) ? (const char *)entry->block : key;
+				} else {
+					remove(entry);
+				}
+			}
+		}
+		rec += recordSize(r->keyLen, r->len);
+	}
+}
+
+uint32_t NVSOnboard::keyHash(const char *key){
+	//FNV-1a
+	uint32_t h = 2166136261u;
+	while (*key){
+		h ^= (uint8_t) *key++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+unsigned int NVSOnboard::lowerBound(uint32_t hash){
+	unsigned int lo = 0;
+	unsigned int hi = xCount;
+	while (lo < hi){
+		unsigned int mid = (lo + hi) / 2;
+		if (xIndex[mid].hash < hash){
+			lo = mid + 1;
+		} else {
+			hi = mid;
 		}
 	}
+	return lo;
+}
 
+nvs_index_t * NVSOnboard::find(const char *key, uint32_t hash){
+	for (unsigned int i = lowerBound(hash); (i < xCount) && (xIndex[i].hash == hash); i++){
+		if (strcmp(xIndex[i].key, key) == 0){
+			return &xIndex[i];
+		}
+	}
+	return NULL;
+}
 
+nvs_index_t * NVSOnboard::insert(uint32_t hash){
+	if (xCount >= NVS_MAX_KEYS){
+		return NULL;
+	}
+	unsigned int i = lowerBound(hash);
+	memmove(&xIndex[i + 1], &xIndex[i], (xCount - i) * sizeof(nvs_index_t));
+	xCount++;
+
+	nvs_index_t * entry = &xIndex[i];
+	entry->hash = hash;
+	entry->key = NULL;
+	entry->value = NULL;
+	entry->block = NULL;
+	entry->len = 0;
+	entry->dirtyLen = 0;
+	entry->type = NVS_TYPE_ANY;
+	entry->dirtyType = NVS_TYPE_ANY;
+	entry->gen = 0;
+	return entry;
+}
+
+void NVSOnboard::remove(nvs_index_t *entry){
+	unsigned int i = entry - xIndex;
+	memmove(&xIndex[i], &xIndex[i + 1], (xCount - i - 1) * sizeof(nvs_index_t));
+	xCount--;
+}
+
+nvs_type_t NVSOnboard::live(const nvs_index_t *entry, size_t *len, const void **value){
+	if (entry->dirtyType != NVS_TYPE_ANY){
+		*len = entry->dirtyLen;
+		*value = dirtyValue(entry);
+		return (nvs_type_t) entry->dirtyType;
+	}
+	*len = entry->len;
+	*value = entry->value;
+	return (nvs_type_t) entry->type;
+}
+
+const void * NVSOnboard::dirtyValue(const nvs_index_t *entry){
+	if (entry->block == NULL){
+		return NULL;
+	}
+	return entry->block + wordAlign(strlen((const char *)entry->block) + 1);
+}
+
+uint8_t * NVSOnboard::arenaAlloc(size_t len){
+	if ((xArenaUsed + len) > NVS_ARENA_SIZE){
+		compactArena();
+	}
+	if ((xArenaUsed + len) > NVS_ARENA_SIZE){
+		return NULL;
+	}
+	uint8_t * block = &xArena[xArenaUsed];
+	xArenaUsed += len;
+	return block;
+}
+
+void NVSOnboard::compactArena(){
+	uint8_t * dst = xArena;
+
+	//Slide blocks still referenced down in address order
+	for (;;){
+		nvs_index_t * next = NULL;
+		for (unsigned int i = 0; i < xCount; i++){
+			nvs_index_t * entry = &xIndex[i];
+			if ((entry->block != NULL) && (entry->block >= dst) &&
+					((next == NULL) || (entry->block < next->block))){
+				next = entry;
+			}
+		}
+		if (next == NULL){
+			break;
+		}
+		size_t size = wordAlign(strlen((const char *)next->block) + 1) +
+				wordAlign(next->dirtyLen);
+		if (next->block != dst){
+			memmove(dst, next->block, size);
+			if (next->key == (const char *)next->block){
+				next->key = (const char *) dst;
+			}
+			next->block = dst;
+		}
+		dst += size;
+	}
+	xArenaUsed = dst - xArena;
 }
 
 /*
@@ -589,54 +1169,103 @@ uint32_t NVSOnboard::oat_hash(const char *s, size_t len){
 
 
 void NVSOnboard::printNVS(){
-	printf("NVS keys: %u, Clean %u Dirty %u\n",
-			numKeys(),
-			xClean.size(),
-			xDirty.size());
+	lock(true);
+	printf("NVS keys: %u, Index %u Arena %u\n",
+			numKeysLocked(),
+			xCount,
+			xArenaUsed);
 
 	int count = 0;
 	int erase = 0;
 
-	map<string, nvs_entry_t *>::iterator it = xClean.begin();
-	while (it != xClean.end()){
-		if (xDirty.count(it->first) == 0){
-			printf("%s [CLEAN] %d\n", it->first.c_str(), it->second->len);
+	for (unsigned int i = 0; i < xCount; i++){
+		const nvs_index_t * entry = &xIndex[i];
+		if (entry->dirtyType == NVS_TYPE_ANY){
+			printf("%s [CLEAN] %d\n", entry->key, entry->len);
+		} else if (entry->dirtyType == NVS_TYPE_ERASE){
+			printf("%s [ERASE] %d\n", entry->key, 0);
+			erase++;
+		} else if (entry->type == NVS_TYPE_ANY){
+			printf("%s [NEW] %d\n", entry->key, entry->dirtyLen);
 		} else {
-			if (xDirty[it->first]->type == NVS_TYPE_ERASE){
-				printf("%s [ERASE] %d\n", it->first.c_str(), 0);
-				erase++;
-			} else {
-				printf("%s [CLEAN] %d\n", it->first.c_str(), it->second->len);
-			}
+			printf("%s [DIRTY] %d\n", entry->key, entry->dirtyLen);
 		}
 		count++;
-		it++;
-	}
-
-	 it = xDirty.begin();
-	while (it != xDirty.end()){
-		if (xClean.count(it->first) == 0){
-			if (it->second->type != NVS_TYPE_ERASE ){
-				printf("%s [NEW] %d\n", it->first.c_str(), it->second->len);
-			} else {
-				printf("%s [ERASE NEW] %d\n", it->first.c_str(), it->second->len);
-				erase++;
-			}
-			count++;
-		}
-		it++;
 	}
 
+	unlock();
 	printf("Entries %d Erase %d Total %d\n", count,  erase, count- erase);
+	printf("Bank %u offset %u, commits %u compactions %u erases %u, programmed %llu written %llu\n",
+			xBank, xOffset, xCommits, xCompactions, xErases,
+			xBytesProgrammed, xBytesWritten);
+	printf("Last commit %u us, max blocked %u us\n", xLastCommitUs, xMaxBlockedUs);
+	printf("Write back %s, commits avoided %u, bytes saved %llu\n",
+			xWriteBack ? "on" : "off", getCommitsAvoided(), getBytesSaved());
 
 }
 
 nvs_err_t NVSOnboard::clear(){
-	nvs_err_t res = rollback();
-	if (res != NVS_OK){
-		return res;
+	//Not while a commit in flight is still to be applied
+#ifdef LIB_FREERTOS_KERNEL
+	if (xCommitSemaphore != NULL){
+		xSemaphoreTake(xCommitSemaphore, portMAX_DELAY);
 	}
-	xClean.clear();
-	return NVS_OK;
+#endif
+	lock(true);
+	nvs_err_t res = rollbackLocked();
+	if (res == NVS_OK){
+		xCount = 0;
+		//Next commit must rewrite the bank without the old keys
+		xNeedsCompact = true;
+	}
+	unlock();
+#ifdef LIB_FREERTOS_KERNEL
+	if (xCommitSemaphore != NULL){
+		xSemaphoreGive(xCommitSemaphore);
+	}
+#endif
+	return res;
+}
+
+
+uint32_t NVSOnboard::getCommits(){
+	return xCommits;
+}
+
+uint32_t NVSOnboard::getCompactions(){
+	return xCompactions;
 }
 
+uint32_t NVSOnboard::getErases(){
+	return xErases;
+}
+
+uint64_t NVSOnboard::getBytesProgrammed(){
+	return xBytesProgrammed;
+}
+
+uint64_t NVSOnboard::getBytesWritten(){
+	return xBytesWritten;
+}
+
+uint32_t NVSOnboard::getLastCommitUs(){
+	return xLastCommitUs;
+}
+
+uint32_t NVSOnboard::getMaxBlockedUs(){
+	return xMaxBlockedUs;
+}
+
+uint32_t NVSOnboard::getCommitsAvoided(){
+	if (xCommitRequests < xCommits){
+		return 0;
+	}
+	return xCommitRequests - xCommits;
+}
+
+uint64_t NVSOnboard::getBytesSaved(){
+	if (xRequestedBytes < xBytesProgrammed){
+		return 0;
+	}
+	return xRequestedBytes - xBytesProgrammed;
+}
@@ -12,14 +12,6 @@
 #include <cstring>
 #include "pico/stdlib.h"
 #include "hardware/flash.h"
-#if CPPUTEST_USE_NEW_MACROS
-   #undef new
-#endif
-#include <map>
-using namespace std;
-#if CPPUTEST_USE_NEW_MACROS
-   #include "CppUTest/MemoryLeakDetectorNewMacros.h"
-#endif
 
 //FreeRTOS Kernel Support
 #ifdef LIB_FREERTOS_KERNEL
@@ -35,8 +27,27 @@ using namespace std;
 #endif
 
 #ifndef NVS_SIZE
-//Size of the NVS Segment. Must be a multiple of 4096
-#define NVS_SIZE 8192//4096
+//Size of the NVS Segment. Must be a multiple of 8192 as it is split
+//into two banks of whole sectors
+#define NVS_SIZE 16384//8192
+#endif
+
+//Records are appended to one bank and compacted into the other when full
+#define NVS_BANK_SIZE (NVS_SIZE / 2)
+
+//Earlier versions wrote a single image to the top 8k of flash
+#define NVS_LEGACY_SIZE 8192
+
+#define NVS_LOG_MAGIC 0x4e56534c
+
+#ifndef NVS_MAX_KEYS
+//Maximum number of keys held in the index
+#define NVS_MAX_KEYS 64
+#endif
+
+#ifndef NVS_ARENA_SIZE
+//Storage for keys and values set but not yet commited
+#define NVS_ARENA_SIZE 4096
 #endif
 
 #ifndef NVS_CORES
@@ -48,6 +59,34 @@ using namespace std;
 #define NVS_WAIT 10000   //usecs
 #endif
 
+#ifndef NVS_PROGRAM_CHUNK
+//Bytes programmed per critical section. Multiple of FLASH_PAGE_SIZE
+#define NVS_PROGRAM_CHUNK FLASH_PAGE_SIZE
+#endif
+
+#ifndef NVS_WRITE_BACK_MS
+//Write back waits for commits to be quiet for this long
+#define NVS_WRITE_BACK_MS 2000
+#endif
+
+#ifndef NVS_WRITE_BACK_MAX_MS
+//Longest write back will hold commits while they keep coming
+#define NVS_WRITE_BACK_MAX_MS 10000
+#endif
+
+#ifndef NVS_WRITE_BACK_BYTES
+//Commits with this many bytes of changes are written straight away
+#define NVS_WRITE_BACK_BYTES (NVS_ARENA_SIZE / 2)
+#endif
+
+#ifndef NVS_WRITE_BACK_STACK
+#define NVS_WRITE_BACK_STACK 1024
+#endif
+
+#ifndef NVS_WRITE_BACK_PRIORITY
+#define NVS_WRITE_BACK_PRIORITY (tskIDLE_PRIORITY + 1)
+#endif
+
 
 //Write and Read address for the base of the NVS region being used
 #define FLASH_WRITE_START (PICO_FLASH_SIZE_BYTES - NVS_SIZE)
@@ -77,7 +116,8 @@ typedef enum {
 	NVS_ERR_INVALID_NAME,
 	NVS_ERR_INVALID_TYPE,
 	NVS_ERR_NOT_ENOUGH_MEM,
-	NVS_ERR_LOCK_FAILED
+	NVS_ERR_LOCK_FAILED,
+	NVS_ERR_WRITE_FAILED
 } nvs_err_t;
 
 //Entry structure used to build a index table in Flash
@@ -89,13 +129,42 @@ typedef struct {
 
 } nvs_entry_t;
 
-//Header for the NVS region
+//Header for the legacy single image NVS region
 typedef struct {
 	uint32_t 	count;
 	uint32_t   pages;
 	uint32_t	hash;
 } nvs_header_t;
 
+//Header for each batch of records appended to a bank.
+//First batch in a bank is a full snapshot of the keys
+typedef struct {
+	uint32_t	magic;
+	uint32_t	seq;		//Commit sequence number
+	uint32_t	len;		//Bytes of records following the header
+	uint32_t	hash;		//Hash of the records
+} nvs_batch_t;
+
+//Record in a batch, followed by key and value each padded to 4 bytes
+typedef struct {
+	uint8_t		type;
+	uint8_t		keyLen;		//Including terminator
+	uint16_t	len;		//Value length
+} nvs_record_t;
+
+//Index entry, one per key. Table is kept sorted on the key hash
+typedef struct {
+	uint32_t	hash;
+	const char *key;		//In flash, or in the arena if never commited
+	const void *value;		//Commited value in flash
+	uint8_t *	block;		//Arena block holding key then new value, NULL if none
+	uint16_t	len;
+	uint16_t	dirtyLen;
+	uint8_t		type;		//NVS_TYPE_ANY if never commited
+	uint8_t		dirtyType;	//NVS_TYPE_ANY if unchanged, NVS_TYPE_ERASE if erased
+	uint32_t	gen;		//Generation of last change
+} nvs_index_t;
+
 class NVSOnboard {
 public:
 	/***
@@ -284,31 +353,81 @@ public:
 	 */
 	nvs_err_t get_blob( const char* key, void* out_value, size_t* length);
 
+	/***
+	 * Read a string without copying it. A commited value is returned
+	 * in place in XIP flash. The pointer stays valid until
+	 * getGeneration changes
+	 * @param key  used for storing the value
+	 * @param value - set to the zero terminated string
+	 * @param length - set to the length including the terminator
+	 * @return NVS_OK if found. See @get for full list of errors
+	 */
+	nvs_err_t view_str ( const char* key, const char** value, size_t* length);
+
+	/***
+	 * Read a blob without copying it. A commited value is returned
+	 * in place in XIP flash. The pointer stays valid until
+	 * getGeneration changes
+	 * @param key  used for storing the value
+	 * @param value - set to the blob
+	 * @param length - set to the length of the blob
+	 * @return NVS_OK if found. See @get for full list of errors
+	 */
+	nvs_err_t view_blob( const char* key, const void** value, size_t* length);
+
+	/***
+	 * Generation of the NVS contents. Changes on every set, erase,
+	 * commit or rollback, after which views must be taken again
+	 * @return generation
+	 */
+	uint32_t getGeneration();
+
 	/***
 	 * Erase a Key Value pair. Note does not commit and can be rolled back
 	 * @param key to delete
 	 * @return NVS_OK if completed.
-	 * NVS_ERR_NOT_ENOUGH_MEM if malloc fails to build erase record
+	 * NVS_ERR_NOT_FOUND if key is not present
+	 * NVS_ERR_LOCK_FAILED if another task holds the NVS for too long
 	 */
 	nvs_err_t erase_key( const char* key);
 
 	/***
 	 * Erase all keys value pairs. Note does not commit and can be rolled back
 	 * @return  NVS_OK if completed
-	 * NVS_ERR_NOT_ENOUGH_MEM if malloc fails to build erase record
+	 * NVS_ERR_LOCK_FAILED if another task holds the NVS for too long
 	 */
 	nvs_err_t erase_all();
 
 	/***
-	 * Commit current state of the NVS to Flash. Will turn off interupts
-	 * and halt any other running processes while this happens.
-	 * This applies to both cores.
+	 * Commit current state of the NVS to Flash. Changed keys are appended
+	 * to the log in the active bank. When the bank is full the live keys
+	 * are compacted into the other bank, which is the only time a sector
+	 * is erased. Flash is written a sector erase or a page program at a
+	 * time, turning off interupts and halting the other core only for
+	 * each one, so other tasks run in between.
 	 * @return NVS_OK if completed
-	 * NVS_ERR_NOT_ENOUGH_MEM if malloc fails or page size is larger than NVS_SIZE
+	 * NVS_ERR_NOT_ENOUGH_MEM if malloc fails or keys are larger than NVS_BANK_SIZE
+	 * NVS_ERR_WRITE_FAILED if the batch did not read back, changes stay dirty
 	 *
+	 * With write back on, the write is left to a background task which
+	 * waits for commits to go quiet, so a burst becomes one batch. Changes
+	 * are lost if power fails first; use flush for keys that must survive.
 	 */
 	nvs_err_t commit();
 
+	/***
+	 * Commit now, even with write back on
+	 * @return as commit
+	 */
+	nvs_err_t flush();
+
+	/***
+	 * Turn write back on or off. Turning it off flushes any pending commit
+	 * @param on
+	 * @return true if write back is on
+	 */
+	bool setWriteBack(bool on);
+
 	/***
 	 * Rollback any changes which have not been commited
 	 * @return NVS_OK always
@@ -348,6 +467,75 @@ public:
 	 */
 	void printNVS();
 
+	/***
+	 * Number of commits written to flash
+	 * @return count
+	 */
+	uint32_t getCommits();
+
+	/***
+	 * Number of commits that compacted into the other bank
+	 * @return count
+	 */
+	uint32_t getCompactions();
+
+	/***
+	 * Number of flash sectors erased
+	 * @return count
+	 */
+	uint32_t getErases();
+
+	/***
+	 * Bytes programmed into flash, including headers and page padding
+	 * @return bytes
+	 */
+	uint64_t getBytesProgrammed();
+
+	/***
+	 * Bytes of changed records committed. Programmed bytes divided
+	 * by this is the write amplification
+	 * @return bytes
+	 */
+	uint64_t getBytesWritten();
+
+	/***
+	 * Duration of the last commit
+	 * @return micro seconds
+	 */
+	uint32_t getLastCommitUs();
+
+	/***
+	 * Longest time interupts and the other core were held off by a
+	 * single flash operation in any commit
+	 * @return micro seconds
+	 */
+	uint32_t getMaxBlockedUs();
+
+	/***
+	 * Commit calls that did not need their own flash write
+	 * @return count
+	 */
+	uint32_t getCommitsAvoided();
+
+	/***
+	 * Bytes that separate commits would have programmed, less those
+	 * actually programmed
+	 * @return bytes
+	 */
+	uint64_t getBytesSaved();
+
+	/***
+	 * Erase and program flash one sector or one NVS_PROGRAM_CHUNK at a
+	 * time. Interupts and the other core are held off only for each
+	 * operation and other tasks may run between them.
+	 * @param offset - flash offset to program, page aligned
+	 * @param data - to program
+	 * @param len - multiple of FLASH_PAGE_SIZE
+	 * @param eraseLen - bytes to erase from offset first, whole sectors, 0 for none
+	 * @return longest time blocked by one operation in micro seconds
+	 */
+	static uint32_t flashWrite(uint32_t offset, const uint8_t *data, size_t len, size_t eraseLen);
+
 protected:
 	/***
 	 * Constructor
@@ -356,7 +544,7 @@ protected:
 	NVSOnboard(bool cleanNVS=false);
 
 	/***
-	 * Load the clean list from the flash
+	 * Load the clean list from the newest valid bank in flash
 	 */
 	void init();
 
@@ -387,6 +575,18 @@ protected:
 	 */
 	nvs_err_t get(const char* key,  nvs_type_t type, size_t * len, void * out_value);
 
+	/***
+	 * Get a pointer to the value associated with the key, without copying
+	 * @param key that value was stored with
+	 * @param type of the value to be returned. Will be checked against stored value
+	 * @param len set to the length of the value
+	 * @param out_value set to the value, in flash if commited
+	 * @return NVS_OK if returned ok
+	 * NVS_ERR_NOT_FOUND if no value found
+	 * NVS_ERR_INVALID_TYPE if types do not match
+	 */
+	nvs_err_t view(const char* key,  nvs_type_t type, size_t * len, const void ** out_value);
+
 
 private:
 	static NVSOnboard * pSingleton;
@@ -399,11 +599,206 @@ private:
 	nvs_err_t validKey(const char* key);
 
 	/***
-	 * Calculate the size needed to write the NVS
-	 * Will be a multiple of 256
-	 * @return mem size
+	 * Replay the batches in the active bank into the clean list
+	 */
+	void replay();
+
+	/***
+	 * Load an image written by earlier versions, to be migrated
+	 * into the log on the next commit
+	 * @return true if found
+	 */
+	bool loadLegacy();
+
+	/***
+	 * Batch header in flash
+	 * @param bank
+	 * @param offset within bank
+	 * @return header in XIP flash
 	 */
-	size_t pagesSize();
+	static const nvs_batch_t * batchAt(uint32_t bank, uint32_t offset);
+
+	/***
+	 * Check batch header and hash
+	 * @param batch
+	 * @param room - bytes left in bank from batch
+	 * @return true if valid
+	 */
+	bool batchValid(const nvs_batch_t *batch, uint32_t room);
+
+	/***
+	 * Size of a record in a batch
+	 * @param keyLen - including terminator
+	 * @param len - value length
+	 * @return bytes including padding
+	 */
+	static size_t recordSize(size_t keyLen, size_t len);
+
+	/***
+	 * Write a record into a batch
+	 * @param buf - to write to
+	 * @param key
+	 * @param type
+	 * @param len - value length
+	 * @param value
+	 * @return bytes used
+	 */
+	static size_t packRecord(uint8_t *buf, const char *key, nvs_type_t type,
+			size_t len, const void *value);
+
+	/***
+	 * Bytes of records needed to write the changed keys
+	 * @return bytes
+	 */
+	size_t deltaSize();
+
+	/***
+	 * Bytes of records needed to write all live keys
+	 * @return bytes, 0 if corrupt
+	 */
+	size_t snapshotSize();
+
+	/***
+	 * Add or replace a clean entry whose key and value are in flash
+	 */
+	void putClean(const char *key, nvs_type_t type, size_t len, const void *value);
+
+	/***
+	 * Apply a batch in flash to the index. Keys changed after snapGen
+	 * keep their uncommited change
+	 * @param batch - in XIP flash
+	 * @param snapGen - generation when the batch was built
+	 */
+	void applyBatch(const nvs_batch_t *batch, uint32_t snapGen);
+
+	/***
+	 * Write dirty keys as one batch, serialised against other commits
+	 * @return as commit
+	 */
+	nvs_err_t writeBatch();
+
+	/***
+	 * Build and write the batch then apply it. Called locked, returns unlocked
+	 * @return as commit
+	 */
+	nvs_err_t writeLocked();
+
+	/***
+	 * Take the index semaphore
+	 * @param forever - wait until taken rather than NVS_WAIT
+	 * @return false if timed out
+	 */
+	bool lock(bool forever = false);
+
+	/***
+	 * Rollback with the index semaphore held
+	 * @return NVS_OK always
+	 */
+	nvs_err_t rollbackLocked();
+
+	/***
+	 * Number of live keys with the index semaphore held
+	 * @return count
+	 */
+	unsigned int numKeysLocked();
+
+	/***
+	 * Any uncommited change, with the index semaphore held
+	 * @return true if dirty
+	 */
+	bool isDirtyLocked();
+
+	/***
+	 * Give the index semaphore
+	 */
+	void unlock();
+
+#ifdef LIB_FREERTOS_KERNEL
+	/***
+	 * Write back task, writes once commits go quiet
+	 * @param pvParameters - NVSOnboard
+	 */
+	static void writeBackTask(void *pvParameters);
+#endif
+
+	/***
+	 * Mark an entry erased, or drop it if never commited
+	 * @param entry
+	 */
+	void eraseEntry(nvs_index_t *entry);
+
+	/***
+	 * Hash of a key, FNV-1a
+	 * @param key
+	 * @return hash
+	 */
+	static uint32_t keyHash(const char *key);
+
+	/***
+	 * First index position with a hash not less than hash
+	 * @param hash
+	 * @return position
+	 */
+	unsigned int lowerBound(uint32_t hash);
+
+	/***
+	 * Find entry for a key
+	 * @param key
+	 * @param hash - keyHash of key
+	 * @return entry or NULL
+	 */
+	nvs_index_t * find(const char *key, uint32_t hash);
+
+	/***
+	 * Insert an empty entry in hash order
+	 * @param hash
+	 * @return entry or NULL if index is full
+	 */
+	nvs_index_t * insert(uint32_t hash);
+
+	/***
+	 * Remove entry from the index
+	 * @param entry
+	 */
+	void remove(nvs_index_t *entry);
+
+	/***
+	 * Current value of an entry, uncommited if changed
+	 * @param entry
+	 * @param len - set to value length
+	 * @param value - set to value
+	 * @return type, NVS_TYPE_ERASE if erased
+	 */
+	static nvs_type_t live(const nvs_index_t *entry, size_t *len, const void **value);
+
+	/***
+	 * Uncommited value in the arena
+	 * @param entry
+	 * @return value or NULL
+	 */
+	static const void * dirtyValue(const nvs_index_t *entry);
+
+	/***
+	 * Allocate from the arena, compacting it if needed
+	 * @param len - multiple of 4
+	 * @return block or NULL if full
+	 */
+	uint8_t * arenaAlloc(size_t len);
+
+	/***
+	 * Slide blocks still in use to the start of the arena
+	 */
+	void compactArena();
+
+	/***
+	 * Run one flash erase or program with interupts and the other core
+	 * held off
+	 * @param offset - flash offset
+	 * @param data - to program, NULL to erase
+	 * @param len - bytes to erase or program
+	 * @return micro seconds blocked
+	 */
+	static uint32_t flashOp(uint32_t offset, const uint8_t *data, size_t len);
 
 	/***
 	 * Simple has function used to check if flash is corrupt
@@ -413,11 +808,37 @@ private:
 	 */
 	uint32_t oat_hash(const char *s, size_t len);
 
-	map<string, nvs_entry_t *> xDirty;
-	map<string, nvs_entry_t *> xClean;
+	nvs_index_t xIndex[NVS_MAX_KEYS];
+	unsigned int xCount = 0;
+
+	uint8_t xArena[NVS_ARENA_SIZE] __attribute__((aligned(4)));
+	size_t xArenaUsed = 0;
+
+	//Bumped whenever a view may have moved
+	volatile uint32_t xGeneration = 0;
+
+	uint32_t xBank = 0;			//Bank being appended to
+	uint32_t xOffset = 0;		//Next free page in bank
+	uint32_t xSeq = 0;			//Sequence of last batch
+	bool xNeedsCompact = false;	//Bank is torn or holds a legacy image
+
+	uint32_t xCommits = 0;
+	uint32_t xCompactions = 0;
+	uint32_t xErases = 0;
+	uint64_t xBytesProgrammed = 0;
+	uint64_t xBytesWritten = 0;
+	uint32_t xLastCommitUs = 0;
+	uint32_t xMaxBlockedUs = 0;
+	uint32_t xCommitRequests = 0;
+	uint64_t xRequestedBytes = 0;
+
+	volatile bool xWriteBack = false;
+	volatile bool xCommitting = false;	//Batch being written unlocked
 
 #ifdef LIB_FREERTOS_KERNEL
 	SemaphoreHandle_t xWriteSemaphore = NULL;
+	SemaphoreHandle_t xCommitSemaphore = NULL;
+	TaskHandle_t xWriteBackTask = NULL;
 #endif
 
 };
@@ -0,0 +1,339 @@
+/*
+ * DNSCache.cpp
+ *
+ * Resolver shared by all transports. Answers are cached for a time to live,
+ * failures are cached for a shorter time, and concurrent lookups of the same
+ * host wait on the one query in flight. An answer close to expiry is returned
+ * straight away while a refresh runs in the background.
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#include "DNSCache.h"
+#include "Transport.h"
+#include "pico/cyw43_arch.h"
+#include <string.h>
+
+DNSCache * DNSCache::pSingleton = NULL;
+
+/***
+ * Get the single resolver
+ * @return resolver
+ */
+DNSCache * DNSCache::getInstance(){
+	if (DNSCache::pSingleton == NULL) {
+		DNSCache::pSingleton = new DNSCache();
+	}
+	return DNSCache::pSingleton;
+}
+
+/***
+ * Constructor
+ */
+DNSCache::DNSCache() {
+	memset(xEntries, 0, sizeof(xEntries));
+	xLock = xSemaphoreCreateMutex();
+	xDone = xEventGroupCreate();
+}
+
+/***
+ * Destructor
+ */
+DNSCache::~DNSCache() {
+	vSemaphoreDelete(xLock);
+	vEventGroupDelete(xDone);
+}
+
+/***
+ * Resolve host name to an address
+ * @param host - server name
+ * @param addr - set to the address
+ * @param waitMs - longest to wait for a lookup
+ * @return true if resolved
+ */
+bool DNSCache::resolve(const char * host, ip_addr_t * addr, uint32_t waitMs){
+	uint32_t start = Transport::getTime();
+	bool ok = false;
+	bool valid;
+	bool failed;
+	bool refresh = false;
+	bool ask = false;
+
+	if (strlen(host) >= DNS_CACHE_HOST_LEN){
+		LogError(("Host name too long for DNS cache: %s", host));
+		return false;
+	}
+
+	xSemaphoreTake(xLock, portMAX_DELAY);
+	int slot = find(host);
+	if (slot >= 0){
+		dns_entry_t *e = &xEntries[slot];
+		e->lastUsed = ++xUseCount;
+
+		//Answer fields are written by the lwIP call back
+		taskENTER_CRITICAL();
+		int32_t remaining = (int32_t)(e->expires - start);
+		valid = (e->state == DNSValid) && (remaining > 0);
+		failed = (e->state == DNSFailed) && (remaining > 0);
+		if (valid){
+			memcpy(addr, &e->addr, sizeof(ip_addr_t));
+			if ((remaining < DNS_CACHE_REFRESH_MS) && !e->refreshing){
+				e->refreshing = true;
+				refresh = true;
+			}
+		}
+		taskEXIT_CRITICAL();
+
+		if (valid){
+			xHits++;
+			if (refresh){
+				xRefreshes++;
+			}
+			xSemaphoreGive(xLock);
+			if (refresh){
+				query(slot, host);
+			}
+			timed(Transport::getTime() - start);
+			return true;
+		}
+
+		if (failed){
+			xNegativeHits++;
+			xSemaphoreGive(xLock);
+			timed(Transport::getTime() - start);
+			return false;
+		}
+	} else {
+		slot = allocate(host);
+		if (slot < 0){
+			xSemaphoreGive(xLock);
+			LogError(("DNS cache full of pending lookups"));
+			return false;
+		}
+	}
+
+	//Join a lookup already in flight, otherwise start one
+	dns_entry_t *e = &xEntries[slot];
+	EventBits_t bit = (1 << slot);
+	xMisses++;
+	if (e->state != DNSPending){
+		xEventGroupClearBits(xDone, bit);
+		taskENTER_CRITICAL();
+		e->state = DNSPending;
+		taskEXIT_CRITICAL();
+		ask = true;
+	}
+	xSemaphoreGive(xLock);
+
+	//lwIP is called without our lock so its call back never waits on it
+	if (ask){
+		query(slot, host);
+	}
+
+	xEventGroupWaitBits(xDone, bit, pdFALSE, pdTRUE, pdMS_TO_TICKS(waitMs));
+
+	xSemaphoreTake(xLock, portMAX_DELAY);
+	taskENTER_CRITICAL();
+	if ((e->state == DNSValid) && (strcmp(e->host, host) == 0)){
+		memcpy(addr, &e->addr, sizeof(ip_addr_t));
+		ok = true;
+	}
+	taskEXIT_CRITICAL();
+	xSemaphoreGive(xLock);
+
+	timed(Transport::getTime() - start);
+	if (!ok){
+		LogError(("DNS lookup failed: %s", host));
+	}
+	return ok;
+}
+
+/***
+ * Drop any cached answer for host, for example after connect fails
+ * @param host - server name
+ */
+void DNSCache::forget(const char * host){
+	xSemaphoreTake(xLock, portMAX_DELAY);
+	int slot = find(host);
+	if (slot >= 0){
+		taskENTER_CRITICAL();
+		if ((xEntries[slot].state != DNSPending) && !xEntries[slot].refreshing){
+			xEntries[slot].state = DNSEmpty;
+		}
+		taskEXIT_CRITICAL();
+	}
+	xSemaphoreGive(xLock);
+}
+
+/***
+ * Find the entry for host. Lock must be held
+ * @return index or -1
+ */
+int DNSCache::find(const char * host){
+	for (int i = 0; i < DNS_CACHE_SLOTS; i++){
+		if ((xEntries[i].state != DNSEmpty) && (strcmp(xEntries[i].host, host) == 0)){
+			return i;
+		}
+	}
+	return -1;
+}
+
+/***
+ * Take an empty or least recently used slot. Lock must be held
+ * @return index or -1 if all are pending
+ */
+int DNSCache::allocate(const char * host){
+	int slot = -1;
+	for (int i = 0; i < DNS_CACHE_SLOTS; i++){
+		dns_entry_t *e = &xEntries[i];
+		//A query in flight will write back to its slot
+		if ((e->state == DNSPending) || e->refreshing){
+			continue;
+		}
+		if (e->state == DNSEmpty){
+			slot = i;
+			break;
+		}
+		if ((slot < 0) || (e->lastUsed < xEntries[slot].lastUsed)){
+			slot = i;
+		}
+	}
+	if (slot >= 0){
+		dns_entry_t *e = &xEntries[slot];
+		//A late call back may compare the host
+		taskENTER_CRITICAL();
+		strcpy(e->host, host);
+		e->state = DNSEmpty;
+		e->refreshing = false;
+		taskEXIT_CRITICAL();
+		e->lastUsed = ++xUseCount;
+	}
+	return slot;
+}
+
+/***
+ * Start a query for the slot. Lock must not be held
+ * @param slot - index
+ * @param host - server name the slot was set up for
+ */
+void DNSCache::query(int slot, const char * host){
+	ip_addr_t addr;
+
+	cyw43_arch_lwip_begin();
+	err_t res = dns_gethostbyname(host, &addr,
+			DNSCache::dnsCB, (void *)(intptr_t)slot);
+	cyw43_arch_lwip_end();
+
+	if (res == ERR_OK){
+		//Still valid in the lwIP table, no call back will follow
+		answer(slot, host, &addr);
+	} else if (res != ERR_INPROGRESS){
+		answer(slot, host, NULL);
+	}
+}
+
+/***
+ * Record the answer for a slot. Never blocks, as it is called on the
+ * lwIP thread
+ * @param slot - index
+ * @param name - server name queried
+ * @param addr - address or NULL on failure
+ */
+void DNSCache::answer(int slot, const char * name, const ip_addr_t * addr){
+	dns_entry_t *e = &xEntries[slot];
+	uint32_t now = Transport::getTime();
+	bool match;
+
+	taskENTER_CRITICAL();
+	//Slot may have been reused for another host
+	match = (strcmp(e->host, name) == 0);
+	if (match){
+		if (addr != NULL){
+			memcpy(&e->addr, addr, sizeof(ip_addr_t));
+			e->state = DNSValid;
+			e->expires = now + DNS_CACHE_TTL_MS;
+		} else if (!(e->refreshing && (e->state == DNSValid))){
+			//A failed refresh keeps the old answer until it expires
+			e->state = DNSFailed;
+			e->expires = now + DNS_CACHE_NEG_TTL_MS;
+		}
+		e->refreshing = false;
+	}
+	taskEXIT_CRITICAL();
+
+	if (match){
+		xEventGroupSetBits(xDone, (1 << slot));
+	}
+}
+
+/***
+ * Call back from lwIP when a query completes
+ * @param name - server name
+ * @param ipaddr - address or NULL on failure
+ * @param callback_arg - slot index
+ */
+void DNSCache::dnsCB(const char *name, const ip_addr_t *ipaddr, void *callback_arg){
+	DNSCache *self = DNSCache::getInstance();
+	int slot = (int)(intptr_t)callback_arg;
+
+	self->answer(slot, name, ipaddr);
+}
+
+/***
+ * Record a lookup time
+ * @param ms
+ */
+void DNSCache::timed(uint32_t ms){
+	xLastLookupMs = ms;
+	if (ms > xMaxLookupMs){
+		xMaxLookupMs = ms;
+	}
+}
+
+/***
+ * Lookups answered from the cache
+ * @return count
+ */
+uint32_t DNSCache::getHits(){
+	return xHits;
+}
+
+/***
+ * Lookups that waited for a query
+ * @return count
+ */
+uint32_t DNSCache::getMisses(){
+	return xMisses;
+}
+
+/***
+ * Lookups answered by a cached failure
+ * @return count
+ */
+uint32_t DNSCache::getNegativeHits(){
+	return xNegativeHits;
+}
+
+/***
+ * Background refreshes started
+ * @return count
+ */
+uint32_t DNSCache::getRefreshes(){
+	return xRefreshes;
+}
+
+/***
+ * Time the last lookup took
+ * @return milliseconds
+ */
+uint32_t DNSCache::getLastLookupMs(){
+	return xLastLookupMs;
+}
+
+/***
+ * Longest time a lookup took
+ * @return milliseconds
+ */
+uint32_t DNSCache::getMaxLookupMs(){
+	return xMaxLookupMs;
+}
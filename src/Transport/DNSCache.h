@@ -0,0 +1,192 @@
+/*
+ * DNSCache.h
+ *
+ * Resolver shared by all transports. Answers are cached for a time to live,
+ * failures are cached for a shorter time, and concurrent lookups of the same
+ * host wait on the one query in flight. An answer close to expiry is returned
+ * straight away while a refresh runs in the background.
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#ifndef DNSCACHE_H_
+#define DNSCACHE_H_
+
+extern "C" {
+#include <FreeRTOS.h>
+#include <semphr.h>
+#include <event_groups.h>
+
+#include "lwip/ip_addr.h"
+#include "lwip/dns.h"
+}
+
+#include <stdint.h>
+
+#ifndef DNS_CACHE_SLOTS
+#define DNS_CACHE_SLOTS 4 //At most 24, one event bit each
+#endif
+
+#ifndef DNS_CACHE_HOST_LEN
+#define DNS_CACHE_HOST_LEN 80
+#endif
+
+//lwIP does not pass the record TTL up, it does apply it to its own table
+#ifndef DNS_CACHE_TTL_MS
+#define DNS_CACHE_TTL_MS 300000
+#endif
+
+#ifndef DNS_CACHE_NEG_TTL_MS
+#define DNS_CACHE_NEG_TTL_MS 10000
+#endif
+
+//Refresh in the background when this close to expiry
+#ifndef DNS_CACHE_REFRESH_MS
+#define DNS_CACHE_REFRESH_MS 30000
+#endif
+
+typedef enum {
+	DNSEmpty,
+	DNSPending,
+	DNSValid,
+	DNSFailed
+} dns_entry_state_t;
+
+typedef struct {
+	char 				host[DNS_CACHE_HOST_LEN];
+	ip_addr_t 			addr;
+	dns_entry_state_t 	state;
+	bool 				refreshing;
+	uint32_t 			expires;
+	uint32_t 			lastUsed;
+} dns_entry_t;
+
+class DNSCache {
+public:
+	/***
+	 * Get the single resolver
+	 * @return resolver
+	 */
+	static DNSCache * getInstance();
+
+	/***
+	 * Resolve host name to an address
+	 * @param host - server name
+	 * @param addr - set to the address
+	 * @param waitMs - longest to wait for a lookup
+	 * @return true if resolved
+	 */
+	bool resolve(const char * host, ip_addr_t * addr, uint32_t waitMs);
+
+	/***
+	 * Drop any cached answer for host, for example after connect fails
+	 * @param host - server name
+	 */
+	void forget(const char * host);
+
+	/***
+	 * Lookups answered from the cache
+	 * @return count
+	 */
+	uint32_t getHits();
+
+	/***
+	 * Lookups that waited for a query
+	 * @return count
+	 */
+	uint32_t getMisses();
+
+	/***
+	 * Lookups answered by a cached failure
+	 * @return count
+	 */
+	uint32_t getNegativeHits();
+
+	/***
+	 * Background refreshes started
+	 * @return count
+	 */
+	uint32_t getRefreshes();
+
+	/***
+	 * Time the last lookup took
+	 * @return milliseconds
+	 */
+	uint32_t getLastLookupMs();
+
+	/***
+	 * Longest time a lookup took
+	 * @return milliseconds
+	 */
+	uint32_t getMaxLookupMs();
+
+private:
+	/***
+	 * Constructor
+	 */
+	DNSCache();
+
+	/***
+	 * Destructor
+	 */
+	virtual ~DNSCache();
+
+	/***
+	 * Find the entry for host. Lock must be held
+	 * @return index or -1
+	 */
+	int find(const char * host);
+
+	/***
+	 * Take an empty or least recently used slot. Lock must be held
+	 * @return index or -1 if all are pending
+	 */
+	int allocate(const char * host);
+
+	/***
+	 * Start a query for the slot. Lock must not be held
+	 * @param slot - index
+	 * @param host - server name the slot was set up for
+	 */
+	void query(int slot, const char * host);
+
+	/***
+	 * Record the answer for a slot. Never blocks, as it is called on the
+	 * lwIP thread
+	 * @param slot - index
+	 * @param name - server name queried
+	 * @param addr - address or NULL on failure
+	 */
+	void answer(int slot, const char * name, const ip_addr_t * addr);
+
+	/***
+	 * Call back from lwIP when a query completes
+	 * @param name - server name
+	 * @param ipaddr - address or NULL on failure
+	 * @param callback_arg - slot index
+	 */
+	static void dnsCB(const char *name, const ip_addr_t *ipaddr, void *callback_arg);
+
+	/***
+	 * Record a lookup time
+	 * @param ms
+	 */
+	void timed(uint32_t ms);
+
+	static DNSCache * pSingleton;
+
+	dns_entry_t xEntries[DNS_CACHE_SLOTS];
+	uint32_t xUseCount = 0;
+
+	SemaphoreHandle_t xLock = NULL;
+	EventGroupHandle_t xDone = NULL;
+
+	uint32_t xHits = 0;
+	uint32_t xMisses = 0;
+	uint32_t xNegativeHits = 0;
+	uint32_t xRefreshes = 0;
+	uint32_t xLastLookupMs = 0;
+	uint32_t xMaxLookupMs = 0;
+};
+
+#endif /* DNSCACHE_H_ */
@@ -21,14 +21,17 @@
  * Constructor
  */
 TCPTransport::TCPTransport(){
-	xHostDNSFound = xSemaphoreCreateBinary(  );
+	// NOP
 }
 
 /***
  * Destructor
  */
 TCPTransport::~TCPTransport() {
-	// NOP
+	if (xWatchTask != NULL){
+		vTaskDelete(xWatchTask);
+		xWatchTask = NULL;
+	}
 }
 
 
@@ -66,11 +69,24 @@ int32_t TCPTransport::transRead(void * pBuffer, size_t bytesToRecv){
 
 	dataIn = read(xSock, (uint8_t *)pBuffer, bytesToRecv);
 
+	//Peer closed, report an error so MQTT reconnects. No rearm as the
+	//socket would stay readable and wake the watcher for ever
+	if ((dataIn == 0) && (bytesToRecv > 0)){
+		LogInfo(("Socket closed by peer"));
+		return -1;
+	}
+
 	if (dataIn < 0){
-		if (errno == 0){
+		if ((errno == 0) || (errno == EWOULDBLOCK) || (errno == EAGAIN)){
 			dataIn = 0;
 		}
 	}
+	if (dataIn == 0){
+		xEmptyReads++;
+	}
+
+	//Reader has looked, watch for whatever comes next
+	rearm();
 
 	//printf("Read(%d)=%d\n", bytesToRecv, dataIn);
 
@@ -88,17 +104,32 @@ int32_t TCPTransport::transRead(void * pBuffer, size_t bytesToRecv){
  * @return true on success
  */
 bool TCPTransport::transConnect(const char * host, uint16_t port){
-	err_t res = dns_gethostbyname(host, &xHost, TCPTransport::dnsCB, this);
+	uint32_t start = Transport::getTime();
 
 	strcpy(xHostName, host);
 	xPort = port;
 
-	if (xSemaphoreTake(xHostDNSFound, TCP_TRANSPORT_WAIT) != pdTRUE){
-		LogError(("DNS Timeout on Connect: %s, %d", host, res));
-		//return false;
+	if (isTimeUp()){
+		LogError(("No time left to connect to %s", host));
+		return false;
+	}
+
+	xDNSOk = DNSCache::getInstance()->resolve(host, &xHost,
+			getTimeLeft(TCP_TRANSPORT_WAIT));
+	xDNSTimeMs = Transport::getTime() - start;
+	if (!xDNSOk){
+		LogError(("DNS failed on Connect: %s", host));
+		return false;
 	}
 
-	return transConnect();
+	start = Transport::getTime();
+	bool ok = transConnect();
+	xConnectTimeMs = Transport::getTime() - start;
+	if (!ok){
+		//Address may have moved, look it up again next time
+		DNSCache::getInstance()->forget(host);
+	}
+	return ok;
 }
 
 
@@ -107,9 +138,6 @@ bool TCPTransport::transConnect(const char * host, uint16_t port){
  * @return true if socket openned
  */
 bool TCPTransport::transConnect(){
-	struct sockaddr_in serv_addr;
-
-
 	xSock = socket(AF_INET, SOCK_STREAM, 0);
 	if (xSock < 0){
 		LogError(("ERROR opening socket\n"));
@@ -117,21 +145,27 @@ bool TCPTransport::transConnect(){
 	}
 
 
-	memset(&serv_addr,0,sizeof(serv_addr));
-	serv_addr.sin_family = AF_INET;
-	serv_addr.sin_port = htons(xPort);
-	memcpy(&serv_addr.sin_addr.s_addr, &xHost, sizeof(xHost));
-
-	int res = connect(xSock,(struct sockaddr *)&serv_addr,sizeof(serv_addr));
-	if (res < 0){
+	if (!connectSocket(xSock, &xHost, xPort)){
 		char *s = ipaddr_ntoa(&xHost);
-		LogError(("ERROR connecting %d to %s port %d\n",res, s, xPort));
+		LogError(("ERROR connecting to %s port %d\n", s, xPort));
 		return false;
 	}
 
 	int nonblock=1;
 	ioctlsocket(xSock, FIONBIO, &nonblock);
 
+	if ((pRecvCB != NULL) && (xWatchTask == NULL)){
+		xTaskCreate(
+			TCPTransport::vWatchTask,
+			"TCPWatch",
+			TCP_TRANSPORT_WATCH_STACK,
+			( void * ) this,
+			uxTaskPriorityGet(NULL),
+			&xWatchTask
+		);
+	}
+	rearm();
+
 	LogInfo(("Connect success\n"));
 	return true;
 }
@@ -153,35 +187,119 @@ int TCPTransport::status(){
  * @return true on success
  */
 bool TCPTransport::transClose(){
-	closesocket(xSock);
+	if (xSock >= 0){
+		closesocket(xSock);
+		xSock = -1;
+	}
 	return true;
 }
 
 /***
- * Call back function for the DNS lookup
- * @param name - server name
- * @param ipaddr - resulting IP address
- * @param callback_arg - poiter to TCPTransport object
+ * Call back when data arrives on the socket, from a watcher task
+ * blocked in select. Fires once, then again after the next read,
+ * so the reader is woken rather than polling. Set before connect
+ * @param cb - callback, NULL for none
+ * @param arg - passed to callback
+ */
+void TCPTransport::setRecvCallback(TransportRecvCallback cb, void *arg){
+	pRecvArg = arg;
+	pRecvCB = cb;
+}
+
+/***
+ * Number of times the receive callback has fired
+ * @return
+ */
+uint32_t TCPTransport::getRecvWakeups(){
+	return xRecvWakeups;
+}
+
+/***
+ * Number of reads that found no data waiting
+ * @return
  */
-void TCPTransport::dnsCB(const char *name, const ip_addr_t *ipaddr, void *callback_arg){
-	TCPTransport *self = (TCPTransport *) callback_arg;
-	self->dnsFound(name, ipaddr, callback_arg);
+uint32_t TCPTransport::getEmptyReads(){
+	return xEmptyReads;
 }
 
+/***
+ * Allow the watcher to wait for the next data
+ */
+void TCPTransport::rearm(){
+	if (xWatchTask != NULL){
+		xTaskNotifyGive(xWatchTask);
+	}
+}
 
 /***
- * Called when DNS is returned
- * @param name - server name
- * @param ipaddr - ip address of server
- * @param callback_arg - this TCPtransport object
+ * Watcher task entry
+ * @param pvParameters - TCPTransport
  */
-void TCPTransport::dnsFound(const char *name, const ip_addr_t *ipaddr, void *callback_arg){
-	memcpy(&xHost, ipaddr, sizeof(xHost));
+void TCPTransport::vWatchTask(void *pvParameters){
+	TCPTransport *self = (TCPTransport *) pvParameters;
+	self->watch();
+}
 
-	LogInfo(("DNS Found %s copied to xHost %s\n", ipaddr_ntoa(ipaddr), ipaddr_ntoa(&xHost)));
-	xSemaphoreGiveFromISR(xHostDNSFound, NULL );
+/***
+ * Watcher loop, block in select until the socket is readable
+ */
+void TCPTransport::watch(){
+	fd_set readSet;
+	struct timeval tv;
+
+	for (;;){
+		//Armed by connect or by the reader
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+		bool fired = false;
+		while (!fired){
+			int sock = xSock;
+			if (sock < 0){
+				break;
+			}
+			FD_ZERO(&readSet);
+			FD_SET(sock, &readSet);
+			tv.tv_sec = TCP_TRANSPORT_SELECT_MS / 1000;
+			tv.tv_usec = (TCP_TRANSPORT_SELECT_MS % 1000) * 1000;
+
+			//Timeout only guards against a close not waking select
+			int res = select(sock + 1, &readSet, NULL, NULL, &tv);
+			if (res > 0){
+				xRecvWakeups++;
+				if (pRecvCB != NULL){
+					pRecvCB(pRecvArg);
+				}
+				fired = true;
+			} else if (res < 0){
+				break;
+			}
+		}
+	}
+}
+
+/***
+ * Time taken by the DNS lookup of the last connect
+ * @return milliseconds
+ */
+uint32_t TCPTransport::getDNSTimeMs(){
+	return xDNSTimeMs;
+}
+
+/***
+ * Did the DNS lookup of the last connect complete
+ * @return false on timeout
+ */
+bool TCPTransport::isDNSOk(){
+	return xDNSOk;
 }
 
+/***
+ * Time taken by the socket connect of the last connect
+ * @return milliseconds
+ */
+uint32_t TCPTransport::getConnectTimeMs(){
+	return xConnectTimeMs;
+}
 
 /***
  * Print the buffer in hex and plain text for debugging
@@ -12,9 +12,19 @@
 
 #define TCP_TRANSPORT_WAIT 10000
 
+//Longest the receive watcher blocks in select before checking the socket again
+#ifndef TCP_TRANSPORT_SELECT_MS
+#define TCP_TRANSPORT_SELECT_MS 5000
+#endif
+
+#ifndef TCP_TRANSPORT_WATCH_STACK
+#define TCP_TRANSPORT_WATCH_STACK 384
+#endif
+
 #include "MQTTConfig.h"
 #include "core_mqtt.h"
 #include "Transport.h"
+#include "DNSCache.h"
 
 extern "C" {
 #include <FreeRTOS.h>
@@ -29,6 +39,8 @@ extern "C" {
 }
 
 
+typedef void (*TransportRecvCallback)(void *arg);
+
 class TCPTransport : public Transport {
 public:
 	/***
@@ -86,6 +98,45 @@ public:
 	 */
 	void debugPrintBuffer(const char *title, const void * pBuffer, size_t bytes);
 
+	/***
+	 * Call back when data arrives on the socket, from a watcher task
+	 * blocked in select. Fires once, then again after the next read,
+	 * so the reader is woken rather than polling. Set before connect
+	 * @param cb - callback, NULL for none
+	 * @param arg - passed to callback
+	 */
+	void setRecvCallback(TransportRecvCallback cb, void *arg);
+
+	/***
+	 * Number of times the receive callback has fired
+	 * @return
+	 */
+	uint32_t getRecvWakeups();
+
+	/***
+	 * Number of reads that found no data waiting
+	 * @return
+	 */
+	uint32_t getEmptyReads();
+
+	/***
+	 * Time taken by the DNS lookup of the last connect
+	 * @return milliseconds
+	 */
+	uint32_t getDNSTimeMs();
+
+	/***
+	 * Did the DNS lookup of the last connect complete
+	 * @return false on timeout
+	 */
+	bool isDNSOk();
+
+	/***
+	 * Time taken by the socket connect of the last connect
+	 * @return milliseconds
+	 */
+	uint32_t getConnectTimeMs();
+
 
 private:
 
@@ -96,23 +147,23 @@ private:
 	bool transConnect();
 
 	/***
-	 * Call back function for the DNS lookup
-	 * @param name - server name
-	 * @param ipaddr - resulting IP address
-	 * @param callback_arg - poiter to TCPTransport object
+	 * Watcher task entry
+	 * @param pvParameters - TCPTransport
 	 */
-	static void dnsCB(const char *name, const ip_addr_t *ipaddr, void *callback_arg);
+	static void vWatchTask(void *pvParameters);
 
 	/***
-	 * Called when DNS is returned
-	 * @param name - server name
-	 * @param ipaddr - ip address of server
-	 * @param callback_arg - this TCPtransport object
+	 * Watcher loop, block in select until the socket is readable
 	 */
-	void dnsFound(const char *name, const ip_addr_t *ipaddr, void *callback_arg);
+	void watch();
+
+	/***
+	 * Allow the watcher to wait for the next data
+	 */
+	void rearm();
 
 	//Socket number
-	int xSock = 0;
+	int xSock = -1;
 
 	// Port to connect to
 	uint16_t xPort=80;
@@ -123,8 +174,18 @@ private:
 	// Remote server name to connect to
 	char xHostName[80];
 
-	// Semaphore used to wait on DNS responses
-	SemaphoreHandle_t xHostDNSFound;
+
+	// Phase timings of the last connect
+	uint32_t xDNSTimeMs = 0;
+	bool xDNSOk = false;
+	uint32_t xConnectTimeMs = 0;
+
+	// Receive watcher
+	TransportRecvCallback pRecvCB = NULL;
+	void * pRecvArg = NULL;
+	TaskHandle_t xWatchTask = NULL;
+	volatile uint32_t xRecvWakeups = 0;
+	volatile uint32_t xEmptyReads = 0;
 
 
 };
@@ -0,0 +1,170 @@
+/*
+ * TLSSessionCache.cpp
+ *
+ * Small cache of TLS sessions keyed by host and port so a repeat
+ * connection can offer the previous session, or ticket, and resume with
+ * an abbreviated handshake. Least recently used entry is replaced.
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#include "TLSSessionCache.h"
+#include <task.h>
+#include <string.h>
+
+/***
+ * Constructor
+ */
+TLSSessionCache::TLSSessionCache() {
+	memset(xEntries, 0, sizeof(xEntries));
+}
+
+/***
+ * Destructor
+ */
+TLSSessionCache::~TLSSessionCache() {
+	for (int i = 0; i < TLS_SESSION_CACHE_SLOTS; i++){
+		if (xEntries[i].session != NULL){
+			wolfSSL_SESSION_free(xEntries[i].session);
+		}
+	}
+}
+
+/***
+ * Create the lock on first use
+ */
+void TLSSessionCache::lock(){
+	taskENTER_CRITICAL();
+	if (xLock == NULL){
+		xLock = xSemaphoreCreateMutexStatic(&xLockBuf);
+	}
+	taskEXIT_CRITICAL();
+	xSemaphoreTake(xLock, portMAX_DELAY);
+}
+
+/***
+ * Release the lock
+ */
+void TLSSessionCache::unlock(){
+	xSemaphoreGive(xLock);
+}
+
+/***
+ * Find entry for host and port
+ * @return entry or NULL. Lock must be held
+ */
+tls_session_entry_t * TLSSessionCache::find(const char * host, uint16_t port){
+	for (int i = 0; i < TLS_SESSION_CACHE_SLOTS; i++){
+		tls_session_entry_t *e = &xEntries[i];
+		if ((e->session != NULL) && (e->port == port) &&
+				(strcmp(e->host, host) == 0)){
+			return e;
+		}
+	}
+	return NULL;
+}
+
+/***
+ * Offer any cached session for host and port to the connection.
+ * Call before the handshake
+ * @param ssl - connection
+ * @param host - server name
+ * @param port - port number
+ * @return true if a session was offered
+ */
+bool TLSSessionCache::apply(WOLFSSL * ssl, const char * host, uint16_t port){
+	bool offered = false;
+
+	lock();
+	tls_session_entry_t *e = find(host, port);
+	if (e != NULL){
+		//Session is copied into the connection so entry can be replaced later
+		if (wolfSSL_set_session(ssl, e->session) == WOLFSSL_SUCCESS){
+			e->lastUsed = ++xUseCount;
+			xOffered++;
+			offered = true;
+		} else {
+			//Expired or unusable
+			wolfSSL_SESSION_free(e->session);
+			e->session = NULL;
+		}
+	}
+	unlock();
+	return offered;
+}
+
+/***
+ * Keep the session of a connection after a successful handshake
+ * @param ssl - connection
+ * @param host - server name
+ * @param port - port number
+ */
+void TLSSessionCache::store(WOLFSSL * ssl, const char * host, uint16_t port){
+	if (strlen(host) >= TLS_SESSION_HOST_LEN){
+		return;
+	}
+
+	bool reused = (wolfSSL_session_reused(ssl) == 1);
+	WOLFSSL_SESSION *session = wolfSSL_get1_session(ssl);
+	if (session == NULL){
+		return;
+	}
+
+	lock();
+	if (reused){
+		xResumed++;
+	}
+	tls_session_entry_t *e = find(host, port);
+	if (e == NULL){
+		//Empty slot or least recently used
+		e = &xEntries[0];
+		for (int i = 0; i < TLS_SESSION_CACHE_SLOTS; i++){
+			if (xEntries[i].session == NULL){
+				e = &xEntries[i];
+				break;
+			}
+			if (xEntries[i].lastUsed < e->lastUsed){
+				e = &xEntries[i];
+			}
+		}
+		strcpy(e->host, host);
+		e->port = port;
+	}
+	if (e->session != NULL){
+		wolfSSL_SESSION_free(e->session);
+	}
+	e->session = session;
+	e->lastUsed = ++xUseCount;
+	unlock();
+}
+
+/***
+ * Drop the session for host and port, for example after a failed handshake
+ * @param host - server name
+ * @param port - port number
+ */
+void TLSSessionCache::forget(const char * host, uint16_t port){
+	lock();
+	tls_session_entry_t *e = find(host, port);
+	if (e != NULL){
+		wolfSSL_SESSION_free(e->session);
+		e->session = NULL;
+	}
+	unlock();
+}
+
+/***
+ * Number of connections that offered a cached session
+ * @return
+ */
+uint32_t TLSSessionCache::getOffered(){
+	return xOffered;
+}
+
+/***
+ * Number of connections the server resumed
+ * @return
+ */
+uint32_t TLSSessionCache::getResumed(){
+	return xResumed;
+}
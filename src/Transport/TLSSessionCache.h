@@ -0,0 +1,118 @@
+/*
+ * TLSSessionCache.h
+ *
+ * Small cache of TLS sessions keyed by host and port so a repeat
+ * connection can offer the previous session, or ticket, and resume with
+ * an abbreviated handshake. Least recently used entry is replaced.
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#ifndef TLSSESSIONCACHE_H_
+#define TLSSESSIONCACHE_H_
+
+extern "C" {
+#include <FreeRTOS.h>
+#include <semphr.h>
+
+typedef unsigned char byte_workaround;
+#define byte byte_workaround
+#include <wolfssl/wolfcrypt/types.h>
+#include <wolfssl/ssl.h>
+#undef byte
+}
+
+#include <stdint.h>
+
+#ifndef TLS_SESSION_CACHE_SLOTS
+#define TLS_SESSION_CACHE_SLOTS 4
+#endif
+
+#ifndef TLS_SESSION_HOST_LEN
+#define TLS_SESSION_HOST_LEN 80
+#endif
+
+typedef struct {
+	char 				host[TLS_SESSION_HOST_LEN];
+	uint16_t 			port;
+	WOLFSSL_SESSION * 	session;
+	uint32_t 			lastUsed;
+} tls_session_entry_t;
+
+class TLSSessionCache {
+public:
+	/***
+	 * Constructor
+	 */
+	TLSSessionCache();
+
+	/***
+	 * Destructor
+	 */
+	virtual ~TLSSessionCache();
+
+	/***
+	 * Offer any cached session for host and port to the connection.
+	 * Call before the handshake
+	 * @param ssl - connection
+	 * @param host - server name
+	 * @param port - port number
+	 * @return true if a session was offered
+	 */
+	bool apply(WOLFSSL * ssl, const char * host, uint16_t port);
+
+	/***
+	 * Keep the session of a connection after a successful handshake
+	 * @param ssl - connection
+	 * @param host - server name
+	 * @param port - port number
+	 */
+	void store(WOLFSSL * ssl, const char * host, uint16_t port);
+
+	/***
+	 * Drop the session for host and port, for example after a failed handshake
+	 * @param host - server name
+	 * @param port - port number
+	 */
+	void forget(const char * host, uint16_t port);
+
+	/***
+	 * Number of connections that offered a cached session
+	 * @return
+	 */
+	uint32_t getOffered();
+
+	/***
+	 * Number of connections the server resumed
+	 * @return
+	 */
+	uint32_t getResumed();
+
+private:
+	/***
+	 * Create the lock on first use
+	 */
+	void lock();
+
+	/***
+	 * Release the lock
+	 */
+	void unlock();
+
+	/***
+	 * Find entry for host and port
+	 * @return entry or NULL. Lock must be held
+	 */
+	tls_session_entry_t * find(const char * host, uint16_t port);
+
+	tls_session_entry_t xEntries[TLS_SESSION_CACHE_SLOTS];
+	uint32_t xUseCount = 0;
+
+	StaticSemaphore_t xLockBuf;
+	SemaphoreHandle_t xLock = NULL;
+
+	uint32_t xOffered = 0;
+	uint32_t xResumed = 0;
+};
+
+#endif /* TLSSESSIONCACHE_H_ */
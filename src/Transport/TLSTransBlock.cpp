@@ -14,13 +14,14 @@
 
 #include <stdio.h>
 
+WOLFSSL_CTX* TLSTransBlock::pCtx = NULL;
+TLSSessionCache TLSTransBlock::xSessionCache;
+
 TLSTransBlock::TLSTransBlock() {
-	xHostDNSFound = xSemaphoreCreateBinary(  );
 
 }
 
 TLSTransBlock::~TLSTransBlock() {
-	vSemaphoreDelete(xHostDNSFound);
 }
 
 /***
@@ -48,29 +49,87 @@ int32_t TLSTransBlock::transSend(const void * pBuffer, size_t bytesToSend){
  */
 int32_t TLSTransBlock::transRead(void * pBuffer, size_t bytesToRecv){
 	int32_t dataIn=0;
-	uint32_t bytesAv=0;
-	int ret;
-	int buffered;
-
-	//Only check if socket is OK
-	if (status() >= 0){
-
-		ret = ioctl (xSock,FIONREAD,&bytesAv);
-		buffered = wolfSSL_pending(pSSL);
 
-		if ((bytesAv ==0) && (buffered == 0)){
+	//IORecv waits up to the receive deadline, so nothing to poll here
+	dataIn = wolfSSL_read(pSSL, (uint8_t *)pBuffer, bytesToRecv);
+	if (dataIn < 0){
+		int err = wolfSSL_get_error(pSSL, dataIn);
+		if (err == WOLFSSL_ERROR_WANT_READ){
 			return 0;
 		}
-
+		LogError(("Read failed %d", err));
 	}
 
-	dataIn = wolfSSL_read(pSSL, (uint8_t *)pBuffer, bytesToRecv);
+	return dataIn;
+}
 
+/***
+ * Set how long a read waits for data before returning 0.
+ * Zero makes reads non blocking, the handshake still blocks.
+ * Takes effect on next connect
+ * @param ms - deadline in milliseconds
+ */
+void TLSTransBlock::setRecvTimeout(uint32_t ms){
+	xRecvTimeoutMs = ms;
+}
 
-	return dataIn;
+/***
+ * Time taken by the last TLS handshake
+ * @return milliseconds
+ */
+uint32_t TLSTransBlock::getHandshakeMs(){
+	return xHandshakeMs;
 }
 
+/***
+ * Did the last handshake resume a cached session
+ * @return true if abbreviated handshake
+ */
+bool TLSTransBlock::isResumed(){
+	return xResumed;
+}
 
+/***
+ * Session cache shared by all TLS connections
+ * @return cache
+ */
+TLSSessionCache * TLSTransBlock::getSessionCache(){
+	return &xSessionCache;
+}
+
+/***
+ * Shared context, created on first connect
+ * @return context or NULL on failure
+ */
+WOLFSSL_CTX * TLSTransBlock::getContext(){
+	if (pCtx != NULL){
+		return pCtx;
+	}
+
+	WOLFSSL_CTX *ctx = wolfSSL_CTX_new(wolfTLSv1_2_client_method());
+	if (ctx == NULL){
+		LogError(("wolfSSL_CTX_new error.\n"));
+		return NULL;
+	}
+	wolfSSL_SetIORecv(ctx, TLSTransBlock::IORecv);
+	wolfSSL_SetIOSend(ctx, TLSTransBlock::IOSend);
+	wolfSSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, NULL);
+#ifdef HAVE_SESSION_TICKET
+	wolfSSL_CTX_UseSessionTicket(ctx);
+#endif
+
+	//Another task may have got there first
+	taskENTER_CRITICAL();
+	if (pCtx == NULL){
+		pCtx = ctx;
+		ctx = NULL;
+	}
+	taskEXIT_CRITICAL();
+	if (ctx != NULL){
+		wolfSSL_CTX_free(ctx);
+	}
+	return pCtx;
+}
 
 
 
@@ -81,24 +140,17 @@ int32_t TLSTransBlock::transRead(void * pBuffer, size_t bytesToRecv){
  * @return true on success
  */
 bool TLSTransBlock::transConnect(const char * host, uint16_t port){
-	err_t res = dns_gethostbyname(host, &xHost, TLSTransBlock::dnsCB, this);
-
 	strcpy(xHostName, host);
 	xPort = port;
 
-	if (res == ERR_OK){
-		//Address in table already no lookup required
-		//printf("DNS Found %s\n", ipaddr_ntoa(&xHost));
-	} else {
-		//Lookup is being performed
-		uint32_t now = to_ms_since_boot (get_absolute_time ());
-		if (xSemaphoreTake(xHostDNSFound, TLS_TRANSPORT_WAIT) != pdTRUE){
-			printf("DNS Timeout on Connect: %s, %d After %u ms",
-					host, res,
-					to_ms_since_boot (get_absolute_time ()) - now
-					);
-			return false;
-		}
+	if (isTimeUp()){
+		LogError(("No time left to connect to %s", host));
+		return false;
+	}
+
+	if (!DNSCache::getInstance()->resolve(host, &xHost, getTimeLeft(TLS_TRANSPORT_WAIT))){
+		LogError(("DNS failed on Connect: %s", host));
+		return false;
 	}
 
 	return transConnect();
@@ -110,7 +162,6 @@ bool TLSTransBlock::transConnect(const char * host, uint16_t port){
  * @return true if socket openned
  */
 bool TLSTransBlock::transConnect(){
-	struct sockaddr_in serv_addr;
 	int                ret, err;
 
 
@@ -120,31 +171,40 @@ bool TLSTransBlock::transConnect(){
 		return false;
 	}
 
-
-	/* Create the WOLFSSL_CTX */
-	pCtx = wolfSSL_CTX_new(wolfTLSv1_2_client_method());
-	if ( pCtx == NULL){
-		LogError(("wolfSSL_CTX_new error.\n"));
+	//Handshake always blocks, so needs a deadline even for non blocking reads
+	uint32_t timeoutMs = xRecvTimeoutMs;
+	if (timeoutMs == 0){
+		timeoutMs = TLS_TRANSPORT_RECV_TIMEOUT_MS;
 	}
+	//Nor wait past the time limit, a zero timeout would block for ever
+	timeoutMs = getTimeLeft(timeoutMs);
+	if (timeoutMs == 0){
+		LogError(("No time left to connect to %s", xHostName));
+		return false;
+	}
+	struct timeval tv;
+	tv.tv_sec = timeoutMs / 1000;
+	tv.tv_usec = (timeoutMs % 1000) * 1000;
+	if (setsockopt(xSock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0){
+		LogError(("Failed to set receive timeout"));
+	}
+	xRecvFlags = 0;
 
-	wolfSSL_SetIORecv(pCtx, TLSTransBlock::IORecv);
-	wolfSSL_SetIOSend(pCtx, TLSTransBlock::IOSend);
-	wolfSSL_CTX_set_verify(pCtx, SSL_VERIFY_NONE, NULL);
 
-	memset(&serv_addr,0,sizeof(serv_addr));
-	serv_addr.sin_family = AF_INET;
-	serv_addr.sin_port = htons(xPort);
-	memcpy(&serv_addr.sin_addr.s_addr, &xHost, sizeof(xHost));
+	WOLFSSL_CTX *ctx = getContext();
+	if (ctx == NULL){
+		return false;
+	}
 
-	int res = connect(xSock,(struct sockaddr *)&serv_addr,sizeof(serv_addr));
-	if (res < 0){
+	if (!connectSocket(xSock, &xHost, xPort)){
 		char *s = ipaddr_ntoa(&xHost);
-		LogError(("ERROR connecting %d to %s port %d\n",res, s, xPort));
+		LogError(("ERROR connecting to %s port %d\n", s, xPort));
+		DNSCache::getInstance()->forget(xHostName);
 		return false;
 	}
 
 	/* Create WOLFSSL object */
-	if( (pSSL = wolfSSL_new(pCtx)) == NULL) {
+	if( (pSSL = wolfSSL_new(ctx)) == NULL) {
 	    LogError(("wolfSSL_new error.\n"));
 	    return false;
 	}
@@ -153,18 +213,43 @@ bool TLSTransBlock::transConnect(){
 		LogError(("Failed to set the FD"));
 		return false;
 	}
+	//Receive needs the object for its flags
+	wolfSSL_SetIOReadCtx(pSSL, this);
 
+	xSessionCache.apply(pSSL, xHostName, xPort);
 
+	//Each receive deadline surfaces as WANT_READ, keep going until overall wait
+	uint32_t start = to_ms_since_boot(get_absolute_time());
+	uint32_t waitMs = getTimeLeft(TLS_TRANSPORT_WAIT);
+	for (;;){
+		ret = wolfSSL_connect(pSSL);
+		err = wolfSSL_get_error(pSSL, ret);
+		if ((ret == WOLFSSL_SUCCESS) || (err != WOLFSSL_ERROR_WANT_READ)){
+			break;
+		}
+		if ((to_ms_since_boot(get_absolute_time()) - start) > waitMs){
+			break;
+		}
+	}
 
-	ret = wolfSSL_connect(pSSL);
-	err = wolfSSL_get_error(pSSL, ret);
+	xHandshakeMs = to_ms_since_boot(get_absolute_time()) - start;
 
     if (ret != WOLFSSL_SUCCESS){
         LogError(("err %d: failed to connect to wolfSSL %d\n", err, ret));
        // printf("err %d: failed to connect to wolfSSL %d\n", err, ret);
+        xSessionCache.forget(xHostName, xPort);
         return false;
     }
 
+	xResumed = (wolfSSL_session_reused(pSSL) == 1);
+	xSessionCache.store(pSSL, xHostName, xPort);
+	LogDebug(("TLS handshake %lu ms resumed %d",
+			(unsigned long)xHandshakeMs, xResumed));
+
+	if (xRecvTimeoutMs == 0){
+		xRecvFlags = MSG_DONTWAIT;
+	}
+
 	//LogInfo(("Connect success\n"));
 	return true;
 }
@@ -186,42 +271,18 @@ int TLSTransBlock::status(){
  * @return true on success
  */
 bool TLSTransBlock::transClose(){
-	wolfSSL_free(pSSL);
-	wolfSSL_CTX_free(pCtx);
-	wolfSSL_Cleanup();
-	closesocket(xSock);
+	//Context and library stay up for the next connection
+	if (pSSL != NULL){
+		wolfSSL_free(pSSL);
+		pSSL = NULL;
+	}
+	if (xSock >= 0){
+		closesocket(xSock);
+		xSock = -1;
+	}
 	return true;
 }
 
-/***
- * Call back function for the DNS lookup
- * @param name - server name
- * @param ipaddr - resulting IP address
- * @param callback_arg - poiter to TLSTransBlock object
- */
-void TLSTransBlock::dnsCB(const char *name, const ip_addr_t *ipaddr, void *callback_arg){
-	TLSTransBlock *self = (TLSTransBlock *) callback_arg;
-	self->dnsFound(name, ipaddr, callback_arg);
-}
-
-
-/***
- * Called when DNS is returned
- * @param name - server name
- * @param ipaddr - ip address of server
- * @param callback_arg - this TLSTransBlock object
- */
-void TLSTransBlock::dnsFound(const char *name, const ip_addr_t *ipaddr, void *callback_arg){
-	memcpy(&xHost, ipaddr, sizeof(xHost));
-
-	LogInfo(("DNS Found %s copied to xHost %s\n", ipaddr_ntoa(ipaddr), ipaddr_ntoa(&xHost)));
-	xSemaphoreGiveFromISR(xHostDNSFound, NULL );
-}
-
-
-
-
-
 int TLSTransBlock::IOSend(WOLFSSL* ssl, char* buff, int sz, void* ctx){
     /* By default, ctx will be a pointer to the file descriptor to write to.
      * This can be changed by calling wolfSSL_SetIOWriteCtx(). */
@@ -274,52 +335,20 @@ int TLSTransBlock::IOSend(WOLFSSL* ssl, char* buff, int sz, void* ctx){
 }
 
 int TLSTransBlock::IORecv(WOLFSSL* ssl, char* buff, int sz, void* ctx){
-    /* By default, ctx will be a pointer to the file descriptor to read from.
-     * This can be changed by calling wolfSSL_SetIOReadCtx(). */
-    int sockfd = *(int*)ctx;
+    /* ctx is set to this object by wolfSSL_SetIOReadCtx() on connect */
+    TLSTransBlock *self = (TLSTransBlock *) ctx;
     int recvd;
 
-
-
-    uint32_t bytesAv=0;
-	int ret;
-	uint32_t start = to_ms_since_boot(get_absolute_time());
-
-	while (bytesAv == 0){
-		ret = ioctl (sockfd,FIONREAD,&bytesAv);
-		if (bytesAv == 0){
-			uint32_t now = to_ms_since_boot(get_absolute_time());
-			if ((now - start) > 250){
-				printf("TIMEOUT\n");
-				return 0;
-			}
-			vTaskDelay(1);
-		}
-	}
-
-
-
-
-
-    /* Receive message from socket */
-    if ((recvd = recv(sockfd, buff, sz, 0)) == -1) {
-        /* error encountered. Be responsible and report it in wolfSSL terms */
-
-        int err = wolfSSL_get_error(ssl, errno);
-        LogError(("IO RECEIVE ERROR: errno=%d sslErr=%d", errno, err));
+    /* Blocks until data or SO_RCVTIMEO deadline, unless MSG_DONTWAIT */
+    if ((recvd = recv(self->xSock, buff, sz, self->xRecvFlags)) == -1) {
         switch (errno) {
         #if EAGAIN != EWOULDBLOCK
         case EAGAIN: /* EAGAIN == EWOULDBLOCK on some systems, but not others */
         #endif
         case EWOULDBLOCK:
-            if (!wolfSSL_dtls(ssl) || wolfSSL_get_using_nonblock(ssl)) {
-                LogError(("would block\n"));
-                return WOLFSSL_CBIO_ERR_WANT_READ;
-            }
-            else {
-                LogError(("socket timeout\n"));
-                return WOLFSSL_CBIO_ERR_TIMEOUT;
-            }
+        case ETIMEDOUT:
+            /* No data before deadline, not an error */
+            return WOLFSSL_CBIO_ERR_WANT_READ;
         case ECONNRESET:
             LogError(("connection reset\n"));
             return WOLFSSL_CBIO_ERR_CONN_RST;
@@ -337,7 +366,7 @@ int TLSTransBlock::IORecv(WOLFSSL* ssl, char* buff, int sz, void* ctx){
 			return 0;
 
         default:
-            LogError(("general error\n"));
+            LogError(("IO RECEIVE ERROR: errno=%d", errno));
             return WOLFSSL_CBIO_ERR_GENERAL;
         }
 
@@ -346,15 +375,14 @@ int TLSTransBlock::IORecv(WOLFSSL* ssl, char* buff, int sz, void* ctx){
     else if (recvd == 0) {
     	int error = 0;
 		socklen_t len = sizeof (error);
-		int retval = getsockopt (sockfd, SOL_SOCKET, SO_ERROR, &error, &len);
+		int retval = getsockopt (self->xSock, SOL_SOCKET, SO_ERROR, &error, &len);
         LogInfo(("Connection closed. Status %d\n", error));
         return WOLFSSL_CBIO_ERR_CONN_CLOSE;
     }
 
 
     /* successful receive */
-    //LogInfo(("Received %d bytes from %d\n", sz, sockfd));
+    //LogInfo(("Received %d bytes from %d\n", sz, self->xSock));
     return recvd;
 }
 
-
@@ -1,11 +1,15 @@
 /*
  * TLSTransBlock.h
  *
- * TLS Transport - Blocking socket except for transRead of 1 byte which will not block
- * Written for the FreeRTOS coreMQTT transport requirements
+ * TLS Transport - Blocking socket with a receive deadline. transRead returns 0
+ * when no data arrives before the deadline, or at once if set non blocking.
+ * Written for the FreeRTOS coreMQTT and coreHTTP transport requirements
  *
  * Does not set a certificate or enforce any certificate checks of the server
  *
+ * All connections share one WOLFSSL_CTX and offer the last session for the
+ * same host and port, so repeat connections use an abbreviated handshake
+ *
  *  Created on: 3 Apr 2023
  *      Author: jondurrant
  */
@@ -15,7 +19,14 @@
 
 #define TLS_TRANSPORT_WAIT 10000
 
+//Deadline for a blocking receive before reporting no data
+#ifndef TLS_TRANSPORT_RECV_TIMEOUT_MS
+#define TLS_TRANSPORT_RECV_TIMEOUT_MS 1000
+#endif
+
 #include "Transport.h"
+#include "DNSCache.h"
+#include "TLSSessionCache.h"
 
 extern "C" {
 #include <FreeRTOS.h>
@@ -82,29 +93,44 @@ public:
 	 */
 	int32_t transRead(void * pBuffer, size_t bytesToRecv);
 
-private:
+	/***
+	 * Set how long a read waits for data before returning 0.
+	 * Zero makes reads non blocking, the handshake still blocks.
+	 * Takes effect on next connect
+	 * @param ms - deadline in milliseconds
+	 */
+	void setRecvTimeout(uint32_t ms);
 
 	/***
-	 * Connect to socket previously stored ip address and port number
-	 * @return true if socket openned
+	 * Time taken by the last TLS handshake
+	 * @return milliseconds
 	 */
-	bool transConnect();
+	uint32_t getHandshakeMs();
 
 	/***
-	 * Call back function for the DNS lookup
-	 * @param name - server name
-	 * @param ipaddr - resulting IP address
-	 * @param callback_arg - poiter to TLSTransport object
+	 * Did the last handshake resume a cached session
+	 * @return true if abbreviated handshake
 	 */
-	static void dnsCB(const char *name, const ip_addr_t *ipaddr, void *callback_arg);
+	bool isResumed();
 
 	/***
-	 * Called when DNS is returned
-	 * @param name - server name
-	 * @param ipaddr - ip address of server
-	 * @param callback_arg - this TLStransport object
+	 * Session cache shared by all TLS connections
+	 * @return cache
 	 */
-	void dnsFound(const char *name, const ip_addr_t *ipaddr, void *callback_arg);
+	static TLSSessionCache * getSessionCache();
+
+private:
+	/***
+	 * Shared context, created on first connect
+	 * @return context or NULL on failure
+	 */
+	static WOLFSSL_CTX * getContext();
+
+	/***
+	 * Connect to socket previously stored ip address and port number
+	 * @return true if socket openned
+	 */
+	bool transConnect();
 
 
 	/***
@@ -122,15 +148,21 @@ private:
 	 * @param ssl - wolf ssl data
 	 * @param buff - buffer to write into
 	 * @param sz - max size of the buffer
-	 * @param ctx - wolfssl context
-	 * @return
+	 * @param ctx - this TLSTransBlock object
+	 * @return bytes read or WOLFSSL_CBIO_ERR_WANT_READ if deadline passed
 	 */
 	static int IORecv(WOLFSSL* ssl, char* buff, int sz, void* ctx);
 
 
 
 	//Socket number
-	int xSock = 0;
+	int xSock = -1;
+
+	// Read deadline, 0 for non blocking reads
+	uint32_t xRecvTimeoutMs = TLS_TRANSPORT_RECV_TIMEOUT_MS;
+
+	// Flags passed to recv, MSG_DONTWAIT once connected if non blocking
+	int xRecvFlags = 0;
 
 	// Port to connect to
 	uint16_t xPort=80;
@@ -141,11 +173,14 @@ private:
 	// Remote server name to connect to
 	char xHostName[80];
 
-	// Semaphore used to wait on DNS responses
-	SemaphoreHandle_t xHostDNSFound;
 
-	WOLFSSL_CTX* pCtx;
-	WOLFSSL* pSSL;
+	WOLFSSL* pSSL = NULL;
+
+	uint32_t xHandshakeMs = 0;
+	bool xResumed = false;
+
+	static WOLFSSL_CTX* pCtx;
+	static TLSSessionCache xSessionCache;
 };
 
 
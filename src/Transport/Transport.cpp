@@ -10,6 +10,7 @@
 #include "core_mqtt_config.h"
 #include "pico/stdlib.h"
 #include <errno.h>
+#include <string.h>
 
 #include <stdio.h>
 #define DEBUG_LINE 25
@@ -81,6 +82,10 @@ int32_t Transport:: staticTransRead(
          void * pBuffer,
          size_t bytesToRecv ){
 	Transport *t = (Transport *) pNetworkContext->tcpTransport;
+	if (t->isTimeUp()){
+		LogWarn(("Read past time limit"));
+		return -1;
+	}
 	return t->transRead(pBuffer,  bytesToRecv);
 }
 
@@ -96,6 +101,10 @@ int32_t Transport::staticTransSend(
 	const void * pBuffer,
 	size_t bytesToSend ){
 	Transport *t = (Transport *) pNetworkContext->tcpTransport;
+	if (t->isTimeUp()){
+		LogWarn(("Send past time limit"));
+		return -1;
+	}
 	return t->transSend(pBuffer,  bytesToSend);
 }
 
@@ -110,3 +119,88 @@ uint32_t Transport::getTime(){
 
 }
 
+/***
+ * Limit connect, reads and sends to a time from now. Once it has
+ * passed reads and sends fail, so a late caller is stopped
+ * @param ms - milliseconds allowed, UINT32_MAX for no limit
+ */
+void Transport::setTimeLimit(uint32_t ms){
+	xLimited = (ms != UINT32_MAX);
+	xLimitEnd = getTime() + ms;
+}
+
+/***
+ * Time left before the limit
+ * @param most - longest time to return
+ * @return milliseconds, no more than most. 0 once the limit has passed
+ */
+uint32_t Transport::getTimeLeft(uint32_t most){
+	if (!xLimited){
+		return most;
+	}
+	int32_t left = (int32_t)(xLimitEnd - getTime());
+	if (left <= 0){
+		return 0;
+	}
+	if ((uint32_t)left < most){
+		return (uint32_t)left;
+	}
+	return most;
+}
+
+/***
+ * Has the time limit passed
+ * @return false if there is no limit
+ */
+bool Transport::isTimeUp(){
+	return xLimited && (getTimeLeft(1) == 0);
+}
+
+/***
+ * Connect a socket, giving up if the time limit passes first.
+ * Socket is left blocking
+ * @param sock - socket number
+ * @param host - server address
+ * @param port - port number
+ * @return true on success
+ */
+bool Transport::connectSocket(int sock, const ip_addr_t * host, uint16_t port){
+	struct sockaddr_in serv_addr;
+
+	memset(&serv_addr,0,sizeof(serv_addr));
+	serv_addr.sin_family = AF_INET;
+	serv_addr.sin_port = htons(port);
+	memcpy(&serv_addr.sin_addr.s_addr, host, sizeof(ip_addr_t));
+
+	if (!xLimited){
+		return connect(sock,(struct sockaddr *)&serv_addr,sizeof(serv_addr)) >= 0;
+	}
+
+	//Connect in the background and wait no longer than the time left
+	int nonblock = 1;
+	ioctlsocket(sock, FIONBIO, &nonblock);
+	int res = connect(sock,(struct sockaddr *)&serv_addr,sizeof(serv_addr));
+	if ((res < 0) && (errno == EINPROGRESS)){
+		fd_set writeSet;
+		struct timeval tv;
+		uint32_t ms = getTimeLeft(UINT32_MAX);
+
+		FD_ZERO(&writeSet);
+		FD_SET(sock, &writeSet);
+		tv.tv_sec = ms / 1000;
+		tv.tv_usec = (ms % 1000) * 1000;
+		if (select(sock + 1, NULL, &writeSet, NULL, &tv) > 0){
+			int error = 0;
+			socklen_t len = sizeof(error);
+			getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &len);
+			if (error == 0){
+				res = 0;
+			}
+		} else {
+			LogError(("Connect timed out after %lu ms", (unsigned long) ms));
+		}
+	}
+	nonblock = 0;
+	ioctlsocket(sock, FIONBIO, &nonblock);
+	return res >= 0;
+}
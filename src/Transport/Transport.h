@@ -106,6 +106,40 @@ public:
 	 */
 	static uint32_t getTime();
 
+	/***
+	 * Limit connect, reads and sends to a time from now. Once it has
+	 * passed reads and sends fail, so a late caller is stopped
+	 * @param ms - milliseconds allowed, UINT32_MAX for no limit
+	 */
+	void setTimeLimit(uint32_t ms);
+
+	/***
+	 * Time left before the limit
+	 * @param most - longest time to return
+	 * @return milliseconds, no more than most. 0 once the limit has passed
+	 */
+	uint32_t getTimeLeft(uint32_t most);
+
+	/***
+	 * Has the time limit passed
+	 * @return false if there is no limit
+	 */
+	bool isTimeUp();
+
+protected:
+	/***
+	 * Connect a socket, giving up if the time limit passes first.
+	 * Socket is left blocking
+	 * @param sock - socket number
+	 * @param host - server address
+	 * @param port - port number
+	 * @return true on success
+	 */
+	bool connectSocket(int sock, const ip_addr_t * host, uint16_t port);
+
+private:
+	bool xLimited = false;
+	uint32_t xLimitEnd = 0;
 
 };
 
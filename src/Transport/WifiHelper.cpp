@@ -63,10 +63,23 @@ bool WifiHelper::join(const char *sid, const char *password,  uint8_t retries){
 			vTaskDelay(2000);
 		}
 	}
+	if (pJoinCB != NULL){
+		pJoinCB(pJoinArg);
+	}
 	return true;
 
 }
 
+/***
+ * Set a single callback to be made each time join succeeds
+ * @param cb - function to call, NULL to clear
+ * @param arg - passed to the callback
+ */
+void WifiHelper::setJoinCallback(WifiJoinCallback cb, void *arg){
+	pJoinArg = arg;
+	pJoinCB = cb;
+}
+
 
 
 /***
@@ -225,6 +238,8 @@ void sntpSetTimeUSec(uint32_t sec, uint32_t us){
 
 uint8_t WifiHelper::sntpServerCount = 0;
 int32_t WifiHelper::sntpTimezoneMinutesOffset = 0;
+WifiJoinCallback WifiHelper::pJoinCB = NULL;
+void * WifiHelper::pJoinArg = NULL;
 
 
 
@@ -15,6 +15,9 @@
 #define WIFI_RETRIES 3
 #endif
 
+//Callback made when the link to the AP comes up
+typedef void (*WifiJoinCallback)(void *arg);
+
 
 class WifiHelper {
 public:
@@ -116,11 +119,21 @@ public:
 	 */
 	static void setTimeSec(uint32_t sec);
 
+	/***
+	 * Set a single callback to be made each time join succeeds
+	 * @param cb - function to call, NULL to clear
+	 * @param arg - passed to the callback
+	 */
+	static void setJoinCallback(WifiJoinCallback cb, void *arg);
+
 	static int32_t sntpTimezoneMinutesOffset;
 private:
 	
 	static uint8_t sntpServerCount;
 
+	static WifiJoinCallback pJoinCB;
+	static void * pJoinArg;
+
 };
 
 #endif /* SRC_WIFIHELPER_H_ */
@@ -0,0 +1,138 @@
+/*
+ * IconCache.cpp
+ *
+ * Flash backed cache of weather icons, keyed by icon code. Each icon is
+ * held as a packed 1 bit per pixel bitmap already dithered for the
+ * display, so it is drawn straight out of XIP flash. The region sits just
+ * below the NVS region at the top of flash and is only erased once full.
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#include "IconCache.h"
+#include <string.h>
+
+static_assert(sizeof(icon_slot_t) <= ICON_CACHE_SLOT_SIZE, "Icon slot too small");
+static_assert((ICON_CACHE_SLOT_SIZE % FLASH_PAGE_SIZE) == 0, "Icon slot not page aligned");
+static_assert((ICON_CACHE_SIZE % FLASH_SECTOR_SIZE) == 0, "Icon cache not sector aligned");
+
+IconCache * IconCache::pSingleton = NULL;
+
+/***
+ * Get the single cache
+ * @return cache
+ */
+IconCache * IconCache::getInstance(){
+	if (IconCache::pSingleton == NULL) {
+		IconCache::pSingleton = new IconCache();
+	}
+	return IconCache::pSingleton;
+}
+
+/***
+ * Constructor
+ */
+IconCache::IconCache() {
+	// NOP
+}
+
+/***
+ * Destructor
+ */
+IconCache::~IconCache() {
+	// NOP
+}
+
+/***
+ * Slot in XIP flash
+ * @param i - index
+ * @return slot
+ */
+const icon_slot_t * IconCache::slot(int i){
+	return (const icon_slot_t *)(ICON_CACHE_READ_START + i * ICON_CACHE_SLOT_SIZE);
+}
+
+/***
+ * Find an icon
+ * @param code - icon code, such as "04d"
+ * @return bitmap in XIP flash, ICON_CACHE_W x ICON_CACHE_H, or NULL
+ */
+const uint8_t * IconCache::find(const char *code){
+	for (int i = 0; i < ICON_CACHE_SLOTS; i++){
+		const icon_slot_t *s = slot(i);
+		if (s->magic == 0xFFFFFFFF){
+			//Slots are filled in order, rest are erased
+			break;
+		}
+		if ((s->magic == ICON_CACHE_MAGIC) &&
+				(s->width == ICON_CACHE_W) && (s->height == ICON_CACHE_H) &&
+				(strncmp(s->code, code, sizeof(s->code)) == 0)){
+			xHits++;
+			return s->data;
+		}
+	}
+	xMisses++;
+	return NULL;
+}
+
+/***
+ * Write an icon to flash. Erases the region first if it is full
+ * @param code - icon code
+ * @param bitmap - ICON_CACHE_BYTES packed bitmap
+ * @return true if stored
+ */
+bool IconCache::store(const char *code, const uint8_t *bitmap){
+	int idx = 0;
+	bool erase = false;
+
+	if (strlen(code) >= sizeof(((icon_slot_t *)0)->code)){
+		LogError(("Icon code %s too long", code));
+		return false;
+	}
+
+	while ((idx < ICON_CACHE_SLOTS) && (slot(idx)->magic != 0xFFFFFFFF)){
+		idx++;
+	}
+	if (idx >= ICON_CACHE_SLOTS){
+		LogInfo(("Icon cache full, erasing"));
+		idx = 0;
+		erase = true;
+	}
+
+	uint8_t *mem = (uint8_t *)malloc(ICON_CACHE_SLOT_SIZE);
+	if (mem == NULL){
+		return false;
+	}
+	memset(mem, 0xFF, ICON_CACHE_SLOT_SIZE);
+	icon_slot_t *s = (icon_slot_t *)mem;
+	s->magic = ICON_CACHE_MAGIC;
+	memset(s->code, 0, sizeof(s->code));
+	strcpy(s->code, code);
+	s->width = ICON_CACHE_W;
+	s->height = ICON_CACHE_H;
+	memcpy(s->data, bitmap, ICON_CACHE_BYTES);
+
+	//When full idx is 0, so the erase starts at the region
+	NVSOnboard::flashWrite(ICON_CACHE_WRITE_START + idx * ICON_CACHE_SLOT_SIZE,
+			mem, ICON_CACHE_SLOT_SIZE, erase ? ICON_CACHE_SIZE : 0);
+	free(mem);
+
+	LogInfo(("Icon %s cached in slot %d", code, idx));
+	return true;
+}
+
+/***
+ * Number of lookups that found the icon
+ * @return
+ */
+uint32_t IconCache::getHits(){
+	return xHits;
+}
+
+/***
+ * Number of lookups that missed
+ * @return
+ */
+uint32_t IconCache::getMisses(){
+	return xMisses;
+}
@@ -0,0 +1,113 @@
+/*
+ * IconCache.h
+ *
+ * Flash backed cache of weather icons, keyed by icon code. Each icon is
+ * held as a packed 1 bit per pixel bitmap already dithered for the
+ * display, so it is drawn straight out of XIP flash. The region sits just
+ * below the NVS region at the top of flash and is only erased once full.
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#ifndef ICONCACHE_H_
+#define ICONCACHE_H_
+
+#include "IconDither.h"
+#include "NVSOnboard.h"
+#include "logging_config.h"
+
+#ifndef ICON_CACHE_W
+#define ICON_CACHE_W 48
+#endif
+
+#ifndef ICON_CACHE_H
+#define ICON_CACHE_H 48
+#endif
+
+#define ICON_CACHE_BYTES ICON_DITHER_BYTES(ICON_CACHE_W, ICON_CACHE_H)
+
+//Slot must hold header and bitmap and be a multiple of FLASH_PAGE_SIZE
+#ifndef ICON_CACHE_SLOT_SIZE
+#define ICON_CACHE_SLOT_SIZE 512
+#endif
+
+//OpenWeatherMap uses 18 icon codes
+#ifndef ICON_CACHE_SLOTS
+#define ICON_CACHE_SLOTS 24
+#endif
+
+//Size must be a multiple of FLASH_SECTOR_SIZE
+#define ICON_CACHE_SIZE (ICON_CACHE_SLOTS * ICON_CACHE_SLOT_SIZE)
+#define ICON_CACHE_WRITE_START (FLASH_WRITE_START - ICON_CACHE_SIZE)
+#define ICON_CACHE_READ_START  (ICON_CACHE_WRITE_START + XIP_BASE)
+
+#define ICON_CACHE_MAGIC 0x49434f4e
+
+typedef struct {
+	uint32_t magic;		//Erased flash reads 0xFFFFFFFF
+	char code[8];
+	uint16_t width;
+	uint16_t height;
+	uint8_t data[ICON_CACHE_BYTES];
+} icon_slot_t;
+
+class IconCache {
+public:
+	/***
+	 * Get the single cache
+	 * @return cache
+	 */
+	static IconCache * getInstance();
+
+	/***
+	 * Find an icon
+	 * @param code - icon code, such as "04d"
+	 * @return bitmap in XIP flash, ICON_CACHE_W x ICON_CACHE_H, or NULL
+	 */
+	const uint8_t * find(const char *code);
+
+	/***
+	 * Write an icon to flash. Erases the region first if it is full
+	 * @param code - icon code
+	 * @param bitmap - ICON_CACHE_BYTES packed bitmap
+	 * @return true if stored
+	 */
+	bool store(const char *code, const uint8_t *bitmap);
+
+	/***
+	 * Number of lookups that found the icon
+	 * @return
+	 */
+	uint32_t getHits();
+
+	/***
+	 * Number of lookups that missed
+	 * @return
+	 */
+	uint32_t getMisses();
+
+private:
+	/***
+	 * Constructor
+	 */
+	IconCache();
+
+	/***
+	 * Destructor
+	 */
+	virtual ~IconCache();
+
+	/***
+	 * Slot in XIP flash
+	 * @param i - index
+	 * @return slot
+	 */
+	static const icon_slot_t * slot(int i);
+
+	static IconCache * pSingleton;
+
+	uint32_t xHits = 0;
+	uint32_t xMisses = 0;
+};
+
+#endif /* ICONCACHE_H_ */
@@ -0,0 +1,82 @@
+/*
+ * IconDither.cpp
+ *
+ * Converts RGBA8 image rows into a packed 1 bit per pixel bitmap for the
+ * e-ink display. Scales to the target size by nearest neighbour and uses a
+ * 4x4 ordered dither. Transparent pixels are treated as white paper.
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#include "IconDither.h"
+#include <string.h>
+
+//Bayer matrix, scaled to thresholds by *16 + 8
+static const uint8_t xBayer[4][4] = {
+	{ 0,  8,  2, 10},
+	{12,  4, 14,  6},
+	{ 3, 11,  1,  9},
+	{15,  7, 13,  5}
+};
+
+/***
+ * Constructor
+ * @param out - bitmap to fill, MSB first, set bit is black
+ * @param outW - width of bitmap in pixels
+ * @param outH - height of bitmap in pixels
+ */
+IconDither::IconDither(uint8_t *out, uint16_t outW, uint16_t outH) :
+		pOut(out), xOutW(outW), xOutH(outH) {
+	// NOP
+}
+
+/***
+ * Destructor
+ */
+IconDither::~IconDither() {
+	// NOP
+}
+
+/***
+ * Start a new source image. Clears the bitmap to white
+ * @param srcW - source width in pixels
+ * @param srcH - source height in pixels
+ */
+void IconDither::begin(uint32_t srcW, uint32_t srcH){
+	xSrcW = srcW;
+	xSrcH = srcH;
+	xNextRow = 0;
+	memset(pOut, 0, ICON_DITHER_BYTES(xOutW, xOutH));
+}
+
+/***
+ * Feed one source row. Rows must be fed top to bottom.
+ * Writes every output row that samples this source row
+ * @param rgba - srcW RGBA8 pixels
+ * @param srcY - index of the row in the source
+ */
+void IconDither::row(const uint8_t *rgba, uint32_t srcY){
+	uint16_t stride = (xOutW + 7) / 8;
+
+	if ((xSrcW == 0) || (xSrcH == 0)){
+		return;
+	}
+
+	while ((xNextRow < xOutH) &&
+			(((uint32_t)xNextRow * xSrcH / xOutH) <= srcY)){
+		uint8_t *line = &pOut[xNextRow * stride];
+
+		for (uint16_t x = 0; x < xOutW; x++){
+			const uint8_t *p = &rgba[((uint32_t)x * xSrcW / xOutW) * 4];
+
+			//Luma, then composite over white
+			uint32_t l = (p[0] * 77 + p[1] * 150 + p[2] * 29) >> 8;
+			l = (l * p[3] + 255 * (255 - p[3])) / 255;
+
+			if (l < (uint32_t)(xBayer[xNextRow & 3][x & 3] * 16 + 8)){
+				line[x >> 3] |= (0x80 >> (x & 7));
+			}
+		}
+		xNextRow++;
+	}
+}
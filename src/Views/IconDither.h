@@ -0,0 +1,61 @@
+/*
+ * IconDither.h
+ *
+ * Converts RGBA8 image rows into a packed 1 bit per pixel bitmap for the
+ * e-ink display. Scales to the target size by nearest neighbour and uses a
+ * 4x4 ordered dither. Transparent pixels are treated as white paper.
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#ifndef ICONDITHER_H_
+#define ICONDITHER_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+//Bytes in a packed bitmap, rows padded to whole bytes
+#define ICON_DITHER_BYTES(w, h) ((((w) + 7) / 8) * (h))
+
+class IconDither {
+public:
+	/***
+	 * Constructor
+	 * @param out - bitmap to fill, MSB first, set bit is black
+	 * @param outW - width of bitmap in pixels
+	 * @param outH - height of bitmap in pixels
+	 */
+	IconDither(uint8_t *out, uint16_t outW, uint16_t outH);
+
+	/***
+	 * Destructor
+	 */
+	virtual ~IconDither();
+
+	/***
+	 * Start a new source image. Clears the bitmap to white
+	 * @param srcW - source width in pixels
+	 * @param srcH - source height in pixels
+	 */
+	void begin(uint32_t srcW, uint32_t srcH);
+
+	/***
+	 * Feed one source row. Rows must be fed top to bottom.
+	 * Writes every output row that samples this source row
+	 * @param rgba - srcW RGBA8 pixels
+	 * @param srcY - index of the row in the source
+	 */
+	void row(const uint8_t *rgba, uint32_t srcY);
+
+private:
+	uint8_t *pOut;
+	uint16_t xOutW;
+	uint16_t xOutH;
+	uint32_t xSrcW = 0;
+	uint32_t xSrcH = 0;
+
+	// Next output row to be written
+	uint16_t xNextRow = 0;
+};
+
+#endif /* ICONDITHER_H_ */
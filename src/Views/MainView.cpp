@@ -1,6 +1,7 @@
 #include "ViewUtil.h"
 #include "MainView.h"
 #include "View.h"
+#include "IconCache.h"
 #include "hardware/rtc.h"
 #include <math.h>
 
@@ -94,6 +95,11 @@ void MainView::displayClockView(void) {
 			char weatherString[50];
 			snprintf(weatherString, 50, " %.1f F %s" , temp, desc);
 			badger.text(weatherString, DISPLAY_WIDTH/3  , DISPLAY_HEIGHT/2 +TITLE_TEXT_SPACING, TEXT_SIZE);
+
+			const uint8_t *bitmap = IconCache::getInstance()->find(icon);
+			if (bitmap != NULL){
+				drawIcon(bitmap, DISPLAY_WIDTH - ICON_CACHE_W - 6*TEXT_PADDING, TEXT_PADDING);
+			}
 		}
 		else {
 
@@ -140,15 +146,25 @@ void MainView::drawSideLabels(void) {
 
 }
 
-void MainView::updateWeatherInfo(WeatherServiceRequest& req) {
-	
-	if (req.getWeather("37.76213", "-122.3943")){
-		req.getTempValues(temp, tempMin, tempMax);
-		req.getDesc(desc);
-		req.getLoc(loc);
-		LogInfo(("Got weather %s, %s, %.2f, %.2f, %.2f", loc, desc, temp, tempMin, tempMax));
-	}
-	else {
-		LogError(("Failed to get weather"));
+void MainView::drawIcon(const uint8_t *bitmap, int x, int y) {
+	//Bitmap is read straight from XIP flash, set bits are black
+	const int stride = (ICON_CACHE_W + 7) / 8;
+	badger.pen(0);
+	for (int j = 0; j < ICON_CACHE_H; j++) {
+		const uint8_t *line = &bitmap[j * stride];
+		for (int i = 0; i < ICON_CACHE_W; i++) {
+			if (line[i >> 3] & (0x80 >> (i & 7))) {
+				badger.pixel(x + i, y + j);
+			}
+		}
 	}
 }
+
+void MainView::updateWeatherInfo(WeatherServiceRequest& req) {
+	//Request has already run on the HTTP worker, just take the result
+	req.getTempValues(temp, tempMin, tempMax);
+	req.getDesc(desc);
+	req.getLoc(loc);
+	req.getIconCode(icon);
+	LogInfo(("Got weather %s, %s, %.2f, %.2f, %.2f", loc, desc, temp, tempMin, tempMax));
+}
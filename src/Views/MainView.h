@@ -49,6 +49,7 @@ private:
 	//Display helper functions
 	void drawClock(uint8_t x, uint8_t y, uint8_t handLen, uint8_t hour, uint8_t min);
 	void drawSideLabels(void);
+	void drawIcon(const uint8_t *bitmap, int x, int y);
 
 	std::shared_ptr<EventView> eventView;
 	std::shared_ptr<ReminderView> reminderView;
@@ -69,7 +70,7 @@ private:
 	float tempMax = 0.0f;
 	char desc[20];
 	char loc[20];
-	char icon[5];
+	char icon[5] = "";
 };
 
 #endif
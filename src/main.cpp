@@ -27,7 +27,9 @@
 #include "MQTTAgent.h"
 #include "MQTTAgentObserver.h"
 #include "BadgerAgent.h"
+#include "HTTPAgent.h"
 #include "MQTTRouterBadger.h"
+#include "MQTTRouterTrie.h"
 #include "NVSOnboard.h"
 #include "Request.h"
 
@@ -55,6 +57,9 @@
 #error "MQTT_PORT not defined"
 #endif
 
+//Print per core idle time from the main loop
+//#define IDLE_STATS
+
 
 #define TASK_PRIORITY			( tskIDLE_PRIORITY + 1UL )
 
@@ -113,6 +118,52 @@ void runTimeStats(   ){
 }
 
 
+#ifdef IDLE_STATS
+/***
+ * Print percentage of time each idle task, one per core, has run
+ * since the last call
+ */
+void idleStats(){
+	static unsigned long ulLastTotal = 0;
+	static unsigned long ulLastIdle[configNUM_CORES] = {0};
+	TaskStatus_t *pxTaskStatusArray;
+	UBaseType_t uxArraySize;
+	unsigned long ulTotalRunTime;
+	unsigned long ulDelta;
+	int idle = 0;
+
+	uxArraySize = uxTaskGetNumberOfTasks();
+	pxTaskStatusArray = (TaskStatus_t *)pvPortMalloc( uxArraySize * sizeof( TaskStatus_t ) );
+	if( pxTaskStatusArray == NULL ){
+		printf("Failed to allocate space for idle stats\n");
+		return;
+	}
+
+	uxArraySize = uxTaskGetSystemState( pxTaskStatusArray,
+							 uxArraySize,
+							 &ulTotalRunTime );
+	ulDelta = ulTotalRunTime - ulLastTotal;
+	ulLastTotal = ulTotalRunTime;
+
+	for(UBaseType_t x = 0; x < uxArraySize; x++ ){
+		if ((strncmp(pxTaskStatusArray[ x ].pcTaskName, "IDLE", 4) == 0) &&
+				(idle < configNUM_CORES)){
+			unsigned long ulIdle = pxTaskStatusArray[ x ].ulRunTimeCounter - ulLastIdle[idle];
+			ulLastIdle[idle] = pxTaskStatusArray[ x ].ulRunTimeCounter;
+			if (ulDelta > 0){
+				printf("%s: %lu%% idle\n",
+						pxTaskStatusArray[ x ].pcTaskName,
+						(unsigned long)(((unsigned long long)ulIdle * 100) / ulDelta));
+			}
+			idle++;
+		}
+	}
+
+	vPortFree( pxTaskStatusArray );
+}
+#endif
+
+
 void sntpInit(void) {
 
 	//Setup SNTP to get time
@@ -171,7 +222,7 @@ void getWifiCredentialNVS(char* ssid, char* password, size_t maxSize) {
 	} else {
 		printf("%s Key not present\n", "SSID");
 		nvs->set_str("SSID", WIFI_SSID);
-		nvs->commit();
+		nvs->flush();
 		strncpy(ssid,WIFI_SSID, maxSize);
 	}
 	
@@ -183,7 +234,7 @@ void getWifiCredentialNVS(char* ssid, char* password, size_t maxSize) {
 	} else {
 		printf("%s Key not present\n", "PASSWORD");
 		nvs->set_str("PASSWORD", WIFI_PASSWORD);
-		nvs->commit();
+		nvs->flush();
 		strncpy(password, WIFI_PASSWORD, maxSize);
 	}
 }
@@ -237,6 +288,8 @@ void wifiInit(void) {
 void main_task(void *params){
 
 	printf("Main task started\n");
+	//Coalesce commits from the agents, credentials are flushed
+	NVSOnboard::getInstance()->setWriteBack(true);
 #if WIFI_ENABLED
 	wifiInit();
 	sntpInit();
@@ -245,11 +298,20 @@ void main_task(void *params){
 	MQTTAgentObserver mqttObs;
 	MQTTInit(mqttAgent, mqttObs);
 
+	//HTTP requests run here so they never block the badger task
+	HTTPAgent httpAgent;
+	httpAgent.start("HTTPAgent", TASK_PRIORITY);
+
 	//Create Badger Agent and router
 	BadgerAgent badAgent(&mqttAgent);
+	badAgent.setHTTPAgent(&httpAgent);
 	badAgent.start("BadAgent", TASK_PRIORITY);
 	MQTTRouterBadger badRouter(&badAgent);
-	mqttAgent.setRouter(&badRouter);
+
+	//Topic router shared by all agents, static as tables are sized at build
+	static MQTTRouterTrie router;
+	router.addRoute(badRouter.getTopic(&mqttAgent), &badRouter, 1);
+	mqttAgent.setRouter(&router);
 
 #if BLE_ENABLED	
 	BleServer_Init();
@@ -264,6 +326,7 @@ void main_task(void *params){
 	//Bind to CORE 1
 	UBaseType_t coreMask = 0x2;
 	vTaskCoreAffinitySet( mqttAgent.getTask(), coreMask );
+	vTaskCoreAffinitySet( httpAgent.getTask(), coreMask );
 
 	//Bind to CORE 0
 	coreMask = 0x1;
@@ -272,6 +335,9 @@ void main_task(void *params){
     while(true) {
 
     	//runTimeStats();
+#ifdef IDLE_STATS
+    	idleStats();
+#endif
 
         vTaskDelay(3000);
 #if WIFI_ENABLED